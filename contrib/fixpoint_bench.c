@@ -0,0 +1,178 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Benchmarks rgbasm's integer fixed-point functions against the libm path they
+ * replaced, and checks that both agree wherever libm's result is in range.
+ *
+ * Build and run with `make bench`, or the `bench` target of the CMake build;
+ * `./fixpoint_bench [calls]` runs it with a different number of calls.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "asm/fixpoint.h"
+#include "asm/warning.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* fixpoint.c only warns about `_PI`, which is not benchmarked */
+void warning(enum WarningID id, const char *fmt, ...)
+{
+	(void)id;
+	(void)fmt;
+}
+
+/* The libm path, as it was before the integer functions */
+#define fix2double(i)	((double)((i) / 65536.0))
+#define fdeg2rad(f)	((f) * (M_PI / 32768.0))
+#define rad2fdeg(r)	((r) * (32768.0 / M_PI))
+
+/* Results out of 16.16's range are left to the caller, which skips them */
+static double libmSin(int32_t i, int32_t j)   { (void)j; return sin(fdeg2rad(fix2double(i))); }
+static double libmTan(int32_t i, int32_t j)   { (void)j; return tan(fdeg2rad(fix2double(i))); }
+static double libmASin(int32_t i, int32_t j)  { (void)j; return rad2fdeg(asin(fix2double(i))); }
+static double libmATan(int32_t i, int32_t j)  { (void)j; return rad2fdeg(atan(fix2double(i))); }
+static double libmATan2(int32_t i, int32_t j) { return rad2fdeg(atan2(fix2double(i), fix2double(j))); }
+static double libmMul(int32_t i, int32_t j)   { return fix2double(i) * fix2double(j); }
+static double libmDiv(int32_t i, int32_t j)   { return fix2double(i) / fix2double(j); }
+static double libmPow(int32_t i, int32_t j)   { return pow(fix2double(i), fix2double(j)); }
+static double libmLog(int32_t i, int32_t j)   { return log(fix2double(i)) / log(fix2double(j)); }
+
+static int32_t intSin(int32_t i, int32_t j)   { (void)j; return fix_Sin(i); }
+static int32_t intTan(int32_t i, int32_t j)   { (void)j; return fix_Tan(i); }
+static int32_t intASin(int32_t i, int32_t j)  { (void)j; return fix_ASin(i); }
+static int32_t intATan(int32_t i, int32_t j)  { (void)j; return fix_ATan(i); }
+
+static uint32_t rngState = 1;
+
+static uint32_t rng(void)
+{
+	/* xorshift32, so that every run uses the same inputs */
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+/* Inputs for which the function is defined, and its result is interesting */
+enum Domain {
+	ANY,      /* Any value */
+	UNIT,     /* [-1; 1] */
+	SMALL,    /* [-256; 256], both operands */
+	POSITIVE, /* ]0; 32768[, both operands */
+};
+
+static int32_t input(enum Domain domain)
+{
+	switch (domain) {
+	case ANY:
+		return rng();
+	case UNIT:
+		return (int32_t)(rng() % 131073) - 65536;
+	case SMALL:
+		return (int32_t)(rng() % (512 << 16)) - (256 << 16);
+	case POSITIVE:
+		return rng() % 0x7FFFFFFF + 1;
+	}
+	return 0;
+}
+
+static struct Benchmark {
+	char const *name;
+	double (*libm)(int32_t i, int32_t j);
+	int32_t (*integer)(int32_t i, int32_t j);
+	enum Domain domain;
+} const benchmarks[] = {
+	{ "SIN",   libmSin,   intSin,    ANY      },
+	{ "TAN",   libmTan,   intTan,    ANY      },
+	{ "ASIN",  libmASin,  intASin,   UNIT     },
+	{ "ATAN",  libmATan,  intATan,   ANY      },
+	{ "ATAN2", libmATan2, fix_ATan2, ANY      },
+	{ "MUL",   libmMul,   fix_Mul,   SMALL    },
+	{ "DIV",   libmDiv,   fix_Div,   ANY      },
+	{ "POW",   libmPow,   fix_Pow,   POSITIVE },
+	{ "LOG",   libmLog,   fix_Log,   POSITIVE },
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long nbCalls = argc > 1 ? strtoul(argv[1], NULL, 0) : 2000000;
+	int32_t *inputs = malloc(sizeof(*inputs) * nbCalls * 2);
+	bool mismatched = false;
+
+	if (!inputs || nbCalls == 0) {
+		fputs("Usage: fixpoint_bench [calls]\n", stderr);
+		return 1;
+	}
+
+	printf("%-6s %12s %12s %10s\n", "", "libm ns", "integer ns", "mismatches");
+	for (size_t b = 0; b < sizeof(benchmarks) / sizeof(*benchmarks); b++) {
+		struct Benchmark const *bench = &benchmarks[b];
+
+		for (unsigned long n = 0; n < nbCalls * 2; n++)
+			inputs[n] = input(bench->domain);
+
+		/* Accumulate the results, so that the calls are not optimized out */
+		volatile double libmSink = 0;
+		volatile int32_t intSink = 0;
+		double start = now();
+
+		for (unsigned long n = 0; n < nbCalls; n++)
+			libmSink += bench->libm(inputs[2 * n], inputs[2 * n + 1]);
+
+		double libmTime = now() - start;
+
+		start = now();
+		for (unsigned long n = 0; n < nbCalls; n++)
+			intSink += bench->integer(inputs[2 * n], inputs[2 * n + 1]);
+
+		double intTime = now() - start;
+		unsigned long nbMismatches = 0;
+
+		for (unsigned long n = 0; n < nbCalls; n++) {
+			double raw = bench->libm(inputs[2 * n], inputs[2 * n + 1]) * 65536.0;
+			double expected = round(raw);
+
+			/* Only compare where the libm result was defined and in range */
+			if (isnan(expected) || expected >= 2147483647.0 || expected <= -2147483648.0)
+				continue;
+			/*
+			 * libm works on the inputs rounded to doubles, which near a pole of TAN
+			 * shifts its results enough to round near-ties the wrong way
+			 */
+			if (fabs(fabs(raw - trunc(raw)) - 0.5) < fabs(raw) * 0x1p-30)
+				continue;
+			if ((int32_t)expected != bench->integer(inputs[2 * n], inputs[2 * n + 1]))
+				nbMismatches++;
+		}
+		if (nbMismatches)
+			mismatched = true;
+
+		printf("%-6s %12.1f %12.1f %10lu\n", bench->name, libmTime * 1e9 / nbCalls,
+		       intTime * 1e9 / nbCalls, nbMismatches);
+	}
+
+	free(inputs);
+	return mismatched;
+}
@@ -13,6 +13,10 @@
 
 struct Charmap *charmap_New(const char *name, const char *baseName);
 void charmap_Delete(struct Charmap *charmap);
+void charmap_Reset(void);
+void charmap_ForEach(void (*mapFunc)(char const *name, void *arg),
+		     void (*charFunc)(char const *mapping, uint8_t value, void *arg), void *arg);
+char const *charmap_GetCurrentName(void);
 void charmap_Set(const char *name);
 void charmap_Push(void);
 void charmap_Pop(void);
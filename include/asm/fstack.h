@@ -60,6 +60,8 @@ struct FileStackNode *fstk_GetFileStack(void);
 char const *fstk_GetFileName(void);
 
 void fstk_AddIncludePath(char const *s);
+void fstk_AddDep(char const *path);
+void fstk_WriteDeps(void);
 /**
  * @param path The user-provided file name
  * @param fullPath The address of a pointer, which will be made to point at the full path
@@ -79,5 +81,6 @@ void fstk_StopRept(void);
 bool fstk_Break(void);
 
 void fstk_Init(char const *mainPath, size_t maxDepth);
+void fstk_Reset(void);
 
 #endif /* RGBDS_ASM_FSTACK_H */
@@ -56,6 +56,7 @@ struct LexerState *lexer_OpenFile(char const *path);
 struct LexerState *lexer_OpenFileView(char const *path, char *buf, size_t size, uint32_t lineNo);
 void lexer_RestartRept(uint32_t lineNo);
 void lexer_DeleteState(struct LexerState *state);
+char *lexer_FindIncludeGuard(struct LexerState const *state);
 void lexer_Init(void);
 
 enum LexerMode {
@@ -30,7 +30,9 @@ char *macro_GetAllArgs(void);
 uint32_t macro_GetUniqueID(void);
 char const *macro_GetUniqueIDStr(void);
 void macro_SetUniqueID(uint32_t id);
+uint32_t macro_GetMaxUniqueID(void);
 uint32_t macro_UseNewUniqueID(void);
+void macro_Reset(void);
 void macro_ShiftCurrentArgs(int32_t count);
 uint32_t macro_NbArgs(void);
 
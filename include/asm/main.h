@@ -26,4 +26,11 @@ extern bool generatedMissingIncludes;
 extern bool failedOnMissingInclude;
 extern bool generatePhonyDeps;
 
+enum DependFormat {
+	DEPFORMAT_MAKE, /* One rule per dependency */
+	DEPFORMAT_NINJA, /* A single rule listing all dependencies, without phony targets */
+};
+
+extern enum DependFormat dependFormat;
+
 #endif /* RGBDS_MAIN_H */
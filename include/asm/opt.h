@@ -20,5 +20,7 @@ void opt_Parse(char const *option);
 
 void opt_Push(void);
 void opt_Pop(void);
+void opt_SaveDefaults(void);
+void opt_Reset(void);
 
 #endif
@@ -26,5 +26,6 @@ void out_CreatePatch(uint32_t type, struct Expression const *expr, uint32_t ofs,
 bool out_CreateAssert(enum AssertionType type, struct Expression const *expr,
 		      char const *message, uint32_t ofs);
 void out_WriteObject(void);
+void out_Reset(void);
 
 #endif /* RGBDS_ASM_OUTPUT_H */
@@ -0,0 +1,32 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Precompiled headers: snapshots of the assembler's state after a prelude file
+ */
+
+#ifndef RGBDS_ASM_PCH_H
+#define RGBDS_ASM_PCH_H
+
+#include <stdbool.h>
+
+/* Remember the state that the prelude about to be assembled will be compared against */
+void pch_StartEmit(void);
+void pch_AddDependency(char const *path);
+bool pch_Write(char const *pchName);
+
+/* Read a precompiled header, and check whether the files it was built from changed */
+void pch_Load(char const *pchName);
+/*
+ * Restore the state saved in the loaded precompiled header
+ * Returns false if it is out of date, in which case the prelude must be included instead
+ */
+bool pch_Apply(void);
+char const *pch_GetPreludeName(void);
+
+#endif /* RGBDS_ASM_PCH_H */
@@ -15,18 +15,32 @@
 #include "linkdefs.h"
 
 #define MAXRPNLEN 1048576
+// Short RPN expressions are stored in the expression itself, to avoid allocations
+#define RPN_INLINE_SIZE 48
 
 struct Expression {
 	int32_t  val;          // If the expression's value is known, it's here
-	char     *reason;      // Why the expression is not known, if it isn't
+	// Why the expression is not known, if it isn't; this is a format string, whose
+	// only "%s", if any, is the name stored at offset `reasonArg` in the RPN buffer
+	char const *reason;
+	uint32_t reasonArg;
 	bool     isKnown;      // Whether the expression's value is known
 	bool     isSymbol;     // Whether the expression represents a symbol
-	uint8_t  *rpn;         // Array of bytes serializing the RPN expression
-	uint32_t rpnCapacity;  // Size of the `rpn` buffer
-	uint32_t rpnLength;    // Used size of the `rpn` buffer
+	uint8_t  *rpn;         // Heap-allocated RPN buffer, or NULL if stored in `rpnBuf`
+	uint32_t rpnCapacity;  // Size of the RPN buffer
+	uint32_t rpnLength;    // Used size of the RPN buffer
 	uint32_t rpnPatchSize; // Size the expression will take in the object file
+	uint8_t  rpnBuf[RPN_INLINE_SIZE]; // Inline RPN buffer, used while it's large enough
 };
 
+/*
+ * Get the array of bytes serializing the RPN expression
+ */
+static inline uint8_t const *rpn_GetBytes(struct Expression const *expr)
+{
+	return expr->rpn ? expr->rpn : expr->rpnBuf;
+}
+
 /*
  * Determines if an expression is known at assembly time
  */
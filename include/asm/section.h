@@ -59,17 +59,18 @@ void sect_StartUnion(void);
 void sect_NextUnionMember(void);
 void sect_EndUnion(void);
 void sect_CheckUnionClosed(void);
+void sect_Reset(void);
 
 void sect_AbsByte(uint8_t b);
-void sect_AbsByteGroup(uint8_t const *s, int32_t length);
-void sect_AbsWordGroup(uint8_t const *s, int32_t length);
-void sect_AbsLongGroup(uint8_t const *s, int32_t length);
 void sect_Skip(int32_t skip, bool ds);
 void sect_String(char const *s);
 void sect_RelByte(struct Expression *expr, uint32_t pcShift);
 void sect_RelBytes(uint32_t n, struct Expression *exprs, size_t size);
 void sect_RelWord(struct Expression *expr, uint32_t pcShift);
 void sect_RelLong(struct Expression *expr, uint32_t pcShift);
+void sect_DataValue(struct Expression *expr, uint8_t size);
+void sect_DataString(uint8_t const *s, int32_t length, uint8_t size);
+void sect_EndDataList(void);
 void sect_PCRelByte(struct Expression *expr, uint32_t pcShift);
 void sect_BinaryFile(char const *s, int32_t startPos);
 void sect_BinaryFileSlice(char const *s, int32_t start_pos, int32_t length);
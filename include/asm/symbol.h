@@ -54,8 +54,12 @@ struct Symbol {
 		char const *(*strCallback)(void);
 	};
 
+	uint32_t generation; /* Changes whenever the symbol is (re)defined */
 	uint32_t ID; /* ID of the symbol in the object file (-1 if none) */
 	struct Symbol *next; /* Next object to output in the object file */
+
+	uint32_t nbExpansions; /* How many lexer expansions borrow this EQUS's name and value */
+	bool isPurged; /* Purged, and only kept alive until its expansions are done */
 };
 
 bool sym_IsPC(struct Symbol const *sym);
@@ -139,11 +143,19 @@ struct Symbol *sym_FindUnscopedSymbol(char const *symName);
 struct Symbol *sym_FindScopedSymbol(char const *symName);
 struct Symbol const *sym_GetPC(void);
 struct Symbol *sym_AddMacro(char const *symName, int32_t defLineNo, char *body, size_t size);
+struct Symbol *sym_AddPrecompiled(char const *symName, enum SymbolType type,
+				  struct FileStackNode *src, uint32_t fileLine);
 struct Symbol *sym_Ref(char const *symName);
 struct Symbol *sym_AddString(char const *symName, char const *value);
 struct Symbol *sym_RedefString(char const *symName, char const *value);
 void sym_Purge(char const *symName);
+/*
+ * Keep an EQUS alive while the lexer expands it, even if it gets purged meanwhile
+ */
+void sym_BeginExpansion(struct Symbol *sym);
+void sym_EndExpansion(struct Symbol *sym);
 void sym_Init(time_t now);
+void sym_Reset(void);
 
 /* Functions to save and restore the current symbol scope. */
 char const *sym_GetCurrentSymbolScope(void);
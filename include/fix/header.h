@@ -0,0 +1,89 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2020, Eldred habert and RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Header fixing, shared by rgbfix and rgblink */
+#ifndef RGBDS_FIX_HEADER_H
+#define RGBDS_FIX_HEADER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FIX_BANK_SIZE 0x4000
+
+/**
+ * Applies one of rgbfix's options
+ * @param ch The option's short name
+ * @param arg The option's argument, if it takes one
+ * @return False if the option is unknown
+ */
+bool fix_ParseOption(int ch, char const *arg);
+
+/**
+ * Applies rgbfix options passed as a single string, as they would be on rgbfix's command line
+ * @param args The options, separated by whitespace; quotes may be used to include whitespace
+ * @return False if any of the options was invalid
+ */
+bool fix_ParseArgs(char const *args);
+
+/**
+ * Checks the options as a whole, once they have all been applied
+ * @return False if any error was reported while applying the options
+ */
+bool fix_CheckOptions(void);
+
+/**
+ * @return How many bytes a ROM needs to contain at least for its header to be fixed
+ */
+uint16_t fix_HeaderSize(void);
+
+/**
+ * Writes the header fields that do not depend on the ROM's size
+ * @param rom0 A pointer to rom0, at least `fix_HeaderSize()` bytes large
+ */
+void fix_Header(uint8_t *rom0);
+
+/**
+ * Pads ROM0 to a full bank, if needed, and writes the ROM size, if padding was requested
+ * @param rom0 A pointer to rom0, `FIX_BANK_SIZE` bytes large
+ * @param rom0Len How many bytes of ROM0 are in use, updated if ROM0 was padded
+ * @param romxLen How many bytes follow ROM0
+ * @param padByte Set to the value to pad with
+ * @param padLen Set to how many padding bytes must be appended after ROMX
+ * @return False if padding was not requested
+ */
+bool fix_Pad(uint8_t *rom0, size_t *rom0Len, size_t romxLen, uint8_t *padByte, size_t *padLen);
+
+/**
+ * Writes the header checksum, if requested; must be done after the ROM size has been written
+ * @param rom0 A pointer to rom0
+ */
+void fix_HeaderSum(uint8_t *rom0);
+
+/**
+ * @return True if the global checksum is to be written
+ */
+bool fix_WantsGlobalSum(void);
+
+/**
+ * Writes the global checksum; must be done once everything else has been written
+ * @param rom0 A pointer to rom0
+ * @param rom0Len How many bytes of ROM0 are in use
+ * @param romxSum The sum of all the bytes following ROM0, including padding
+ */
+void fix_GlobalSum(uint8_t *rom0, size_t rom0Len, uint16_t romxSum);
+
+/**
+ * Sums bytes modulo 65536, as the global checksum does.
+ * @param data The bytes to sum
+ * @param len How many bytes to sum
+ * @return The sum, truncated to 16 bits
+ */
+uint16_t fix_SumBytes(uint8_t const *data, size_t len);
+
+#endif /* RGBDS_FIX_HEADER_H */
@@ -0,0 +1,22 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2013-2018, stag019 and RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef RGBDS_GFX_CACHE_H
+#define RGBDS_GFX_CACHE_H
+
+#include <stdbool.h>
+
+#include "gfx/main.h"
+
+#define CACHE_KEY_LEN 16 /* Hex digits */
+
+void cache_key(const struct Options *opts, char key[CACHE_KEY_LEN + 1]);
+bool cache_fetch(const struct Options *opts, char const *key);
+void cache_store(const struct Options *opts, char const *key);
+
+#endif /* RGBDS_GFX_CACHE_H */
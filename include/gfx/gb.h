@@ -15,17 +15,18 @@
 #define XFLIP 0x40
 #define YFLIP 0x20
 
-void raw_to_gb(const struct RawIndexedImage *raw_image, struct GBImage *gb);
+void raw_to_gb(struct RawIndexedImage *raw_image, struct GBImage *gb);
 void output_file(const struct Options *opts, const struct GBImage *gb);
-int get_tile_index(uint8_t *tile, uint8_t **tiles, int num_tiles,
-		   int tile_size);
 uint8_t reverse_bits(uint8_t b);
-void xflip(uint8_t *tile, uint8_t *tile_xflip, int tile_size);
-void yflip(uint8_t *tile, uint8_t *tile_yflip, int tile_size);
-int get_mirrored_tile_index(uint8_t *tile, uint8_t **tiles, int num_tiles,
-			    int tile_size, int *flags);
+void xflip(uint8_t const *tile, uint8_t *tile_xflip, int tile_size);
+void yflip(uint8_t const *tile, uint8_t *tile_yflip, int tile_size);
+void init_tileset(struct TileSet *set, bool mirror, int expected_tiles);
+void load_tileset(struct TileSet *set, char const *filename);
+void output_tileset_file(const struct TileSet *set, char const *filename);
+void free_tileset(struct TileSet *set);
 void create_mapfiles(const struct Options *opts, struct GBImage *gb,
-		     struct Mapfile *tilemap, struct Mapfile *attrmap);
+		     struct Mapfile *tilemap, struct Mapfile *attrmap,
+		     struct TileSet *tileset);
 void output_tilemap_file(const struct Options *opts,
 			 const struct Mapfile *tilemap);
 void output_attrmap_file(const struct Options *opts,
@@ -12,6 +12,7 @@
 #include <png.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include "extern/err.h"
 
@@ -33,6 +34,7 @@ struct Options {
 	bool palout;
 	char *outfile;
 	char *infile;
+	char *cachedir;
 };
 
 struct RGBColor {
@@ -52,23 +54,46 @@ struct ImageOptions {
 	bool palout;
 };
 
+/*
+ * Maps colors, packed as 0x01RRGGBB, to palette indices; an empty slot's key
+ * is 0. Palettes have at most 4 colors, so lookups almost always take a
+ * single probe.
+ */
+#define COLOR_MAP_SIZE 16
+struct ColorMap {
+	uint32_t keys[COLOR_MAP_SIZE];
+	uint8_t indices[COLOR_MAP_SIZE];
+};
+
 struct PNGImage {
 	png_struct *png;
 	png_info *info;
+	FILE *file;
 
-	png_byte **data;
+	png_byte **data; /* The whole image, only used if it is interlaced */
+	png_byte *row; /* The row being decoded otherwise */
+	int next_row;
+	bool interlaced;
 	int width;
 	int height;
 	png_byte depth;
 	png_byte type;
+
+	/* How decoded pixels map to palette indices */
+	bool rgba;
+	uint8_t index_map[256];
+	png_color *palette;
+	int num_colors;
+	struct ColorMap color_map;
 };
 
 struct RawIndexedImage {
-	uint8_t **data;
+	uint8_t **data; /* NULL until the whole image is loaded */
 	struct RGBColor *palette;
 	int num_colors;
 	unsigned int width;
 	unsigned int height;
+	struct PNGImage *png; /* Where the image's rows are read from */
 };
 
 struct GBImage {
@@ -83,9 +108,28 @@ struct Mapfile {
 	int size;
 };
 
+/*
+ * Unique tiles, in the order they were kept, possibly shared between images.
+ * `entries` is a hash table of their contents, see gb.c.
+ */
+struct TileSet {
+	uint8_t *tiles;
+	uint8_t *flips; /* Each tile's Y-, X- and XY-flipped variants, if `mirror` */
+	int num_tiles;
+	int max_tiles; /* How many tiles `tiles` has room for */
+	int tile_size;
+	bool mirror;
+	struct TileEntry *entries;
+	uint32_t mask;
+	uint32_t nb_keys;
+};
+
 extern int depth, colors;
 
+char *derived_file_name(char const *infile, char const *ext);
+
 #include "gfx/makepng.h"
 #include "gfx/gb.h"
+#include "gfx/cache.h"
 
 #endif /* RGBDS_GFX_MAIN_H */
@@ -13,6 +13,9 @@
 
 struct RawIndexedImage *input_png_file(const struct Options *opts,
 				       struct ImageOptions *png_options);
+void read_raw_image_rows(struct RawIndexedImage *raw_image, uint8_t **rows,
+			 int nb_rows);
+void load_raw_image(struct RawIndexedImage *raw_image);
 void output_png_file(const struct Options *opts,
 		     const struct ImageOptions *png_options,
 		     const struct RawIndexedImage *raw_image);
@@ -0,0 +1,35 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Worker pool shared by the tools' batch modes */
+#ifndef RGBDS_JOBS_H
+#define RGBDS_JOBS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The most workers that a `-j` option may request */
+#define JOBS_MAX 1024
+
+/**
+ * Runs `func` on each item, in `nbJobs` worker processes which take them from a shared queue.
+ * The workers are forked, so they inherit everything set up before the call, but nothing
+ * they modify is seen by the caller. Each item's diagnostics are printed in one go.
+ * On platforms without `fork`, or with a single job, the items are processed in order by
+ * the calling process instead.
+ * @param nbItems How many items to process; they are numbered from 0
+ * @param nbJobs How many workers to start, at most `JOBS_MAX`
+ * @param func The function to run on each item. The first argument will be the item's
+ *             number, the second will be `arg`. It must return false if the item failed.
+ * @param arg An argument to be passed to all function calls
+ * @return How many items failed, plus how many workers aborted
+ */
+uint32_t jobs_Run(uint32_t nbItems, unsigned int nbJobs, bool (*func)(uint32_t, void *),
+		  void *arg);
+
+#endif /* RGBDS_JOBS_H */
@@ -18,6 +18,7 @@
 
 /* Variables related to CLI options */
 extern bool isDmgMode;
+extern char const *fixOptions;
 extern char       *linkerScriptName;
 extern char const *mapFileName;
 extern char const *symFileName;
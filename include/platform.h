@@ -73,4 +73,11 @@
 # define setmode(fd, mode) ((void)0)
 #endif
 
+// Windows cannot `fork`, so jobs that need a process of their own run sequentially there
+#if defined(_MSC_VER) || defined(__MINGW32__)
+# define HAVE_FORK 0
+#else
+# define HAVE_FORK 1
+#endif
+
 #endif /* RGBDS_PLATFORM_H */
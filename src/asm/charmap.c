@@ -25,33 +25,54 @@
  * Charmaps are stored using a structure known as "trie".
  * Essentially a tree, where each nodes stores a single character's worth of info:
  * whether there exists a mapping that ends at the current character,
+ * and which nodes the following characters lead to.
+ * Most nodes only have a few children, so they are kept in a list sorted by character;
+ * only the root, through which every lookup goes, has a table indexed by character.
  */
+struct Charedge {
+	uint8_t c;
+	uint32_t node; /* Index of the node that `c` leads to */
+};
+
 struct Charnode {
 	bool isTerminal; /* Whether there exists a mapping that ends here */
 	uint8_t value; /* If the above is true, its corresponding value */
-	/* This MUST be indexes and not pointers, because pointers get invalidated by `realloc`!! */
-	size_t next[255]; /* Indexes of where to go next, 0 = nowhere */
+	uint16_t nbNext;
+	struct Charedge *next; /* Sorted by character; unused for the root node */
 };
 
 #define INITIAL_CAPACITY 32
 
+/* What the mappings starting with a given byte require to convert it */
+enum FirstByte {
+	FIRST_UNMAPPED, /* No mapping starts with it, so its codepoint is copied */
+	FIRST_SINGLE, /* The only mapping starting with it is that byte alone */
+	FIRST_TRIE, /* Longer mappings start with it, so the trie must be walked */
+};
+
+/* A charmap created from another one shares its trie, until either of them is modified */
+struct Chartrie {
+	unsigned int refCount;
+	uint32_t rootNext[256]; /* Indexes of where to go next from the root, 0 = nowhere */
+	uint32_t usedNodes; /* How many nodes are being used */
+	uint32_t capacity; /* How many nodes have been allocated */
+	struct Charnode *nodes; /* first node is reserved for the root node */
+	/* Built when first converting a string, and invalidated when adding a mapping */
+	bool areFirstBytesValid;
+	uint8_t firstBytes[256]; /* `enum FirstByte` for each byte */
+};
+
 struct Charmap {
 	char *name;
-	size_t usedNodes; /* How many nodes are being used */
-	size_t capacity; /* How many nodes have been allocated */
-	struct Charnode nodes[]; /* first node is reserved for the root node */
+	struct Chartrie *trie;
 };
 
 static HashMap charmaps;
 
-/*
- * Store pointers to hashmap nodes, so that there is only one pointer to the memory block
- * that gets reallocated.
- */
-static struct Charmap **currentCharmap;
+static struct Charmap *currentCharmap;
 
 struct CharmapStackEntry {
-	struct Charmap **charmap;
+	struct Charmap *charmap;
 	struct CharmapStackEntry *next;
 };
 
@@ -62,20 +83,132 @@ static struct Charmap *charmap_Get(char const *name)
 	return hash_GetElement(charmaps, name);
 }
 
-static void resizeCharmap(struct Charmap **map, size_t capacity)
+static void resizeTrie(struct Chartrie *trie, uint32_t capacity)
 {
-	*map = realloc(*map, sizeof(**map) + sizeof(*(*map)->nodes) * capacity);
-
-	if (!*map)
+	trie->nodes = realloc(trie->nodes, sizeof(*trie->nodes) * capacity);
+	if (!trie->nodes)
 		fatalerror("Failed to %s charmap: %s\n",
-			   *map ? "create" : "resize", strerror(errno));
-	(**map).capacity = capacity;
+			   trie->capacity ? "resize" : "create", strerror(errno));
+	trie->capacity = capacity;
 }
 
 static void initNode(struct Charnode *node)
 {
 	node->isTerminal = false;
-	memset(node->next, 0, sizeof(node->next));
+	node->nbNext = 0;
+	node->next = NULL;
+}
+
+static struct Chartrie *newTrie(void)
+{
+	struct Chartrie *trie = malloc(sizeof(*trie));
+
+	if (!trie)
+		fatalerror("Failed to create charmap: %s\n", strerror(errno));
+	trie->refCount = 1;
+	memset(trie->rootNext, 0, sizeof(trie->rootNext));
+	trie->nodes = NULL;
+	trie->capacity = 0;
+	resizeTrie(trie, INITIAL_CAPACITY);
+	trie->usedNodes = 1;
+	initNode(&trie->nodes[0]); /* Init the root node */
+	trie->areFirstBytesValid = false;
+	return trie;
+}
+
+static struct Chartrie *copyTrie(struct Chartrie const *trie)
+{
+	struct Chartrie *copy = malloc(sizeof(*copy));
+
+	if (!copy)
+		fatalerror("Failed to copy charmap: %s\n", strerror(errno));
+	copy->refCount = 1;
+	memcpy(copy->rootNext, trie->rootNext, sizeof(copy->rootNext));
+	copy->nodes = NULL;
+	copy->capacity = 0;
+	resizeTrie(copy, trie->capacity);
+	copy->usedNodes = trie->usedNodes;
+	memcpy(copy->nodes, trie->nodes, sizeof(*copy->nodes) * trie->usedNodes);
+	copy->areFirstBytesValid = trie->areFirstBytesValid;
+	memcpy(copy->firstBytes, trie->firstBytes, sizeof(copy->firstBytes));
+
+	for (uint32_t i = 1; i < copy->usedNodes; i++) {
+		struct Charnode *node = &copy->nodes[i];
+		size_t size = sizeof(*node->next) * node->nbNext;
+
+		if (!node->nbNext)
+			continue;
+		node->next = malloc(size);
+		if (!node->next)
+			fatalerror("Failed to copy charmap: %s\n", strerror(errno));
+		memcpy(node->next, trie->nodes[i].next, size);
+	}
+	return copy;
+}
+
+static void releaseTrie(struct Chartrie *trie)
+{
+	if (--trie->refCount != 0)
+		return;
+	for (uint32_t i = 0; i < trie->usedNodes; i++)
+		free(trie->nodes[i].next);
+	free(trie->nodes);
+	free(trie);
+}
+
+/*
+ * Get the index of the node that follows `nodeIdx` with character `c`, or 0 if there is none
+ */
+static uint32_t findNext(struct Chartrie const *trie, uint32_t nodeIdx, uint8_t c)
+{
+	if (nodeIdx == 0)
+		return trie->rootNext[c];
+
+	struct Charnode const *node = &trie->nodes[nodeIdx];
+	uint16_t low = 0;
+	uint16_t high = node->nbNext;
+
+	while (low < high) {
+		uint16_t mid = (low + high) / 2;
+
+		if (node->next[mid].c < c)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low < node->nbNext && node->next[low].c == c ? node->next[low].node : 0;
+}
+
+/*
+ * Create the node that follows `nodeIdx` with character `c`, and return its index
+ */
+static uint32_t addNext(struct Chartrie *trie, uint32_t nodeIdx, uint8_t c)
+{
+	uint32_t newIdx = trie->usedNodes;
+
+	/* If no more nodes are available, get new ones */
+	if (trie->usedNodes == trie->capacity)
+		resizeTrie(trie, trie->capacity * 2);
+	initNode(&trie->nodes[trie->usedNodes++]);
+
+	if (nodeIdx == 0) {
+		trie->rootNext[c] = newIdx;
+		return newIdx;
+	}
+
+	struct Charnode *node = &trie->nodes[nodeIdx];
+	uint16_t pos = 0;
+
+	node->next = realloc(node->next, sizeof(*node->next) * (node->nbNext + 1));
+	if (!node->next)
+		fatalerror("Failed to resize charmap: %s\n", strerror(errno));
+	while (pos < node->nbNext && node->next[pos].c < c)
+		pos++;
+	memmove(&node->next[pos + 1], &node->next[pos], sizeof(*node->next) * (node->nbNext - pos));
+	node->next[pos].c = c;
+	node->next[pos].node = newIdx;
+	node->nbNext++;
+	return newIdx;
 }
 
 struct Charmap *charmap_New(const char *name, const char *baseName)
@@ -97,32 +230,120 @@ struct Charmap *charmap_New(const char *name, const char *baseName)
 	}
 
 	/* Init the new charmap's fields */
+	charmap = malloc(sizeof(*charmap));
+	if (!charmap)
+		fatalerror("Failed to create charmap: %s\n", strerror(errno));
 	if (base) {
-		resizeCharmap(&charmap, base->capacity);
-		charmap->usedNodes = base->usedNodes;
-
-		memcpy(charmap->nodes, base->nodes, sizeof(base->nodes[0]) * charmap->usedNodes);
+		/* The trie will only be copied if either charmap is modified */
+		charmap->trie = base->trie;
+		charmap->trie->refCount++;
 	} else {
-		resizeCharmap(&charmap, INITIAL_CAPACITY);
-		charmap->usedNodes = 1;
-		initNode(&charmap->nodes[0]); /* Init the root node */
+		charmap->trie = newTrie();
 	}
 	charmap->name = strdup(name);
 
-	currentCharmap = (struct Charmap **)hash_AddElement(charmaps, charmap->name, charmap);
+	hash_AddElement(charmaps, charmap->name, charmap);
+	currentCharmap = charmap;
 
 	return charmap;
 }
 
 void charmap_Delete(struct Charmap *charmap)
 {
+	releaseTrie(charmap->trie);
 	free(charmap->name);
 	free(charmap);
 }
 
+static void deleteCharmap(void *charmap, void *arg)
+{
+	(void)arg;
+	charmap_Delete(charmap);
+}
+
+/*
+ * Forget all charmaps, so that the next file assembled in batch mode starts afresh
+ */
+void charmap_Reset(void)
+{
+	hash_ForEach(charmaps, deleteCharmap, NULL);
+	hash_EmptyMap(charmaps);
+	currentCharmap = NULL;
+
+	while (charmapStack) {
+		struct CharmapStackEntry *next = charmapStack->next;
+
+		free(charmapStack);
+		charmapStack = next;
+	}
+}
+
+struct CharmapVisitor {
+	void (*mapFunc)(char const *name, void *arg);
+	void (*charFunc)(char const *mapping, uint8_t value, void *arg);
+	void *arg;
+	struct Chartrie const *trie;
+	char *mapping;
+};
+
+static void visitMappings(struct CharmapVisitor *visitor, uint32_t nodeIdx, size_t depth)
+{
+	struct Charnode const *node = &visitor->trie->nodes[nodeIdx];
+
+	/* The root node never matches anything */
+	if (node->isTerminal && depth != 0) {
+		visitor->mapping[depth] = '\0';
+		visitor->charFunc(visitor->mapping, node->value, visitor->arg);
+	}
+	if (nodeIdx == 0) {
+		for (unsigned int c = 1; c < 256; c++) {
+			if (visitor->trie->rootNext[c]) {
+				visitor->mapping[depth] = c;
+				visitMappings(visitor, visitor->trie->rootNext[c], depth + 1);
+			}
+		}
+	} else {
+		for (uint16_t i = 0; i < node->nbNext; i++) {
+			visitor->mapping[depth] = node->next[i].c;
+			visitMappings(visitor, node->next[i].node, depth + 1);
+		}
+	}
+}
+
+static void visitCharmap(void *_charmap, void *_visitor)
+{
+	struct Charmap const *charmap = _charmap;
+	struct CharmapVisitor *visitor = _visitor;
+
+	/* No mapping can be longer than there are nodes */
+	visitor->mapping = malloc(charmap->trie->usedNodes + 1);
+	if (!visitor->mapping)
+		fatalerror("Failed to visit charmap: %s\n", strerror(errno));
+	visitor->trie = charmap->trie;
+	visitor->mapFunc(charmap->name, visitor->arg);
+	visitMappings(visitor, 0, 0);
+	free(visitor->mapping);
+}
+
+/*
+ * Call `mapFunc` with the name of each charmap, followed by `charFunc` with each of its mappings
+ */
+void charmap_ForEach(void (*mapFunc)(char const *name, void *arg),
+		     void (*charFunc)(char const *mapping, uint8_t value, void *arg), void *arg)
+{
+	struct CharmapVisitor visitor = { .mapFunc = mapFunc, .charFunc = charFunc, .arg = arg };
+
+	hash_ForEach(charmaps, visitCharmap, &visitor);
+}
+
+char const *charmap_GetCurrentName(void)
+{
+	return currentCharmap->name;
+}
+
 void charmap_Set(const char *name)
 {
-	struct Charmap **charmap = (struct Charmap **)hash_GetNode(charmaps, name);
+	struct Charmap *charmap = charmap_Get(name);
 
 	if (charmap == NULL)
 		error("Charmap '%s' doesn't exist\n", name);
@@ -160,30 +381,30 @@ void charmap_Pop(void)
 
 void charmap_Add(char *mapping, uint8_t value)
 {
-	struct Charmap *charmap = *currentCharmap;
-	struct Charnode *node = &charmap->nodes[0];
+	struct Charmap *charmap = currentCharmap;
 
-	for (uint8_t c; *mapping; mapping++) {
-		c = *mapping - 1;
+	/* Stop sharing the trie before modifying it */
+	if (charmap->trie->refCount > 1) {
+		struct Chartrie *copy = copyTrie(charmap->trie);
 
-		if (node->next[c]) {
-			node = &charmap->nodes[node->next[c]];
-		} else {
-			/* Register next available node */
-			node->next[c] = charmap->usedNodes;
-			/* If no more nodes are available, get new ones */
-			if (charmap->usedNodes == charmap->capacity) {
-				charmap->capacity *= 2;
-				resizeCharmap(currentCharmap, charmap->capacity);
-				charmap = *currentCharmap;
-			}
+		releaseTrie(charmap->trie);
+		charmap->trie = copy;
+	}
 
-			/* Switch to and init new node */
-			node = &charmap->nodes[charmap->usedNodes++];
-			initNode(node);
-		}
+	struct Chartrie *trie = charmap->trie;
+	uint32_t nodeIdx = 0;
+
+	trie->areFirstBytesValid = false;
+
+	for (; *mapping; mapping++) {
+		uint32_t next = findNext(trie, nodeIdx, *mapping);
+
+		/* Register next available node */
+		nodeIdx = next ? next : addNext(trie, nodeIdx, *mapping);
 	}
 
+	struct Charnode *node = &trie->nodes[nodeIdx];
+
 	if (node->isTerminal)
 		warning(WARNING_CHARMAP_REDEF, "Overriding charmap mapping\n");
 
@@ -191,39 +412,100 @@ void charmap_Add(char *mapping, uint8_t value)
 	node->value = value;
 }
 
-size_t charmap_Convert(char const *input, uint8_t *output)
+/*
+ * Copy a UTF-8 codepoint that does not start any mapping
+ */
+static size_t copyCodepoint(char const **input, uint8_t **output)
 {
-	uint8_t *start = output;
+	// This will write the codepoint's value to `output`, little-endian
+	size_t codepointLen = readUTF8Char(output ? *output : NULL, *input);
 
-	while (charmap_ConvertNext(&input, &output))
-		;
+	if (codepointLen == 0)
+		error("Input string is not valid UTF-8!\n");
 
-	return output - start;
+	// OK because UTF-8 has no NUL in multi-byte chars
+	*input += codepointLen;
+	if (output)
+		*output += codepointLen;
+
+	return codepointLen;
 }
 
-size_t charmap_ConvertNext(char const **input, uint8_t **output)
+/*
+ * Classify each byte according to the mappings that start with it, so that most characters
+ * can be converted without walking the trie
+ */
+static void updateFirstBytes(struct Chartrie *trie)
 {
+	if (trie->areFirstBytesValid)
+		return;
+
+	for (unsigned int c = 0; c < 256; c++) {
+		struct Charnode const *node = &trie->nodes[trie->rootNext[c]];
+
+		if (!trie->rootNext[c])
+			trie->firstBytes[c] = FIRST_UNMAPPED;
+		else if (node->isTerminal && !node->nbNext)
+			trie->firstBytes[c] = FIRST_SINGLE;
+		else
+			trie->firstBytes[c] = FIRST_TRIE;
+	}
+	trie->areFirstBytesValid = true;
+}
+
+/*
+ * Convert the next character(s), assuming that the first byte table is up to date
+ */
+static size_t convertNext(struct Chartrie const *trie, char const **input, uint8_t **output)
+{
+	uint8_t c = **input;
+
+	if (!c) // End of input
+		return 0;
+
+	switch (trie->firstBytes[c]) {
+	case FIRST_UNMAPPED:
+		if (c >= 0x80)
+			return copyCodepoint(input, output);
+		// ASCII chars are codepoints by themselves
+		(*input)++;
+		if (output)
+			*(*output)++ = c;
+		return 1;
+
+	case FIRST_SINGLE:
+		(*input)++;
+		if (output)
+			*(*output)++ = trie->nodes[trie->rootNext[c]].value;
+		return 1;
+
+	case FIRST_TRIE:
+		break;
+	}
+
 	/*
 	 * The goal is to match the longest mapping possible.
 	 * For that, advance through the trie with each character read.
 	 * If that would lead to a dead end, rewind characters until the last match, and output.
 	 * If no match, read a UTF-8 codepoint and output that.
 	 */
-	struct Charmap const *charmap = *currentCharmap;
-	struct Charnode const *node = &charmap->nodes[0];
+	uint32_t nodeIdx = 0;
 	struct Charnode const *match = NULL;
 	size_t rewindDistance = 0;
 
 	for (;;) {
-		uint8_t c = **input - 1;
+		uint32_t next = **input ? findNext(trie, nodeIdx, **input) : 0;
 
-		if (**input && node->next[c]) {
+		if (next) {
 			// Consume that char
 			(*input)++;
 			rewindDistance++;
 
 			// Advance to next node (index starts at 1)
-			node = &charmap->nodes[node->next[c]];
+			nodeIdx = next;
+
+			struct Charnode const *node = &trie->nodes[nodeIdx];
+
 			if (node->isTerminal) {
 				// This node matches, register it
 				match = node;
@@ -241,24 +523,29 @@ size_t charmap_ConvertNext(char const **input, uint8_t **output)
 
 				return 1;
 
-			} else if (**input) { // No match found, but there is some input left
-				// This will write the codepoint's value to `output`, little-endian
-				size_t codepointLen = readUTF8Char(output ? *output : NULL,
-								   *input);
+			} else { // No match found, but there is some input left
+				return copyCodepoint(input, output);
+			}
+		}
+	}
+}
+
+size_t charmap_Convert(char const *input, uint8_t *output)
+{
+	struct Chartrie *trie = currentCharmap->trie;
+	uint8_t *start = output;
 
-				if (codepointLen == 0)
-					error("Input string is not valid UTF-8!\n");
+	updateFirstBytes(trie);
+	while (convertNext(trie, &input, &output))
+		;
 
-				// OK because UTF-8 has no NUL in multi-byte chars
-				*input += codepointLen;
-				if (output)
-					*output += codepointLen;
+	return output - start;
+}
 
-				return codepointLen;
+size_t charmap_ConvertNext(char const **input, uint8_t **output)
+{
+	struct Chartrie *trie = currentCharmap->trie;
 
-			} else { // End of input
-				return 0;
-			}
-		}
-	}
+	updateFirstBytes(trie);
+	return convertNext(trie, input, output);
 }
@@ -8,10 +8,16 @@
 
 /*
  * Fixed-point math routines
+ *
+ * Everything is computed with integers only, so that results are the same on
+ * every platform. Intermediate values are kept in 2.62 fixed-point ("Q62"), which
+ * is precise enough for 16.16 results to be correctly rounded.
+ * Results that do not fit in 16.16 saturate, and undefined ones (such as 0 / 0)
+ * are 0.
  */
 
 #include <inttypes.h>
-#include <math.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -19,17 +25,462 @@
 #include "asm/symbol.h"
 #include "asm/warning.h"
 
-#define fix2double(i)	((double)((i) / 65536.0))
-#define double2fix(d)	((int32_t)round((d) * 65536.0))
+#include "helpers.h"
+
+#define Q62_ONE (UINT64_C(1) << 62)
+#define Q62_HALF_PI UINT64_C(0x6487ED5110B4611A)
+#define Q62_TWO_OVER_PI UINT64_C(0x28BE60DB9391054A)
+#define Q62_LN_2 UINT64_C(0x2C5C85FDF473DE6B)
+#define Q62_INV_LN_2 UINT64_C(0x5C551D94AE0BF85E)
+
+// Logarithms are returned in 5.59 fixed-point, whose range covers all of 16.16's
+#define Q59_ONE (INT64_C(1) << 59)
+
+// Any magnitude at least this large saturates
+#define SATURATED (UINT64_C(1) << 32)
+
+// atan(k / 64), in 1/2^64 turns
+static uint64_t const atanTable[65] = {
+	UINT64_C(0x0000000000000000), UINT64_C(0x00A2F61E5C28262A), UINT64_C(0x0145D7E159046278),
+	UINT64_C(0x01E890FCD5255C1A), UINT64_C(0x028B0D430E589AED), UINT64_C(0x032D38B38A738106),
+	UINT64_C(0x03CEFF89AC340906), UINT64_C(0x04704E4ADA035582), UINT64_C(0x051111D41DDD9A1B),
+	UINT64_C(0x05B137672768F3A0), UINT64_C(0x0650ACB69B4FE3AE), UINT64_C(0x06EF5FF19D399BF0),
+	UINT64_C(0x078D3FCE842E72EC), UINT64_C(0x082A3B94ABCD89A5), UINT64_C(0x08C64325576561A1),
+	UINT64_C(0x096147039EB78911), UINT64_C(0x09FB385B5EE39E8E), UINT64_C(0x0A9409072C9C755D),
+	UINT64_C(0x0B2BAB954758B68A), UINT64_C(0x0BC2134B8F9DB904), UINT64_C(0x0C57342A84C77619),
+	UINT64_C(0x0CEB02EF50C4D90E), UINT64_C(0x0D7D7514EA1EFDBA), UINT64_C(0x0E0E80D456487EC6),
+	UINT64_C(0x0E9E1D24179D5A77), UINT64_C(0x0F2C41B6D3AB2AFA), UINT64_C(0x0FB8E6F93F4CA68F),
+	UINT64_C(0x1044060F5EDBE182), UINT64_C(0x10CD98D1293EE442), UINT64_C(0x115599C69CDCE966),
+	UINT64_C(0x11DC042355A3C0DD), UINT64_C(0x1260D3C1B330A904), UINT64_C(0x12E4051D9DF30866),
+	UINT64_C(0x1365954EF9BEA97F), UINT64_C(0x13E58203D3C358A8), UINT64_C(0x1463C97A5945F355),
+	UINT64_C(0x14E06A7AA3C7DDEE), UINT64_C(0x155B6450668A0849), UINT64_C(0x15D4B6C4888C7725),
+	UINT64_C(0x164C6216B556B249), UINT64_C(0x16C266F6EDFC1E3E), UINT64_C(0x1736C67F22F472C7),
+	UINT64_C(0x17A9822CDE870C11), UINT64_C(0x181A9BDB06B242E0), UINT64_C(0x188A15BBBCA863E4),
+	UINT64_C(0x18F7F2525F34085C), UINT64_C(0x1964346DB496E206), UINT64_C(0x19CEDF223FC198EA),
+	UINT64_C(0x1A37F5C4C419EF33), UINT64_C(0x1A9F7BE4FA66874B), UINT64_C(0x1B05754878E5B08C),
+	UINT64_C(0x1B69E5E5D00EA1A5), UINT64_C(0x1BCCD1DFDD02723F), UINT64_C(0x1C2E3D815243C04A),
+	UINT64_C(0x1C8E2D3876E8E159), UINT64_C(0x1CECA5931C245E37), UINT64_C(0x1D49AB3AC8B1BB50),
+	UINT64_C(0x1DA542F11970AA94), UINT64_C(0x1DFF718C563E1741), UINT64_C(0x1E583BF439E868C5),
+	UINT64_C(0x1EAFA71EEBF23A7B), UINT64_C(0x1F05B80E2AB3F69E), UINT64_C(0x1F5A73CCA450A08D),
+	UINT64_C(0x1FADDF6B7CDC07B6), UINT64_C(0x2000000000000000),
+};
+
+// log2(1 + k / 64), in Q62
+static uint64_t const log2Table[64] = {
+	UINT64_C(0x0000000000000000), UINT64_C(0x016E79685C2D2299), UINT64_C(0x02D75A6EB1DFB0E6),
+	UINT64_C(0x043ACE27E8A7E6AD), UINT64_C(0x0598FDBEB244C59F), UINT64_C(0x06F210902B6AEE99),
+	UINT64_C(0x08462C466D3CF1CB), UINT64_C(0x099574F13C570D10), UINT64_C(0x0AE00D1CFDEB43D0),
+	UINT64_C(0x0C2615E81781D97F), UINT64_C(0x0D67AF16DA7649F8), UINT64_C(0x0EA4F726192CB7E4),
+	UINT64_C(0x0FDE0B5C81340512), UINT64_C(0x111307DAD30B75CB), UINT64_C(0x124407AB0E073982),
+	UINT64_C(0x137124CEA4CDECDA), UINT64_C(0x149A784BCD1B8AFE), UINT64_C(0x15C01A39FBD687A0),
+	UINT64_C(0x16E221CD9D0CDE58), UINT64_C(0x1800A563161C5433), UINT64_C(0x191BBA891F1708B5),
+	UINT64_C(0x1A33760A7F60509D), UINT64_C(0x1B47EBF73882A0A4), UINT64_C(0x1C592FAD295B567E),
+	UINT64_C(0x1D6753E032EA0EFE), UINT64_C(0x1E726AA1E754D20C), UINT64_C(0x1F7A8568CB06CECE),
+	UINT64_C(0x207FB5172F32FE67), UINT64_C(0x21820A01AC754CB1), UINT64_C(0x228193F543CA873C),
+	UINT64_C(0x237E623D2BA01BC7), UINT64_C(0x247883A84E4F9010), UINT64_C(0x2570068E7EF5A1E8),
+	UINT64_C(0x2664F8D569394D91), UINT64_C(0x275767F54042CD9A), UINT64_C(0x284760FD30D552CE),
+	UINT64_C(0x2934F0979A3715FD), UINT64_C(0x2A20230E1151F1BC), UINT64_C(0x2B09044D313A6787),
+	UINT64_C(0x2BEF9FE83C135D72), UINT64_C(0x2CD4011C8F11979A), UINT64_C(0x2DB632D4EC3293B3),
+	UINT64_C(0x2E963FAC9C0EA78E), UINT64_C(0x2F7431F26A05C814), UINT64_C(0x305013AB7CE0E5B8),
+	UINT64_C(0x3129EE960DDF1681), UINT64_C(0x3201CC2C000599FD), UINT64_C(0x32D7B5A5596BEBE0),
+	UINT64_C(0x33ABB3FAA02166CD), UINT64_C(0x347DCFE71C303DA1), UINT64_C(0x354E11EB0029A6FA),
+	UINT64_C(0x361C824D7990D7AF), UINT64_C(0x36E9291EAA65B497), UINT64_C(0x37B40E398CFCDB6A),
+	UINT64_C(0x387D3945C340AA67), UINT64_C(0x3944B1B952662C6C), UINT64_C(0x3A0A7EDA4C112CE6),
+	UINT64_C(0x3ACEA7C065D41DFC), UINT64_C(0x3B9133567FEAD8BD), UINT64_C(0x3C52285C1C02803F),
+	UINT64_C(0x3D118D66C4D4E554), UINT64_C(0x3DCF68E36752A0FB), UINT64_C(0x3E8BC1179E0CAA9D),
+	UINT64_C(0x3F469C22EF8466C5),
+};
+
+// 1 / (1 + k / 64), in Q62
+static uint64_t const log2RecipTable[64] = {
+	UINT64_C(0x4000000000000000), UINT64_C(0x3F03F03F03F03F03), UINT64_C(0x3E0F83E0F83E0F83),
+	UINT64_C(0x3D226357E16ECE54), UINT64_C(0x3C3C3C3C3C3C3C3C), UINT64_C(0x3B5CC0ED7303B5CC),
+	UINT64_C(0x3A83A83A83A83A83), UINT64_C(0x39B0AD12073615A2), UINT64_C(0x38E38E38E38E38E3),
+	UINT64_C(0x381C0E070381C0E0), UINT64_C(0x3759F22983759F22), UINT64_C(0x369D0369D0369D03),
+	UINT64_C(0x35E50D79435E50D7), UINT64_C(0x3531DEC0D4C77B03), UINT64_C(0x3483483483483483),
+	UINT64_C(0x33D91D2A2067B23A), UINT64_C(0x3333333333333333), UINT64_C(0x329161F9ADD3C0CA),
+	UINT64_C(0x31F3831F3831F383), UINT64_C(0x3159721ED7E75346), UINT64_C(0x30C30C30C30C30C3),
+	UINT64_C(0x3030303030303030), UINT64_C(0x2FA0BE82FA0BE82F), UINT64_C(0x2F149902F149902F),
+	UINT64_C(0x2E8BA2E8BA2E8BA2), UINT64_C(0x2E05C0B81702E05C), UINT64_C(0x2D82D82D82D82D82),
+	UINT64_C(0x2D02D02D02D02D02), UINT64_C(0x2C8590B21642C859), UINT64_C(0x2C0B02C0B02C0B02),
+	UINT64_C(0x2B9310572620AE4C), UINT64_C(0x2B1DA46102B1DA46), UINT64_C(0x2AAAAAAAAAAAAAAA),
+	UINT64_C(0x2A3A0FD5C5F02A3A), UINT64_C(0x29CBC14E5E0A72F0), UINT64_C(0x295FAD40A57EB502),
+	UINT64_C(0x28F5C28F5C28F5C2), UINT64_C(0x288DF0CAC5B3F5DC), UINT64_C(0x2828282828282828),
+	UINT64_C(0x27C45979C95204F8), UINT64_C(0x2762762762762762), UINT64_C(0x2702702702702702),
+	UINT64_C(0x26A439F656F1826A), UINT64_C(0x2647C69456217ECD), UINT64_C(0x25ED097B425ED097),
+	UINT64_C(0x2593F69B02593F69), UINT64_C(0x253C8253C8253C82), UINT64_C(0x24E6A171024E6A17),
+	UINT64_C(0x2492492492492492), UINT64_C(0x243F6F0243F6F024), UINT64_C(0x23EE08FB823EE08F),
+	UINT64_C(0x239E0D5B450239E0), UINT64_C(0x234F72C234F72C23), UINT64_C(0x2302302302302302),
+	UINT64_C(0x22B63CBEEA4E1A08), UINT64_C(0x226B90226B90226B), UINT64_C(0x2222222222222222),
+	UINT64_C(0x21D9EAD7CD391FBC), UINT64_C(0x2192E29F79B47582), UINT64_C(0x214D0214D0214D02),
+	UINT64_C(0x2108421084210842), UINT64_C(0x20C49BA5E353F7CE), UINT64_C(0x2082082082082082),
+	UINT64_C(0x2040810204081020),
+};
+
+// 2^(k / 64), in Q62
+static uint64_t const exp2Table[64] = {
+	UINT64_C(0x4000000000000000), UINT64_C(0x40B268F9DE0183BA), UINT64_C(0x4166C34C5615D0EC),
+	UINT64_C(0x421D1461D66F2023), UINT64_C(0x42D561B3E6243D8A), UINT64_C(0x438FB0CB4F468808),
+	UINT64_C(0x444C0740496D4294), UINT64_C(0x450A6ABAA4B77ECD), UINT64_C(0x45CAE0F1F545EB73),
+	UINT64_C(0x468D6FADBF2DD4F3), UINT64_C(0x47521CC5A2E6A9E0), UINT64_C(0x4818EE218A3358EE),
+	UINT64_C(0x48E1E9B9D588E19B), UINT64_C(0x49AD159789F37496), UINT64_C(0x4A7A77D47F7B84B1),
+	UINT64_C(0x4B4A169B900C2D00), UINT64_C(0x4C1BF828C6DC54B8), UINT64_C(0x4CF022C9905BFD32),
+	UINT64_C(0x4DC69CDCEAA72A9C), UINT64_C(0x4E9F6CD3967FDBA8), UINT64_C(0x4F7A993048D088D7),
+	UINT64_C(0x50582887DCB8A7E1), UINT64_C(0x513821818624B40C), UINT64_C(0x521A8AD704F3404F),
+	UINT64_C(0x52FF6B54D8A89C75), UINT64_C(0x53E6C9DA74B29AB5), UINT64_C(0x54D0AD5A753E077C),
+	UINT64_C(0x55BD1CDAD49F699C), UINT64_C(0x56AC1F752150A563), UINT64_C(0x579DBC56B48521BA),
+	UINT64_C(0x5891FAC0E95612C8), UINT64_C(0x5988E20954889245), UINT64_C(0x5A827999FCEF3242),
+	UINT64_C(0x5B7EC8F19468BBC9), UINT64_C(0x5C7DD7A3B17DCF75), UINT64_C(0x5D7FAD59099F22FE),
+	UINT64_C(0x5E8451CFAC061B5F), UINT64_C(0x5F8BCCDB3D398841), UINT64_C(0x6096266533384A2B),
+	UINT64_C(0x61A3666D124BB204), UINT64_C(0x62B39508AA836D6F), UINT64_C(0x63C6BA6455DCD8AE),
+	UINT64_C(0x64DCDEC3371793D1), UINT64_C(0x65F60A7F79393E2E), UINT64_C(0x6712460A8FC24072),
+	UINT64_C(0x683199ED779592CA), UINT64_C(0x69540EC8F895722D), UINT64_C(0x6A79AD55E7F6FD10),
+	UINT64_C(0x6BA27E656B4EB57A), UINT64_C(0x6CCE8AE13C57EBDB), UINT64_C(0x6DFDDBCBED791BAB),
+	UINT64_C(0x6F307A412F074892), UINT64_C(0x70666F76154A7089), UINT64_C(0x719FC4B95F452D29),
+	UINT64_C(0x72DC8373BE41A454), UINT64_C(0x741CB5281E25EE34), UINT64_C(0x75606373EE921C97),
+	UINT64_C(0x76A7980F6CCA15C2), UINT64_C(0x77F25CCDEE6D7AE6), UINT64_C(0x7940BB9E2CFFD89D),
+	UINT64_C(0x7A92BE8A92436616), UINT64_C(0x7BE86FB985689DDC), UINT64_C(0x7D41D96DB915019D),
+	UINT64_C(0x7E9F06067A4360BA),
+};
+
+// Taylor series coefficients, in Q62
+static uint64_t const sinCoeffs[] = { // 1 / (2n + 1)!
+	Q62_ONE, Q62_ONE / 6, Q62_ONE / 120, Q62_ONE / 5040, Q62_ONE / 362880,
+	Q62_ONE / 39916800, Q62_ONE / UINT64_C(6227020800),
+	Q62_ONE / UINT64_C(1307674368000), Q62_ONE / UINT64_C(355687428096000),
+	Q62_ONE / UINT64_C(121645100408832000),
+};
+static uint64_t const cosCoeffs[] = { // 1 / (2n)!
+	Q62_ONE, Q62_ONE / 2, Q62_ONE / 24, Q62_ONE / 720, Q62_ONE / 40320,
+	Q62_ONE / 3628800, Q62_ONE / 479001600, Q62_ONE / UINT64_C(87178291200),
+	Q62_ONE / UINT64_C(20922789888000), Q62_ONE / UINT64_C(6402373705728000),
+	Q62_ONE / UINT64_C(2432902008176640000),
+};
+static uint64_t const expCoeffs[] = { // 1 / n!
+	Q62_ONE, Q62_ONE, Q62_ONE / 2, Q62_ONE / 6, Q62_ONE / 24, Q62_ONE / 120,
+	Q62_ONE / 720, Q62_ONE / 5040, Q62_ONE / 40320,
+};
+static uint64_t const oddCoeffs[] = { // 1 / (2n + 1)
+	Q62_ONE, Q62_ONE / 3, Q62_ONE / 5, Q62_ONE / 7,
+};
+
+// 1 / sqrt(m) for m in [k / 256; (k + 1) / 256), k in [64; 256), in Q14
+static uint16_t const rsqrtTable[192] = {
+	32641, 32391, 32146, 31907, 31673, 31445, 31221, 31002, 30787, 30577, 30371, 30169,
+	29972, 29778, 29587, 29401, 29217, 29038, 28861, 28688, 28518, 28350, 28186, 28024,
+	27866, 27709, 27556, 27405, 27256, 27110, 26966, 26825, 26686, 26548, 26413, 26280,
+	26149, 26020, 25893, 25767, 25644, 25522, 25402, 25283, 25167, 25051, 24938, 24826,
+	24715, 24606, 24498, 24392, 24287, 24184, 24081, 23980, 23881, 23782, 23685, 23589,
+	23494, 23400, 23307, 23216, 23125, 23036, 22947, 22860, 22774, 22688, 22604, 22520,
+	22437, 22356, 22275, 22195, 22116, 22037, 21960, 21883, 21808, 21732, 21658, 21585,
+	21512, 21440, 21368, 21298, 21228, 21159, 21090, 21022, 20955, 20888, 20822, 20757,
+	20692, 20628, 20564, 20501, 20439, 20377, 20316, 20255, 20195, 20135, 20076, 20017,
+	19959, 19902, 19845, 19788, 19732, 19676, 19621, 19566, 19512, 19458, 19405, 19352,
+	19299, 19247, 19196, 19144, 19093, 19043, 18993, 18943, 18894, 18845, 18797, 18749,
+	18701, 18653, 18606, 18560, 18513, 18467, 18422, 18376, 18331, 18287, 18242, 18198,
+	18155, 18111, 18068, 18025, 17983, 17941, 17899, 17857, 17816, 17775, 17734, 17694,
+	17654, 17614, 17574, 17535, 17496, 17457, 17418, 17380, 17342, 17304, 17267, 17229,
+	17192, 17155, 17119, 17082, 17046, 17010, 16974, 16939, 16904, 16869, 16834, 16799,
+	16765, 16731, 16697, 16663, 16629, 16596, 16563, 16530, 16497, 16465, 16432, 16400,
+};
+
+// 1 / m for m in [1 + k / 128; 1 + (k + 1) / 128), k in [0; 128), in Q15
+static uint16_t const recipTable[128] = {
+	32640, 32388, 32140, 31896, 31655, 31418, 31184, 30954, 30728, 30504, 30284, 30067,
+	29853, 29642, 29434, 29229, 29026, 28827, 28630, 28436, 28244, 28056, 27869, 27685,
+	27504, 27324, 27148, 26973, 26801, 26631, 26462, 26297, 26133, 25971, 25811, 25653,
+	25497, 25343, 25191, 25041, 24892, 24745, 24600, 24457, 24315, 24175, 24036, 23899,
+	23764, 23630, 23498, 23367, 23237, 23109, 22982, 22857, 22733, 22611, 22490, 22370,
+	22251, 22134, 22017, 21902, 21789, 21676, 21565, 21454, 21345, 21237, 21130, 21024,
+	20919, 20815, 20713, 20611, 20510, 20410, 20311, 20214, 20117, 20021, 19925, 19831,
+	19738, 19645, 19554, 19463, 19373, 19284, 19196, 19108, 19022, 18936, 18851, 18766,
+	18683, 18600, 18518, 18437, 18356, 18276, 18197, 18118, 18040, 17963, 17886, 17810,
+	17735, 17660, 17586, 17513, 17440, 17368, 17296, 17225, 17155, 17085, 17015, 16947,
+	16878, 16811, 16744, 16677, 16611, 16546, 16481, 16416,
+};
+
+#define COEFF_COUNT(coeffs) (sizeof(coeffs) / sizeof(*(coeffs)))
+
+static int32_t clamp(int64_t v)
+{
+	return v > INT32_MAX ? INT32_MAX : v < INT32_MIN ? INT32_MIN : (int32_t)v;
+}
+
+static int32_t applySign(uint64_t magnitude, bool negative)
+{
+	return clamp(negative ? -(int64_t)magnitude : (int64_t)magnitude);
+}
+
+static uint64_t magnitude(int64_t v)
+{
+	return v < 0 ? -(uint64_t)v : (uint64_t)v;
+}
 
-// pi radians == 32768 fixed-point "degrees"
-#define fdeg2rad(f)	((f) * (M_PI / 32768.0))
-#define rad2fdeg(r)	((r) * (32768.0 / M_PI))
+/*
+ * Number of leading zero bits of a non-zero value
+ */
+static int clz64(uint64_t v)
+{
+	return v >> 32 ? clz(v >> 32) : 32 + clz(v);
+}
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
+#ifdef __SIZEOF_INT128__
+/* `__extension__` keeps `-Wpedantic` quiet about the non-standard type */
+__extension__ typedef unsigned __int128 uint128_t;
 #endif
 
+/*
+ * Full 128-bit product of two 64-bit values
+ */
+static void mul64(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo)
+{
+#ifdef __SIZEOF_INT128__
+	uint128_t product = (uint128_t)a * b;
+
+	*hi = product >> 64;
+	*lo = (uint64_t)product;
+#else
+	uint64_t aLo = a & 0xFFFFFFFF, aHi = a >> 32;
+	uint64_t bLo = b & 0xFFFFFFFF, bHi = b >> 32;
+	uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+	uint64_t mid = (ll >> 32) + (lh & 0xFFFFFFFF) + (hl & 0xFFFFFFFF);
+
+	*hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+	*lo = mid << 32 | (ll & 0xFFFFFFFF);
+#endif
+}
+
+/*
+ * Product of two Q62 values, truncated; the product must be less than 4
+ */
+static uint64_t mulQ62(uint64_t a, uint64_t b)
+{
+	uint64_t hi, lo;
+
+	mul64(a, b, &hi, &lo);
+	return hi << 2 | lo >> 62;
+}
+
+/*
+ * num * 2^shift / den, truncated, with its remainder
+ * `den` must be at most 2^63, and the quotient must fit in 64 bits
+ */
+static uint64_t divShifted(uint64_t num, uint64_t den, unsigned int shift, uint64_t *rem)
+{
+#ifdef __SIZEOF_INT128__
+	uint128_t wide = (uint128_t)num << shift;
+
+	*rem = wide % den;
+	return wide / den;
+#else
+	uint64_t quo = num / den;
+
+	*rem = num % den;
+	for (unsigned int n = 0; n < shift; n++) {
+		quo <<= 1;
+		*rem <<= 1;
+		if (*rem >= den) {
+			*rem -= den;
+			quo |= 1;
+		}
+	}
+	return quo;
+#endif
+}
+
+/*
+ * num * 2^62 / den, truncated, by Newton's method on 1 / den
+ * `num` must be below 2^55, and `den` in [2^59; 2^63)
+ */
+static uint64_t divQ62(uint64_t num, uint64_t den)
+{
+	// Normalize den to m in [1; 2), in Q62
+	int shift = clz64(den) - 1;
+	uint64_t m = den << shift;
+	uint64_t y = (uint64_t)recipTable[(m >> 55) - 128] << 47; // Good to 8 bits
+
+	// Goldschmidt's form of the iteration: scaling both num and m by the same factor
+	// drives m to 1 and num to the quotient, doubling the number of correct bits each time
+	uint64_t d = mulQ62(m, y);
+	uint64_t n = mulQ62(num << 7, y); // Keep 7 extra bits, to absorb rounding errors
+
+	for (int i = 0; i < 3; i++) {
+		uint64_t f = 2 * Q62_ONE - d;
+
+		n = mulQ62(n, f);
+		d = mulQ62(d, f);
+	}
+
+	// n is within 4 units of the exact value, so the biased quotient is either exact or
+	// one too large; in the latter case, the remainder (less than den in magnitude) is negative
+	uint64_t quo = (n + 4) >> (7 - shift);
+	uint64_t rem = (num << 62) - quo * den;
+
+	return quo - (rem >> 63);
+}
+
+/*
+ * num * 2^16 / den, rounded half away from zero, or SATURATED if it does not fit
+ */
+static uint64_t divRounded(uint64_t num, uint64_t den)
+{
+	uint64_t rem;
+	uint64_t quo = divShifted(num, den, 16, &rem);
+
+	if (rem >= den - rem)
+		quo++;
+	return quo < SATURATED ? quo : SATURATED;
+}
+
+/*
+ * sqrt(v) * 2^30 for v <= 2^32, by Newton's method on 1 / sqrt(v)
+ */
+static uint64_t sqrtFixed(uint64_t v)
+{
+	if (v == 0)
+		return 0;
+
+	// Normalize v to m in [1/4; 1), in Q62
+	int shift = (clz64(v) - 2) & ~1;
+
+	uint64_t m = v << shift;
+	uint64_t y = (uint64_t)rsqrtTable[(m >> 54) - 64] << 48; // Good to 8 bits
+
+	// Each iteration doubles the number of correct bits
+	for (int n = 0; n < 3; n++)
+		y = mulQ62(y, 3 * Q62_ONE - mulQ62(m, mulQ62(y, y))) / 2;
+	return mulQ62(m, y) >> (1 + shift / 2);
+}
+
+/*
+ * Evaluate sum(coeffs[n] * (-x)^n) or sum(coeffs[n] * x^n), by Horner's method
+ * The alternating series must be decreasing, so that every partial sum is positive
+ */
+static uint64_t series(uint64_t const *coeffs, size_t count, uint64_t x, bool alternating)
+{
+	uint64_t acc = coeffs[count - 1];
+
+	for (size_t n = count - 1; n-- > 0;)
+		acc = alternating ? coeffs[n] - mulQ62(x, acc) : coeffs[n] + mulQ62(x, acc);
+	return acc;
+}
+
+/*
+ * Sine of an angle in 1/2^30 quarter turns, between 0 and a quarter turn, in Q62
+ */
+static uint64_t sinQuarter(uint32_t a)
+{
+	// Only use the Taylor series up to pi/4, where they converge fastest
+	if (a <= UINT32_C(1) << 29) {
+		uint64_t rad = mulQ62((uint64_t)a << 32, Q62_HALF_PI);
+
+		return mulQ62(rad, series(sinCoeffs, COEFF_COUNT(sinCoeffs), mulQ62(rad, rad), true));
+	} else {
+		uint64_t rad = mulQ62((uint64_t)((UINT32_C(1) << 30) - a) << 32, Q62_HALF_PI);
+
+		return series(cosCoeffs, COEFF_COUNT(cosCoeffs), mulQ62(rad, rad), true);
+	}
+}
+
+/*
+ * Sine of an angle in 1/2^32 turns, in Q62 with a separate sign
+ */
+static uint64_t sinTurns(uint32_t a, bool *negative)
+{
+	uint32_t inQuarter = a & 0x3FFFFFFF;
+
+	*negative = a & 0x80000000;
+	return sinQuarter(a & 0x40000000 ? 0x40000000 - inQuarter : inQuarter);
+}
+
+/*
+ * Angle of the vector (x, y) with x, y >= 0, in 1/2^64 turns
+ */
+static uint64_t vectorAngle(uint64_t x, uint64_t y)
+{
+	if (y > x)
+		return (UINT64_C(1) << 62) - vectorAngle(y, x);
+	if (x == 0)
+		return 0;
+
+	// Scale the vector to make the most of the available precision, with x in [2^53; 2^54)
+	int shift = clz64(x) - 10;
+
+	if (shift > 0) {
+		x <<= shift;
+		y <<= shift;
+	} else {
+		x >>= -shift;
+		y >>= -shift;
+	}
+
+	// Look up the closest k / 64 to y / x, then rotate by its angle to get a small one
+	// The reciprocal table gets within one of k, and the remainder tells which way
+	uint64_t t = y * 64 + x / 2;
+	uint64_t k = (t >> 38) * recipTable[(x >> 46) - 128] >> 30;
+	int64_t r = (int64_t)(t - k * x);
+
+	k += (r >= (int64_t)x) - (r < 0);
+	int64_t num = (int64_t)(y * 64) - (int64_t)(k * x);
+	uint64_t tangent = divQ62(magnitude(num), x * 64 + k * y);
+	uint64_t rad = mulQ62(tangent, series(oddCoeffs, COEFF_COUNT(oddCoeffs),
+					      mulQ62(tangent, tangent), true));
+	uint64_t delta = mulQ62(rad, Q62_TWO_OVER_PI);
+
+	return num < 0 ? atanTable[k] - delta : atanTable[k] + delta;
+}
+
+/*
+ * Round an angle in 1/2^64 turns to fixed-point "degrees" (1/2^32 turns)
+ */
+static int32_t roundAngle(uint64_t angle)
+{
+	return (int32_t)(uint32_t)((angle + (UINT64_C(1) << 31)) >> 32);
+}
+
+/*
+ * log2(u / 65536) for u > 0, in Q59
+ */
+static int64_t log2Fixed(uint32_t u)
+{
+	int exponent = 31 - clz(u);
+
+	uint64_t mantissa = (uint64_t)u << (62 - exponent); // In [1; 2)
+	unsigned int k = mantissa >> 56 & 63;
+	uint64_t base = Q62_ONE + ((uint64_t)k << 56);
+
+	// log2(m) = log2(base) + 2 * atanh((m - base) / (m + base)) / ln 2
+	// With v = (m - base) / (2 * base) < 1/128, that ratio is v / (1 + v), whose Newton
+	// expansion v * (1 - v) * (1 + v^2) * (1 + v^4) falls short of it by less than v^9
+	uint64_t half = (mantissa - base) >> 1;
+	uint64_t v = mulQ62(half << 7, log2RecipTable[k]); // Keep 7 extra bits, in Q69
+	uint64_t v2 = mulQ62(v, v); // In Q76
+	uint64_t v4 = mulQ62(v2, v2) >> 14;
+	uint64_t w = v - (v2 >> 7);
+
+	w += mulQ62(w, v2) >> 14;
+	w += mulQ62(w, v4) >> 14;
+
+	// w is within 72 units below and 3 above the exact value, so the biased quotient is
+	// either exact or one too large, which the sign of the remainder tells apart
+	w = (w + 72) >> 7;
+	w -= ((half << 62) - w * ((mantissa + base) >> 1)) >> 63;
+	uint64_t atanh = mulQ62(w, series(oddCoeffs, COEFF_COUNT(oddCoeffs), mulQ62(w, w), false));
+	uint64_t fraction = log2Table[k] + mulQ62(atanh * 2, Q62_INV_LN_2);
+
+	return (int64_t)(exponent - 16) * Q59_ONE + (int64_t)(fraction >> 3);
+}
+
+/*
+ * 2^x, for 0 <= x < 1 in Q62
+ */
+static uint64_t exp2Fixed(uint64_t x)
+{
+	uint64_t rest = mulQ62(x & ((UINT64_C(1) << 56) - 1), Q62_LN_2);
+
+	return mulQ62(exp2Table[x >> 56], series(expCoeffs, COEFF_COUNT(expCoeffs), rest, false));
+}
+
 /*
  * Return the _PI symbol value
  */
@@ -37,7 +488,7 @@ int32_t fix_Callback_PI(void)
 {
 	warning(WARNING_OBSOLETE, "`_PI` is deprecated; use 3.14159\n");
 
-	return double2fix(M_PI);
+	return 0x3243F; // pi, rounded to 16.16
 }
 
 /*
@@ -54,7 +505,7 @@ void fix_Print(int32_t i)
 	}
 
 	printf("%s%" PRIu32 ".%05" PRIu32, sign, u >> 16,
-	       ((uint32_t)(fix2double(u) * 100000 + 0.5)) % 100000);
+	       (uint32_t)(((uint64_t)(u & 0xFFFF) * 100000 + 0x8000) >> 16) % 100000);
 }
 
 /*
@@ -62,7 +513,10 @@ void fix_Print(int32_t i)
  */
 int32_t fix_Sin(int32_t i)
 {
-	return double2fix(sin(fdeg2rad(fix2double(i))));
+	bool negative;
+	uint64_t sine = sinTurns(i, &negative);
+
+	return applySign((sine + (UINT64_C(1) << 45)) >> 46, negative);
 }
 
 /*
@@ -70,7 +524,7 @@ int32_t fix_Sin(int32_t i)
  */
 int32_t fix_Cos(int32_t i)
 {
-	return double2fix(cos(fdeg2rad(fix2double(i))));
+	return fix_Sin((uint32_t)i + 0x40000000);
 }
 
 /*
@@ -78,7 +532,13 @@ int32_t fix_Cos(int32_t i)
  */
 int32_t fix_Tan(int32_t i)
 {
-	return double2fix(tan(fdeg2rad(fix2double(i))));
+	bool sinNegative, cosNegative;
+	uint64_t sine = sinTurns(i, &sinNegative);
+	uint64_t cosine = sinTurns((uint32_t)i + 0x40000000, &cosNegative);
+
+	if (cosine == 0)
+		return applySign(SATURATED, sinNegative != cosNegative);
+	return applySign(divRounded(sine, cosine), sinNegative != cosNegative);
 }
 
 /*
@@ -86,7 +546,14 @@ int32_t fix_Tan(int32_t i)
  */
 int32_t fix_ASin(int32_t i)
 {
-	return double2fix(rad2fdeg(asin(fix2double(i))));
+	uint64_t x = magnitude(i);
+
+	if (x > 65536)
+		return 0;
+
+	uint64_t angle = vectorAngle(sqrtFixed((UINT64_C(1) << 32) - x * x), x << 30);
+
+	return roundAngle(i < 0 ? -angle : angle);
 }
 
 /*
@@ -94,7 +561,14 @@ int32_t fix_ASin(int32_t i)
  */
 int32_t fix_ACos(int32_t i)
 {
-	return double2fix(rad2fdeg(acos(fix2double(i))));
+	uint64_t x = magnitude(i);
+
+	if (x > 65536)
+		return 0;
+
+	uint64_t angle = vectorAngle(x << 30, sqrtFixed((UINT64_C(1) << 32) - x * x));
+
+	return roundAngle(i < 0 ? (UINT64_C(1) << 63) - angle : angle);
 }
 
 /*
@@ -102,7 +576,7 @@ int32_t fix_ACos(int32_t i)
  */
 int32_t fix_ATan(int32_t i)
 {
-	return double2fix(rad2fdeg(atan(fix2double(i))));
+	return fix_ATan2(i, 65536);
 }
 
 /*
@@ -110,7 +584,11 @@ int32_t fix_ATan(int32_t i)
  */
 int32_t fix_ATan2(int32_t i, int32_t j)
 {
-	return double2fix(rad2fdeg(atan2(fix2double(i), fix2double(j))));
+	uint64_t angle = vectorAngle(magnitude(j), magnitude(i));
+
+	if (j < 0)
+		angle = (UINT64_C(1) << 63) - angle;
+	return roundAngle(i < 0 ? -angle : angle);
 }
 
 /*
@@ -118,7 +596,9 @@ int32_t fix_ATan2(int32_t i, int32_t j)
  */
 int32_t fix_Mul(int32_t i, int32_t j)
 {
-	return double2fix(fix2double(i) * fix2double(j));
+	uint64_t product = magnitude(i) * magnitude(j);
+
+	return applySign((product + 0x8000) >> 16, (i < 0) != (j < 0));
 }
 
 /*
@@ -126,7 +606,9 @@ int32_t fix_Mul(int32_t i, int32_t j)
  */
 int32_t fix_Div(int32_t i, int32_t j)
 {
-	return double2fix(fix2double(i) / fix2double(j));
+	if (j == 0)
+		return i == 0 ? 0 : applySign(SATURATED, i < 0);
+	return applySign(divRounded(magnitude(i), magnitude(j)), (i < 0) != (j < 0));
 }
 
 /*
@@ -134,7 +616,50 @@ int32_t fix_Div(int32_t i, int32_t j)
  */
 int32_t fix_Pow(int32_t i, int32_t j)
 {
-	return double2fix(pow(fix2double(i), fix2double(j)));
+	if (j == 0)
+		return 65536;
+	if (i == 0)
+		return j > 0 ? 0 : INT32_MAX;
+
+	bool negative = false;
+
+	// Negative numbers only have real powers with integer exponents
+	if (i < 0) {
+		if (j & 0xFFFF)
+			return 0;
+		negative = j & 0x10000;
+	}
+
+	// The result is 2^(log2(i) * j); compute that exponent in Q58
+	int64_t logarithm = log2Fixed(magnitude(i));
+	bool expNegative = (logarithm < 0) != (j < 0);
+	uint64_t hi, lo;
+
+	mul64(magnitude(logarithm), magnitude(j), &hi, &lo);
+	if (hi >= 1 << 16) // The exponent's magnitude is at least 32
+		return expNegative ? 0 : applySign(SATURATED, negative);
+
+	uint64_t exponent = hi << 47 | lo >> 17;
+	int64_t intPart = exponent >> 58;
+	uint64_t fracPart = exponent & ((UINT64_C(1) << 58) - 1);
+
+	if (expNegative) {
+		intPart = -intPart;
+		if (fracPart) {
+			intPart--;
+			fracPart = (UINT64_C(1) << 58) - fracPart;
+		}
+	}
+
+	if (intPart >= 15)
+		return applySign(SATURATED, negative);
+	if (intPart < -17)
+		return 0;
+
+	uint64_t power = exp2Fixed(fracPart << 4);
+	unsigned int shift = 46 - intPart;
+
+	return applySign((power + (UINT64_C(1) << (shift - 1))) >> shift, negative);
 }
 
 /*
@@ -142,7 +667,19 @@ int32_t fix_Pow(int32_t i, int32_t j)
  */
 int32_t fix_Log(int32_t i, int32_t j)
 {
-	return double2fix(log(fix2double(i)) / log(fix2double(j)));
+	if (i < 0 || j < 0)
+		return 0;
+	if (i == 0) // -inf / log(j)
+		return j == 0 ? 0 : applySign(SATURATED, j >= 65536);
+	if (j == 0) // log(i) / -inf
+		return 0;
+
+	int64_t logI = log2Fixed(i);
+	int64_t logJ = log2Fixed(j);
+
+	if (logJ == 0)
+		return logI == 0 ? 0 : applySign(SATURATED, logI < 0);
+	return applySign(divRounded(magnitude(logI), magnitude(logJ)), (logI < 0) != (logJ < 0));
 }
 
 /*
@@ -150,7 +687,7 @@ int32_t fix_Log(int32_t i, int32_t j)
  */
 int32_t fix_Round(int32_t i)
 {
-	return double2fix(round(fix2double(i)));
+	return applySign((magnitude(i) + 0x8000) & ~UINT64_C(0xFFFF), i < 0);
 }
 
 /*
@@ -158,7 +695,7 @@ int32_t fix_Round(int32_t i)
  */
 int32_t fix_Ceil(int32_t i)
 {
-	return double2fix(ceil(fix2double(i)));
+	return applySign((magnitude(i) + (i < 0 ? 0 : 0xFFFF)) & ~UINT64_C(0xFFFF), i < 0);
 }
 
 /*
@@ -166,5 +703,5 @@ int32_t fix_Ceil(int32_t i)
  */
 int32_t fix_Floor(int32_t i)
 {
-	return double2fix(floor(fix2double(i)));
+	return applySign((magnitude(i) + (i < 0 ? 0xFFFF : 0)) & ~UINT64_C(0xFFFF), i < 0);
 }
@@ -17,10 +17,13 @@
 #include "asm/fstack.h"
 #include "asm/macro.h"
 #include "asm/main.h"
+#include "asm/pch.h"
 #include "asm/symbol.h"
 #include "asm/warning.h"
 #include "platform.h" /* S_ISDIR (stat macro) */
 
+#include "hashmap.h"
+
 #define MAXINCPATHS 128
 
 #ifdef LEXER_DEBUG
@@ -49,6 +52,38 @@ size_t maxRecursionDepth;
 static unsigned int nbIncPaths = 0;
 static char const *includePaths[MAXINCPATHS];
 
+/*
+ * Where `fstk_FindFile` found each file, so that later lookups of the same name need not try
+ * (and `stat`) every include path again. Since include paths are only added from the command
+ * line, this remains valid for the whole program, including across files in batch mode.
+ */
+struct ResolvedPath {
+	char *fullPath; /* NULL if the file was not found */
+	char name[];
+};
+
+static HashMap resolvedPaths;
+
+/*
+ * The include guard of each file included so far (see `lexer_FindIncludeGuard`), by path
+ * Files without one are recorded as well, so that they are only scanned once
+ */
+struct IncludeGuard {
+	char *symName; /* NULL if the file has no include guard */
+	char path[];
+};
+
+static HashMap includeGuards;
+
+/*
+ * The files that the target depends on, in the order they were first used
+ * They are only written out once assembly is done, so each is listed only once
+ */
+static HashMap depSet;
+static char **deps;
+static size_t nbDeps;
+static size_t depsCapacity;
+
 static const char *dumpNodeAndParents(struct FileStackNode const *node)
 {
 	char const *name;
@@ -114,6 +149,35 @@ char const *fstk_GetFileName(void)
 	return ((struct FileStackNamedNode const *)node)->name;
 }
 
+static void freeResolvedPath(void *_resolved, void *arg)
+{
+	struct ResolvedPath *resolved = _resolved;
+
+	(void)arg;
+	free(resolved->fullPath);
+	free(resolved);
+}
+
+static void rememberResolvedPath(char const *name, char const *fullPath)
+{
+	size_t len = strlen(name);
+	struct ResolvedPath *resolved = malloc(sizeof(*resolved) + len + 1);
+
+	/* Not remembering the path only costs performance */
+	if (!resolved)
+		return;
+	resolved->fullPath = NULL;
+	if (fullPath) {
+		resolved->fullPath = strdup(fullPath);
+		if (!resolved->fullPath) {
+			free(resolved);
+			return;
+		}
+	}
+	memcpy(resolved->name, name, len + 1);
+	hash_AddElement(resolvedPaths, resolved->name, resolved);
+}
+
 void fstk_AddIncludePath(char const *path)
 {
 	if (path[0] == '\0')
@@ -138,15 +202,94 @@ void fstk_AddIncludePath(char const *path)
 		*end++ = '/';
 	*end = '\0';
 	includePaths[nbIncPaths++] = str;
+
+	/* The new path may take precedence over previously resolved ones */
+	hash_ForEach(resolvedPaths, freeResolvedPath, NULL);
+	hash_EmptyMap(resolvedPaths);
+}
+
+/*
+ * Add a file that the target depends on to the dependency file, if any
+ */
+void fstk_AddDep(char const *path)
+{
+	if (!dependfile || hash_GetElement(depSet, path))
+		return;
+
+	if (nbDeps == depsCapacity) {
+		depsCapacity = depsCapacity ? depsCapacity * 2 : 16;
+		deps = realloc(deps, sizeof(*deps) * depsCapacity);
+		if (!deps)
+			fatalerror("Failed to allocate dependency list: %s\n", strerror(errno));
+	}
+
+	char *dep = strdup(path);
+
+	if (!dep)
+		fatalerror("Failed to allocate dependency name: %s\n", strerror(errno));
+	deps[nbDeps++] = dep;
+	hash_AddElement(depSet, dep, dep);
+}
+
+/*
+ * Append a string to the dependency file's contents, or only count its size if `buf` is NULL
+ */
+static size_t appendDep(char *buf, size_t len, char const *str)
+{
+	size_t strLen = strlen(str);
+
+	if (buf)
+		memcpy(&buf[len], str, strLen);
+	return len + strLen;
 }
 
-static void printDep(char const *path)
+static size_t formatDeps(char *buf)
 {
-	if (dependfile) {
-		fprintf(dependfile, "%s: %s\n", targetFileName, path);
-		if (generatePhonyDeps)
-			fprintf(dependfile, "%s:\n", path);
+	size_t len = 0;
+
+	if (dependFormat == DEPFORMAT_NINJA) {
+		len = appendDep(buf, len, targetFileName);
+		len = appendDep(buf, len, ":");
+		for (size_t i = 0; i < nbDeps; i++) {
+			len = appendDep(buf, len, i ? " \\\n  " : " ");
+			len = appendDep(buf, len, deps[i]);
+		}
+		return appendDep(buf, len, "\n");
+	}
+
+	for (size_t i = 0; i < nbDeps; i++) {
+		len = appendDep(buf, len, targetFileName);
+		len = appendDep(buf, len, ": ");
+		len = appendDep(buf, len, deps[i]);
+		len = appendDep(buf, len, "\n");
+		/* The main file comes first, and does not get a phony target */
+		if (generatePhonyDeps && i != 0) {
+			len = appendDep(buf, len, deps[i]);
+			len = appendDep(buf, len, ":\n");
+		}
 	}
+	return len;
+}
+
+/*
+ * Write all the dependencies to the dependency file at once, then forget them
+ */
+void fstk_WriteDeps(void)
+{
+	size_t len = formatDeps(NULL);
+	char *buf = malloc(len);
+
+	if (!buf)
+		fatalerror("Failed to allocate dependency file contents: %s\n", strerror(errno));
+	formatDeps(buf);
+	if (fwrite(buf, 1, len, dependfile) != len)
+		error("Failed to write dependency file: %s\n", strerror(errno));
+	free(buf);
+
+	for (size_t i = 0; i < nbDeps; i++)
+		free(deps[i]);
+	nbDeps = 0;
+	hash_EmptyMap(depSet);
 }
 
 static bool isPathValid(char const *path)
@@ -162,6 +305,28 @@ static bool isPathValid(char const *path)
 
 bool fstk_FindFile(char const *path, char **fullPath, size_t *size)
 {
+	struct ResolvedPath const *resolved = hash_GetElement(resolvedPaths, path);
+
+	if (resolved) {
+		if (!resolved->fullPath)
+			goto notFound;
+
+		size_t len = strlen(resolved->fullPath);
+
+		if (*size < len + 1) {
+			*size = len + 1;
+			*fullPath = realloc(*fullPath, *size);
+			if (!*fullPath) {
+				error("realloc error during include path search: %s\n",
+				      strerror(errno));
+				return false;
+			}
+		}
+		memcpy(*fullPath, resolved->fullPath, len + 1);
+		fstk_AddDep(*fullPath);
+		return true;
+	}
+
 	if (!*size) {
 		*size = 64; /* This is arbitrary, really */
 		*fullPath = realloc(*fullPath, *size);
@@ -199,15 +364,21 @@ bool fstk_FindFile(char const *path, char **fullPath, size_t *size)
 			}
 
 			if (isPathValid(*fullPath)) {
-				printDep(*fullPath);
+				rememberResolvedPath(path, *fullPath);
+				fstk_AddDep(*fullPath);
 				return true;
 			}
+
+			/* Only remember that the file is missing once all paths have been tried */
+			if (i == nbIncPaths)
+				rememberResolvedPath(path, NULL);
 		}
 	}
 
+notFound:
 	errno = ENOENT;
 	if (generatedMissingIncludes)
-		printDep(path);
+		fstk_AddDep(path);
 	return false;
 }
 
@@ -313,6 +484,19 @@ static void newContext(struct FileStackNode *fileInfo)
 	contextStack = context;
 }
 
+static void rememberIncludeGuard(char const *path, struct LexerState const *state)
+{
+	size_t len = strlen(path);
+	struct IncludeGuard *guard = malloc(sizeof(*guard) + len + 1);
+
+	/* Not remembering the guard only costs performance */
+	if (!guard)
+		return;
+	guard->symName = lexer_FindIncludeGuard(state);
+	memcpy(guard->path, path, len + 1);
+	hash_AddElement(includeGuards, guard->path, guard);
+}
+
 void fstk_RunInclude(char const *path)
 {
 	dbgPrint("Including path \"%s\"\n", path);
@@ -334,6 +518,16 @@ void fstk_RunInclude(char const *path)
 	}
 	dbgPrint("Full path: \"%s\"\n", fullPath);
 
+	struct IncludeGuard const *guard = hash_GetElement(includeGuards, fullPath);
+
+	/* Including a file whose guard is defined does nothing, unless it exceeds the depth */
+	if (guard && guard->symName && sym_FindScopedSymbol(guard->symName)
+	    && contextDepth + 1 < maxRecursionDepth) {
+		dbgPrint("Skipping \"%s\", guarded by \"%s\"\n", fullPath, guard->symName);
+		free(fullPath);
+		return;
+	}
+
 	struct FileStackNamedNode *fileInfo = malloc(sizeof(*fileInfo) + size);
 
 	if (!fileInfo) {
@@ -348,6 +542,9 @@ void fstk_RunInclude(char const *path)
 	contextStack->lexerState = lexer_OpenFile(fileInfo->name);
 	if (!contextStack->lexerState)
 		fatalerror("Failed to set up lexer for file include\n");
+	pch_AddDependency(fileInfo->name);
+	if (!guard)
+		rememberIncludeGuard(fileInfo->name, contextStack->lexerState);
 	lexer_SetStateAtEOL(contextStack->lexerState);
 	/* We're back at top-level, so most things are reset */
 	contextStack->uniqueID = 0;
@@ -534,6 +731,7 @@ void fstk_Init(char const *mainPath, size_t maxDepth)
 
 	if (!state)
 		fatalerror("Failed to open main file!\n");
+	pch_AddDependency(mainPath);
 	lexer_SetState(state);
 	char const *fileName = lexer_GetFileName();
 	size_t len = strlen(fileName);
@@ -581,3 +779,28 @@ void fstk_Init(char const *mainPath, size_t maxDepth)
 	assert(DEPTH_LIMIT >= DEFAULT_MAX_DEPTH);
 #undef DEPTH_LIMIT
 }
+
+/*
+ * Tear down whatever is left of the file stack once a file has been assembled,
+ * so that the next file in batch mode can be passed to `fstk_Init`
+ * Include paths are kept, since they are set for the whole invocation
+ */
+void fstk_Reset(void)
+{
+	lexer_SetStateAtEOL(NULL);
+	while (contextStack) {
+		struct Context *context = contextStack;
+
+		contextStack = context->parent;
+		if (context->lexerState)
+			lexer_DeleteState(context->lexerState);
+		/* Referenced nodes are still pointed to by symbols and patches */
+		if (!context->fileInfo->referenced)
+			free(context->fileInfo);
+		free(context->forName);
+		free(context);
+	}
+	contextDepth = 0;
+	lexer_SetState(NULL);
+	macro_Reset();
+}
@@ -39,6 +39,8 @@
 /* Include this last so it gets all type & constant definitions */
 #include "parser.h" /* For token definitions, generated from parser.y */
 
+#include "hashmap.h"
+
 #ifdef LEXER_DEBUG
   #define dbgPrint(...) fprintf(stderr, "[lexer] " __VA_ARGS__)
 #else
@@ -68,7 +70,6 @@
 	CloseHandle(mappingObj); \
 	CloseHandle(file); \
 } while (0)
-# define munmap(ptr, size)  UnmapViewOfFile((ptr))
 
 #else /* defined(_MSC_VER) || defined(__MINGW32__) */
 
@@ -309,9 +310,15 @@ static_assert(LEXER_BUF_SIZE > 1, "Lexer buffer size is too small");
 /* This caps the size of buffer reads, and according to POSIX, passing more than SSIZE_MAX is UB */
 static_assert(LEXER_BUF_SIZE <= SSIZE_MAX, "Lexer buffer size is too large");
 
+/*
+ * Expansions are kept in a contiguous stack, innermost last. Their names are borrowed:
+ * an EQUS is kept alive until its expansion ends (see `sym_EndExpansion`), and an
+ * interpolation's name is its own contents.
+ */
 struct Expansion {
-	struct Expansion *parent;
-	char *name;
+	char const *name;
+	size_t nameLen;
+	struct Symbol *sym; /* The EQUS being expanded, if any */
 	union {
 		char const *unowned;
 		char *owned;
@@ -337,7 +344,6 @@ struct LexerState {
 			char *ptr; /* Technically `const` during the lexer's execution */
 			size_t size;
 			size_t offset;
-			bool isReferenced; /* If a macro in this file requires not unmapping it */
 		};
 		struct { /* Otherwise */
 			int fd;
@@ -367,7 +373,9 @@ struct LexerState {
 	bool disableInterpolation;
 	size_t macroArgScanDistance; /* Max distance already scanned for macro args */
 	bool expandStrings;
-	struct Expansion *expansions; /* Points to the innermost current expansion */
+	struct Expansion *expansions; /* Stack of current expansions, innermost last */
+	size_t nbExpansions; /* Current depth of the expansion stack */
+	size_t expansionCapacity; /* Size of the stack above */
 };
 
 struct LexerState *lexerState = NULL;
@@ -388,7 +396,27 @@ static void initState(struct LexerState *state)
 	state->disableInterpolation = false;
 	state->macroArgScanDistance = 0;
 	state->expandStrings = true;
+	state->nbExpansions = 0;
+}
+
+static void initExpansions(struct LexerState *state)
+{
 	state->expansions = NULL;
+	state->expansionCapacity = 0;
+}
+
+static void endExpansion(struct Expansion *exp)
+{
+	if (exp->owned)
+		free(exp->contents.owned);
+	if (exp->sym)
+		sym_EndExpansion(exp->sym);
+}
+
+static void freeExpansions(struct LexerState *state)
+{
+	while (state->nbExpansions)
+		endExpansion(&state->expansions[--state->nbExpansions]);
 }
 
 static void nextLine(void)
@@ -453,6 +481,33 @@ void lexer_ReachELSEBlock(void)
 	lexerState->ifStack->reachedElseBlock = true;
 }
 
+/*
+ * Files are mapped only once, and then stay mapped until the program exits; this lets files
+ * included many times (including from several files in batch mode) be read only once, and
+ * macros defined in a file can keep pointing into its contents.
+ */
+struct MappedFile {
+	char *ptr;
+	size_t size;
+	char path[];
+};
+
+static HashMap mappedFiles;
+
+static void cacheMapping(char const *path, char *ptr, size_t size)
+{
+	size_t len = strlen(path);
+	struct MappedFile *file = malloc(sizeof(*file) + len + 1);
+
+	/* Failing to cache the mapping is not a problem, it's just leaked */
+	if (!file)
+		return;
+	file->ptr = ptr;
+	file->size = size;
+	memcpy(file->path, path, len + 1);
+	hash_AddElement(mappedFiles, file->path, file);
+}
+
 struct LexerState *lexer_OpenFile(char const *path)
 {
 	dbgPrint("Opening file \"%s\"\n", path);
@@ -468,6 +523,23 @@ struct LexerState *lexer_OpenFile(char const *path)
 		error("Failed to allocate memory for lexer state: %s\n", strerror(errno));
 		return NULL;
 	}
+
+	struct MappedFile const *mapping = isStdin ? NULL : hash_GetElement(mappedFiles, path);
+
+	if (mapping) {
+		state->path = path;
+		state->isFile = true;
+		state->isMmapped = true;
+		state->ptr = mapping->ptr;
+		state->size = mapping->size;
+		state->offset = 0;
+
+		initState(state);
+		initExpansions(state);
+		state->lineNo = 0;
+		return state;
+	}
+
 	if (!isStdin && stat(path, &fileInfo) != 0) {
 		error("Failed to stat file \"%s\": %s\n", path, strerror(errno));
 		free(state);
@@ -501,11 +573,11 @@ struct LexerState *lexer_OpenFile(char const *path)
 			close(state->fd);
 
 			state->isMmapped = true;
-			state->isReferenced = false; // By default, a state isn't referenced
 			state->ptr = mappingAddr;
 			assert(fileInfo.st_size >= 0);
 			state->size = (size_t)fileInfo.st_size;
 			state->offset = 0;
+			cacheMapping(path, state->ptr, state->size);
 
 			if (verbose)
 				printf("File %s successfully mmap()ped\n", path);
@@ -527,6 +599,7 @@ struct LexerState *lexer_OpenFile(char const *path)
 	}
 
 	initState(state);
+	initExpansions(state);
 	state->lineNo = 0; /* Will be incremented at first line start */
 	return state;
 }
@@ -550,6 +623,7 @@ struct LexerState *lexer_OpenFileView(char const *path, char *buf, size_t size,
 	state->offset = 0;
 
 	initState(state);
+	initExpansions(state);
 	state->lineNo = lineNo; /* Will be incremented at first line start */
 	return state;
 }
@@ -558,6 +632,7 @@ void lexer_RestartRept(uint32_t lineNo)
 {
 	dbgPrint("Restarting REPT/FOR\n");
 	lexerState->offset = 0;
+	freeExpansions(lexerState);
 	initState(lexerState);
 	lexerState->lineNo = lineNo;
 }
@@ -577,10 +652,11 @@ void lexer_DeleteState(struct LexerState *state)
 	// `lexerStateEOL`, but there's currently no situation in which this should happen.
 	assert(state != lexerStateEOL);
 
+	freeExpansions(state);
+	free(state->expansions);
+	/* Mapped files are kept in `mappedFiles`, and thus never unmapped */
 	if (!state->isMmapped)
 		close(state->fd);
-	else if (state->isFile && !state->isReferenced)
-		munmap(state->ptr, state->size);
 	free(state);
 }
 
@@ -675,7 +751,7 @@ static void reallocCaptureBuf(void)
 		fatalerror("realloc error while resizing capture buffer: %s\n", strerror(errno));
 }
 
-static void beginExpansion(char const *str, bool owned, char const *name)
+static void beginExpansion(char const *str, bool owned, char const *name, struct Symbol *sym)
 {
 	size_t size = strlen(str);
 
@@ -683,36 +759,31 @@ static void beginExpansion(char const *str, bool owned, char const *name)
 	if (!size)
 		return;
 
-	if (name) {
-		size_t depth = 0;
+	if (name && lexerState->nbExpansions > maxRecursionDepth)
+		fatalerror("Recursion limit (%zu) exceeded\n", maxRecursionDepth);
 
-		for (struct Expansion *exp = lexerState->expansions; exp; exp = exp->parent) {
-			if (depth++ >= maxRecursionDepth)
-				fatalerror("Recursion limit (%zu) exceeded\n", maxRecursionDepth);
-		}
+	if (lexerState->nbExpansions == lexerState->expansionCapacity) {
+		/* The stack is reused for the lexer state's whole lifetime, so this is rare */
+		lexerState->expansionCapacity = lexerState->expansionCapacity
+							? lexerState->expansionCapacity * 2 : 8;
+		lexerState->expansions = realloc(lexerState->expansions,
+						 sizeof(*lexerState->expansions)
+							* lexerState->expansionCapacity);
+		if (!lexerState->expansions)
+			fatalerror("Unable to allocate new expansion: %s\n", strerror(errno));
 	}
 
-	struct Expansion *new = malloc(sizeof(*new));
+	struct Expansion *new = &lexerState->expansions[lexerState->nbExpansions++];
 
-	if (!new)
-		fatalerror("Unable to allocate new expansion: %s\n", strerror(errno));
-
-	new->parent = lexerState->expansions;
-	new->name = name ? strdup(name) : NULL;
+	new->name = name;
+	new->nameLen = !name ? 0 : name == str ? size : strlen(name);
+	new->sym = sym;
+	if (sym)
+		sym_BeginExpansion(sym);
 	new->contents.unowned = str;
 	new->size = size;
 	new->offset = 0;
 	new->owned = owned;
-
-	lexerState->expansions = new;
-}
-
-static void freeExpansion(struct Expansion *expansion)
-{
-	free(expansion->name);
-	if (expansion->owned)
-		free(expansion->contents.owned);
-	free(expansion);
 }
 
 static bool isMacroChar(char c)
@@ -827,7 +898,9 @@ static char const *readMacroArg(char name)
 /* We only need one character of lookahead, for macro arguments */
 static int peekInternal(uint8_t distance)
 {
-	for (struct Expansion *exp = lexerState->expansions; exp; exp = exp->parent) {
+	for (size_t i = lexerState->nbExpansions; i-- > 0; ) {
+		struct Expansion const *exp = &lexerState->expansions[i];
+
 		/*
 		 * An expansion that has reached its end will have `exp->offset` == `exp->size`,
 		 * and `peekInternal` will continue with its parent
@@ -926,7 +999,7 @@ restart:
 			if (!str || !str[0])
 				goto restart;
 
-			beginExpansion(str, c == '#', NULL);
+			beginExpansion(str, c == '#', NULL, NULL);
 
 			/*
 			 * Assuming macro args can't be recursive (I'll be damned if a way
@@ -944,7 +1017,7 @@ restart:
 		char const *str = readInterpolation(0);
 
 		if (str && str[0])
-			beginExpansion(str, false, str);
+			beginExpansion(str, false, str, NULL);
 		goto restart;
 	}
 
@@ -966,19 +1039,19 @@ static void shiftChar(void)
 	lexerState->macroArgScanDistance--;
 
 restart:
-	if (lexerState->expansions) {
+	if (lexerState->nbExpansions) {
 		/* Advance within the current expansion */
-		assert(lexerState->expansions->offset <= lexerState->expansions->size);
-		lexerState->expansions->offset++;
-		if (lexerState->expansions->offset > lexerState->expansions->size) {
+		struct Expansion *exp = &lexerState->expansions[lexerState->nbExpansions - 1];
+
+		assert(exp->offset <= exp->size);
+		exp->offset++;
+		if (exp->offset > exp->size) {
 			/*
-			 * When advancing would go past an expansion's end, free it,
+			 * When advancing would go past an expansion's end, pop it,
 			 * move up to its parent, and try again to advance
 			 */
-			struct Expansion *exp = lexerState->expansions;
-
-			lexerState->expansions = lexerState->expansions->parent;
-			freeExpansion(exp);
+			endExpansion(exp);
+			lexerState->nbExpansions--;
 			goto restart;
 		}
 	} else {
@@ -1013,6 +1086,47 @@ static void handleCRLF(int c)
 		shiftChar();
 }
 
+/*
+ * When reading straight from a buffer with nothing being expanded, hot loops that only
+ * discard characters can scan the buffer themselves instead of using `peek` and `shiftChar`
+ */
+static bool canReadBufferDirectly(void)
+{
+	return lexerState->isMmapped && !lexerState->nbExpansions && !lexerState->capturing;
+}
+
+/*
+ * Consume chars read directly from the buffer, like `shiftChar` would, except that
+ * updating the column number (and line number, if applicable) is up to the caller
+ */
+static void shiftBufferedChars(size_t nbChars)
+{
+	assert(lexerState->offset + nbChars <= lexerState->size);
+	lexerState->offset += nbChars;
+	/* Those chars are past any that were already scanned for macro args */
+	if (lexerState->macroArgScanDistance > nbChars)
+		lexerState->macroArgScanDistance -= nbChars;
+	else
+		lexerState->macroArgScanDistance = 0;
+}
+
+static void discardWhitespace(void)
+{
+	if (canReadBufferDirectly()) {
+		char const *ptr = &lexerState->ptr[lexerState->offset];
+		size_t nbChars = 0;
+
+		while (nbChars < lexerState->size - lexerState->offset && isWhitespace(ptr[nbChars]))
+			nbChars++;
+		shiftBufferedChars(nbChars);
+		lexerState->colNo += nbChars;
+	}
+
+	/* Finish the job if the whitespace continues past the buffer, e.g. in an expansion */
+	while (isWhitespace(peek()))
+		shiftChar();
+}
+
 /* "Services" provided by the lexer to the rest of the program */
 
 char const *lexer_GetFileName(void)
@@ -1035,10 +1149,13 @@ void lexer_DumpStringExpansions(void)
 	if (!lexerState)
 		return;
 
-	for (struct Expansion *exp = lexerState->expansions; exp; exp = exp->parent) {
+	for (size_t i = lexerState->nbExpansions; i-- > 0; ) {
+		struct Expansion const *exp = &lexerState->expansions[i];
+
 		/* Only register EQUS expansions, not string args */
 		if (exp->name)
-			fprintf(stderr, "while expanding symbol \"%s\"\n", exp->name);
+			fprintf(stderr, "while expanding symbol \"%.*s\"\n",
+				(int)exp->nameLen, exp->name);
 	}
 }
 
@@ -1048,6 +1165,40 @@ static void discardBlockComment(void)
 	dbgPrint("Discarding block comment\n");
 	lexerState->disableMacroArgs = true;
 	lexerState->disableInterpolation = true;
+
+	if (canReadBufferDirectly()) {
+		char const *start = &lexerState->ptr[lexerState->offset];
+		char const *end = &lexerState->ptr[lexerState->size];
+		char const *lineStart = start;
+
+		for (char const *ptr = start; ptr != end; ptr++) {
+			switch (*ptr) {
+			case '\r':
+				if (ptr + 1 != end && ptr[1] == '\n')
+					ptr++;
+				/* fallthrough */
+			case '\n':
+				nextLine();
+				lineStart = ptr + 1;
+				break;
+			case '/':
+				if (ptr + 1 != end && ptr[1] == '*')
+					warning(WARNING_NESTED_COMMENT, "/* in block comment\n");
+				break;
+			case '*':
+				if (ptr + 1 != end && ptr[1] == '/') {
+					ptr += 2;
+					shiftBufferedChars(ptr - start);
+					lexerState->colNo += ptr - lineStart;
+					goto finish;
+				}
+			}
+		}
+		/* Reached EOF, let the regular loop below report it */
+		shiftBufferedChars(end - start);
+		lexerState->colNo += end - lineStart;
+	}
+
 	for (;;) {
 		int c = nextChar();
 
@@ -1060,7 +1211,7 @@ static void discardBlockComment(void)
 			handleCRLF(c);
 			/* fallthrough */
 		case '\n':
-			if (!lexerState->expansions)
+			if (!lexerState->nbExpansions)
 				nextLine();
 			continue;
 		case '/':
@@ -1091,6 +1242,22 @@ static void discardComment(void)
 	dbgPrint("Discarding comment\n");
 	lexerState->disableMacroArgs = true;
 	lexerState->disableInterpolation = true;
+
+	if (canReadBufferDirectly()) {
+		char const *ptr = &lexerState->ptr[lexerState->offset];
+		size_t len = lexerState->size - lexerState->offset;
+		char const *lf = memchr(ptr, '\n', len);
+
+		if (lf)
+			len = lf - ptr;
+		char const *cr = memchr(ptr, '\r', len);
+
+		if (cr)
+			len = cr - ptr;
+		shiftBufferedChars(len);
+		lexerState->colNo += len;
+	}
+
 	for (;;) {
 		int c = peek();
 
@@ -1116,7 +1283,7 @@ static void readLineContinuation(void)
 			shiftChar();
 			/* Handle CRLF before nextLine() since shiftChar updates colNo */
 			handleCRLF(c);
-			if (!lexerState->expansions)
+			if (!lexerState->nbExpansions)
 				nextLine();
 			return;
 		} else if (c == ';') {
@@ -1358,6 +1525,37 @@ static int readIdentifier(char firstChar)
 
 /* Functions to read strings */
 
+/*
+ * Interpolating the same symbol with the same format (e.g. in a REPT or macro body) is common,
+ * so formatted values are memoized. Entries are keyed on the symbol, its generation (which
+ * changes when it is redefined), and the format spec's text.
+ */
+#define INTERP_CACHE_SIZE 64
+#define INTERP_FMT_MAXLEN 15
+
+struct InterpolationCacheEntry {
+	struct Symbol const *sym; /* NULL if the entry is unused */
+	uint32_t generation;
+	uint8_t fmtLen;
+	char fmt[INTERP_FMT_MAXLEN];
+	char value[MAXSTRLEN + 1];
+};
+
+static struct InterpolationCacheEntry interpCache[INTERP_CACHE_SIZE];
+
+static struct InterpolationCacheEntry *getInterpCacheEntry(struct Symbol const *sym,
+							   char const *fmt, size_t fmtLen)
+{
+	/* Mix the symbol's address and generation with the format spec, FNV-1a style */
+	uint32_t hash = 2166136261u ^ (uint32_t)((uintptr_t)sym >> 4);
+
+	hash = (hash ^ sym->generation) * 16777619u;
+	for (size_t i = 0; i < fmtLen; i++)
+		hash = (hash ^ (uint8_t)fmt[i]) * 16777619u;
+
+	return &interpCache[hash % INTERP_CACHE_SIZE];
+}
+
 static char const *readInterpolation(size_t depth)
 {
 	if (depth >= maxRecursionDepth)
@@ -1366,6 +1564,8 @@ static char const *readInterpolation(size_t depth)
 	char symName[MAXSYMLEN + 1];
 	size_t i = 0;
 	struct FormatSpec fmt = fmt_NewSpec();
+	char fmtText[INTERP_FMT_MAXLEN];
+	size_t fmtLen = 0;
 	bool disableInterpolation = lexerState->disableInterpolation;
 
 	/*
@@ -1383,7 +1583,7 @@ static char const *readInterpolation(size_t depth)
 			char const *str = readInterpolation(depth + 1);
 
 			if (str && str[0])
-				beginExpansion(str, false, str);
+				beginExpansion(str, false, str, NULL);
 			continue; /* Restart, reading from the new buffer */
 		} else if (c == EOF || c == '\r' || c == '\n' || c == '"') {
 			error("Missing }\n");
@@ -1396,6 +1596,10 @@ static char const *readInterpolation(size_t depth)
 			for (size_t j = 0; j < i; j++)
 				fmt_UseCharacter(&fmt, symName[j]);
 			fmt_FinishCharacters(&fmt);
+			/* Remember the spec's text for the cache; a too-long one will not be cached */
+			fmtLen = i;
+			if (fmtLen <= sizeof(fmtText))
+				memcpy(fmtText, symName, fmtLen);
 			symName[i] = '\0';
 			if (!fmt_IsValid(&fmt))
 				error("Invalid format spec '%s'\n", symName);
@@ -1416,30 +1620,56 @@ static char const *readInterpolation(size_t depth)
 	/* Don't return before `lexerState->disableInterpolation` is reset! */ 
 	lexerState->disableInterpolation = disableInterpolation;
 
-	static char buf[MAXSTRLEN + 1];
+	static char staticBuf[MAXSTRLEN + 1];
+	char *buf = staticBuf;
+	struct InterpolationCacheEntry *entry = NULL;
+	unsigned int nbPrevErrors = nbErrors;
 
 	struct Symbol const *sym = sym_FindScopedSymbol(symName);
 
+	/*
+	 * Only values that are sure not to change without the symbol being redefined can be
+	 * cached, and only if formatting them succeeded (so that errors keep being reported)
+	 */
+	if (sym && !sym->hasCallback && fmtLen <= sizeof(fmtText)
+	 && (fmt_IsEmpty(&fmt) || fmt_IsValid(&fmt))
+	 && (sym->type == SYM_EQUS || (sym_IsNumeric(sym) && sym_IsConstant(sym)))) {
+		entry = getInterpCacheEntry(sym, fmtText, fmtLen);
+		if (entry->sym == sym && entry->generation == sym->generation
+		 && entry->fmtLen == fmtLen && !memcmp(entry->fmt, fmtText, fmtLen))
+			return entry->value;
+
+		buf = entry->value;
+		entry->sym = NULL; /* Invalidate the entry until it's been filled */
+	}
+
 	if (!sym) {
 		error("Interpolated symbol \"%s\" does not exist\n", symName);
+		return NULL;
 	} else if (sym->type == SYM_EQUS) {
 		if (fmt_IsEmpty(&fmt))
 			/* No format was specified */
 			fmt.type = 's';
-		fmt_PrintString(buf, sizeof(buf), &fmt, sym_GetStringValue(sym));
-		return buf;
+		fmt_PrintString(buf, MAXSTRLEN + 1, &fmt, sym_GetStringValue(sym));
 	} else if (sym_IsNumeric(sym)) {
 		if (fmt_IsEmpty(&fmt)) {
 			/* No format was specified; default to uppercase $hex */
 			fmt.type = 'X';
 			fmt.prefix = true;
 		}
-		fmt_PrintNumber(buf, sizeof(buf), &fmt, sym_GetConstantSymValue(sym));
-		return buf;
+		fmt_PrintNumber(buf, MAXSTRLEN + 1, &fmt, sym_GetConstantSymValue(sym));
 	} else {
 		error("Only numerical and string symbols can be interpolated\n");
+		return NULL;
+	}
+
+	if (entry && nbErrors == nbPrevErrors) {
+		entry->sym = sym;
+		entry->generation = sym->generation;
+		entry->fmtLen = fmtLen;
+		memcpy(entry->fmt, fmtText, fmtLen);
 	}
-	return NULL;
+	return buf;
 }
 
 #define append_yylval_string(c) do { \
@@ -1803,9 +2033,10 @@ static int yylex_NORMAL(void)
 
 		case ';':
 			discardComment();
-			/* fallthrough */
+			break;
 		case ' ':
 		case '\t':
+			discardWhitespace();
 			break;
 
 		/* Handle unambiguous single-char tokens */
@@ -1997,14 +2228,14 @@ static int yylex_NORMAL(void)
 				/* Local symbols cannot be string expansions */
 				if (tokenType == T_ID && lexerState->expandStrings) {
 					/* Attempt string expansion */
-					struct Symbol const *sym = sym_FindExactSymbol(yylval.symName);
+					struct Symbol *sym = sym_FindExactSymbol(yylval.symName);
 
 					if (sym && sym->type == SYM_EQUS) {
 						char const *s = sym_GetStringValue(sym);
 
 						assert(s);
 						if (s[0])
-							beginExpansion(s, false, sym->name);
+							beginExpansion(s, false, sym->name, sym);
 						continue; /* Restart, reading from the new buffer */
 					}
 				}
@@ -2036,8 +2267,7 @@ static int yylex_RAW(void)
 	int c;
 
 	/* Trim left whitespace (stops at a block comment or line continuation) */
-	while (isWhitespace(peek()))
-		shiftChar();
+	discardWhitespace();
 
 	for (;;) {
 		c = peek();
@@ -2178,6 +2408,64 @@ finish:
 
 #undef append_yylval_string
 
+/*
+ * Skipping conditional or loop blocks spends most of its time discarding the rest of lines,
+ * so lines are scanned for with `memchr` instead of going through `nextChar` for each
+ * character when possible.
+ * This behaves like calling `nextChar` until the end of line: the character after a backslash
+ * is skipped, so line continuations do not end the line.
+ * Returns false if EOF was reached before the end of the line.
+ */
+static bool skipRestOfLine(void)
+{
+	assert(canReadBufferDirectly());
+	char const *ptr = &lexerState->ptr[lexerState->offset];
+	char const *end = &lexerState->ptr[lexerState->size];
+	char const *lineStart = ptr;
+	bool reachedEOL = false;
+
+	while (ptr != end) {
+		char const *lf = memchr(ptr, '\n', end - ptr);
+		char const *eol = lf ? lf : end;
+		char const *backslash = memchr(ptr, '\\', eol - ptr);
+		char const *cr = memchr(ptr, '\r', (backslash ? backslash : eol) - ptr);
+
+		if (cr) {
+			ptr = cr + 1;
+			if (ptr != end && *ptr == '\n')
+				ptr++;
+			reachedEOL = true;
+			break;
+		} else if (backslash) {
+			/* Unconditionally skip the next char, including line conts */
+			ptr = backslash + 1;
+			if (ptr == end)
+				break;
+			char c = *ptr++;
+
+			if (c == '\r' || c == '\n') {
+				if (c == '\r' && ptr != end && *ptr == '\n')
+					ptr++;
+				nextLine();
+				lineStart = ptr;
+			}
+		} else if (lf) {
+			ptr = lf + 1;
+			reachedEOL = true;
+			break;
+		} else {
+			ptr = end;
+		}
+	}
+
+	shiftBufferedChars(ptr - &lexerState->ptr[lexerState->offset]);
+	if (reachedEOL)
+		nextLine();
+	else
+		lexerState->colNo += ptr - lineStart;
+	return reachedEOL;
+}
+
 /*
  * This function uses the fact that `if`, etc. constructs are only valid when
  * there's nothing before them on their lines. This enables filtering
@@ -2199,14 +2487,8 @@ static int skipIfBlock(bool toEndc)
 
 	for (;;) {
 		if (atLineStart) {
-			int c;
-
-			for (;;) {
-				c = peek();
-				if (!isWhitespace(c))
-					break;
-				shiftChar();
-			}
+			discardWhitespace();
+			int c = peek();
 
 			if (startsIdentifier(c)) {
 				shiftChar();
@@ -2241,6 +2523,14 @@ static int skipIfBlock(bool toEndc)
 		}
 
 		/* Read chars until EOL */
+		if (canReadBufferDirectly()) {
+			if (!skipRestOfLine()) {
+				token = T_EOF;
+				goto finish;
+			}
+			atLineStart = true;
+			continue;
+		}
 		do {
 			int c = nextChar();
 
@@ -2271,6 +2561,150 @@ finish:
 	return token;
 }
 
+/*
+ * Include guards: a file consisting only of an `IF !DEF(sym)` ... `ENDC` block does nothing
+ * when included while `sym` is defined, which lets the file stack skip it entirely.
+ * The file is scanned the same way `skipIfBlock` would skip it, so keep both in sync!
+ */
+
+static char const *skipSpaces(char const *ptr, char const *end)
+{
+	while (ptr != end && isWhitespace(*ptr))
+		ptr++;
+	return ptr;
+}
+
+/* Skips whitespace, comments and EOLs, which do nothing outside of IF blocks */
+static char const *skipBlankLines(char const *ptr, char const *end)
+{
+	for (;;) {
+		ptr = skipSpaces(ptr, end);
+		if (ptr != end && *ptr == ';') {
+			while (ptr != end && *ptr != '\r' && *ptr != '\n')
+				ptr++;
+		}
+		if (ptr == end || (*ptr != '\r' && *ptr != '\n'))
+			return ptr;
+		ptr++;
+	}
+}
+
+/* Returns the token for the identifier at `*ptr`, or 0 if it's too long to be lexed as-is */
+static int scanIdentifier(char const **ptr, char const *end)
+{
+	char const *start = *ptr;
+	uint16_t nodeID = 0;
+	int tokenType = T_ID;
+
+	for (; *ptr != end && continuesIdentifier(**ptr); (*ptr)++) {
+		if (**ptr == '.')
+			tokenType = T_LOCAL_ID;
+		if (nodeID || *ptr == start)
+			nodeID = keywordDict[nodeID].children[dictIndex(**ptr)];
+	}
+
+	if (*ptr - start > MAXSYMLEN)
+		return 0;
+	if (nodeID && keywordDict[nodeID].keyword)
+		return keywordDict[nodeID].keyword->token;
+	return tokenType;
+}
+
+char *lexer_FindIncludeGuard(struct LexerState const *state)
+{
+	if (!state->isFile || !state->isMmapped)
+		return NULL;
+
+	char const *ptr = state->ptr;
+	char const *end = &state->ptr[state->size];
+
+	/* The file must begin with `IF !DEF(sym)`... */
+	ptr = skipBlankLines(ptr, end);
+	if (ptr == end || !startsIdentifier(*ptr) || scanIdentifier(&ptr, end) != T_POP_IF)
+		return NULL;
+	ptr = skipSpaces(ptr, end);
+	if (ptr == end || *ptr++ != '!')
+		return NULL;
+	ptr = skipSpaces(ptr, end);
+	if (ptr == end || !startsIdentifier(*ptr) || scanIdentifier(&ptr, end) != T_OP_DEF)
+		return NULL;
+	ptr = skipSpaces(ptr, end);
+	if (ptr == end || *ptr++ != '(')
+		return NULL;
+	ptr = skipSpaces(ptr, end);
+
+	char const *symName = ptr;
+
+	if (ptr == end || !startsIdentifier(*ptr) || scanIdentifier(&ptr, end) != T_ID)
+		return NULL;
+
+	size_t symNameLen = ptr - symName;
+
+	ptr = skipSpaces(ptr, end);
+	if (ptr == end || *ptr++ != ')')
+		return NULL;
+	ptr = skipSpaces(ptr, end);
+	if (ptr != end && *ptr == ';') {
+		while (ptr != end && *ptr != '\r' && *ptr != '\n')
+			ptr++;
+	}
+	if (ptr == end || (*ptr != '\r' && *ptr != '\n'))
+		return NULL;
+	ptr += *ptr == '\r' && ptr + 1 != end && ptr[1] == '\n' ? 2 : 1;
+
+	/* ...whose matching ENDC (without an ELIF or ELSE) must be the last thing in it */
+	uint32_t depth = 0;
+
+	for (;;) {
+		ptr = skipSpaces(ptr, end);
+		if (ptr != end && startsIdentifier(*ptr)) {
+			switch (scanIdentifier(&ptr, end)) {
+			case 0:
+				return NULL;
+
+			case T_POP_IF:
+				depth++;
+				break;
+
+			case T_POP_ELIF:
+			case T_POP_ELSE:
+				if (depth == 0)
+					return NULL;
+				break;
+
+			case T_POP_ENDC:
+				if (depth == 0)
+					goto foundEndc;
+				depth--;
+				break;
+			}
+		}
+
+		while (ptr != end && *ptr != '\r' && *ptr != '\n') {
+			if (*ptr++ == '\\' && ptr != end) {
+				/* Unconditionally skip the next char, including line conts */
+				if (*ptr == '\r' && ptr + 1 != end && ptr[1] == '\n')
+					ptr++;
+				ptr++;
+			}
+		}
+		if (ptr == end)
+			return NULL;
+		ptr += *ptr == '\r' && ptr + 1 != end && ptr[1] == '\n' ? 2 : 1;
+	}
+foundEndc:
+	if (skipBlankLines(ptr, end) != end)
+		return NULL;
+
+	char *guard = malloc(symNameLen + 1);
+
+	if (!guard)
+		return NULL;
+	memcpy(guard, symName, symNameLen);
+	guard[symNameLen] = '\0';
+	return guard;
+}
+
 static int yylex_SKIP_TO_ELIF(void)
 {
 	return skipIfBlock(false);
@@ -2294,14 +2728,8 @@ static int yylex_SKIP_TO_ENDR(void)
 
 	for (;;) {
 		if (atLineStart) {
-			int c;
-
-			for (;;) {
-				c = peek();
-				if (!isWhitespace(c))
-					break;
-				shiftChar();
-			}
+			discardWhitespace();
+			int c = peek();
 
 			if (startsIdentifier(c)) {
 				shiftChar();
@@ -2329,6 +2757,12 @@ static int yylex_SKIP_TO_ENDR(void)
 		}
 
 		/* Read chars until EOL */
+		if (canReadBufferDirectly()) {
+			if (!skipRestOfLine())
+				goto finish;
+			atLineStart = true;
+			continue;
+		}
 		do {
 			int c = nextChar();
 
@@ -2374,7 +2808,7 @@ int yylex(void)
 	}
 	if (lexerState->atLineStart) {
 		/* Newlines read within an expansion should not increase the line count */
-		if (!lexerState->expansions)
+		if (!lexerState->nbExpansions)
 			nextLine();
 	}
 
@@ -2409,7 +2843,7 @@ static void startCapture(struct CaptureBody *capture)
 
 	capture->lineNo = lexer_GetLineNo();
 
-	if (lexerState->isMmapped && !lexerState->expansions) {
+	if (lexerState->isMmapped && !lexerState->nbExpansions) {
 		capture->body = &lexerState->ptr[lexerState->offset];
 	} else {
 		lexerState->captureCapacity = 128; /* The initial size will be twice that */
@@ -2500,10 +2934,6 @@ bool lexer_CaptureMacroBody(struct CaptureBody *capture)
 {
 	startCapture(capture);
 
-	/* If the file is `mmap`ed, we need not to unmap it to keep access to the macro */
-	if (lexerState->isMmapped)
-		lexerState->isReferenced = true;
-
 	int c = EOF;
 
 	/*
@@ -160,12 +160,28 @@ void macro_SetUniqueID(uint32_t id)
 	}
 }
 
+uint32_t macro_GetMaxUniqueID(void)
+{
+	return maxUniqueID;
+}
+
 uint32_t macro_UseNewUniqueID(void)
 {
 	macro_SetUniqueID(++maxUniqueID);
 	return maxUniqueID;
 }
 
+/*
+ * Start over from the first unique ID, for the next file assembled in batch mode
+ * The args are owned by file stack contexts, so they are not freed here
+ */
+void macro_Reset(void)
+{
+	macroArgs = NULL;
+	maxUniqueID = 0;
+	macro_SetUniqueID(0);
+}
+
 void macro_ShiftCurrentArgs(int32_t count)
 {
 	if (!macroArgs) {
@@ -25,7 +25,9 @@
 #include "asm/main.h"
 #include "asm/opt.h"
 #include "asm/output.h"
+#include "asm/pch.h"
 #include "asm/rpn.h"
+#include "asm/section.h"
 #include "asm/symbol.h"
 #include "asm/warning.h"
 #include "parser.h"
@@ -34,6 +36,8 @@
 #include "extern/getopt.h"
 
 #include "helpers.h"
+#include "jobs.h"
+#include "platform.h" // HAVE_FORK
 #include "version.h"
 
 #ifdef __clang__
@@ -60,6 +64,7 @@ FILE * dependfile;
 bool generatedMissingIncludes;
 bool failedOnMissingInclude;
 bool generatePhonyDeps;
+enum DependFormat dependFormat;
 char *targetFileName;
 
 bool haltnop;
@@ -88,10 +93,19 @@ static char *make_escape(const char *str)
 }
 
 /* Short options */
-static const char *optstring = "b:D:Eg:hi:LM:o:p:r:VvW:w";
+static const char *optstring = "B:b:D:Eg:hi:j:LM:o:p:r:VvW:w";
 
 /* Variables for the long-only options */
-static int depType; /* Variants of `-M` */
+static int depType; /* Variants of `-M`, and the precompiled header options */
+static char const *emitPchName;
+static char const *usePchName;
+
+/* Symbols defined with `-D`, which are defined again for every file in batch mode */
+static struct {
+	char const *name;
+	char const *value;
+} *defines;
+static size_t nbDefines;
 
 /*
  * Equivalent long options
@@ -104,13 +118,17 @@ static int depType; /* Variants of `-M` */
  * over short opt matching
  */
 static struct option const longopts[] = {
+	{ "batch",            required_argument, NULL,     'B' },
 	{ "binary-digits",    required_argument, NULL,     'b' },
 	{ "define",           required_argument, NULL,     'D' },
 	{ "export-all",       no_argument,       NULL,     'E' },
 	{ "gfx-chars",        required_argument, NULL,     'g' },
 	{ "halt-without-nop", no_argument,       NULL,     'h' },
 	{ "include",          required_argument, NULL,     'i' },
+	{ "jobs",             required_argument, NULL,     'j' },
 	{ "preserve-ld",      no_argument,       NULL,     'L' },
+	{ "emit-pch",         required_argument, &depType, 'e' },
+	{ "dep-format",       required_argument, &depType, 'F' },
 	{ "dependfile",       required_argument, NULL,     'M' },
 	{ "MG",               no_argument,       &depType, 'G' },
 	{ "MP",               no_argument,       &depType, 'P' },
@@ -119,6 +137,7 @@ static struct option const longopts[] = {
 	{ "output",           required_argument, NULL,     'o' },
 	{ "pad-value",        required_argument, NULL,     'p' },
 	{ "recursion-depth",  required_argument, NULL,     'r' },
+	{ "use-pch",          required_argument, &depType, 'u' },
 	{ "version",          no_argument,       NULL,     'V' },
 	{ "verbose",          no_argument,       NULL,     'v' },
 	{ "warning",          required_argument, NULL,     'W' },
@@ -130,8 +149,13 @@ static void print_usage(void)
 	fputs(
 "Usage: rgbasm [-EhLVvw] [-b chars] [-D name[=value]] [-g chars] [-i path]\n"
 "              [-M depend_file] [-MG] [-MP] [-MT target_file] [-MQ target_file]\n"
-"              [-o out_file] [-p pad_value] [-r depth] [-W warning] <file>\n"
+"              [--dep-format make|ninja] [-o out_file] [-p pad_value]\n"
+"              [-r depth] [-W warning]\n"
+"              [--emit-pch pch_file | --use-pch pch_file] <file>\n"
+"       rgbasm -B manifest [-j jobs] [options]\n"
 "Useful options:\n"
+"    -B, --batch <manifest>   assemble the files listed in the manifest\n"
+"    -j, --jobs <count>       assemble this many files at once with -B\n"
 "    -E, --export-all         export all labels\n"
 "    -M, --dependfile <path>  set the output dependency file\n"
 "    -o, --output <path>      set the output object file\n"
@@ -144,6 +168,248 @@ static void print_usage(void)
 	exit(1);
 }
 
+/*
+ * Write the dependencies collected so far, if a dependency file is open
+ * Also runs at exit, so that a fatal error leaves the dependencies found until then
+ */
+static void writeDependFile(void)
+{
+	if (!dependfile)
+		return;
+	fstk_WriteDeps();
+	fclose(dependfile);
+	dependfile = NULL;
+}
+
+/*
+ * Assemble one file, using the object and dependency files currently set
+ * Returns false if any errors occurred, in which case no object file is written
+ */
+static bool assembleFile(char const *mainFileName, time_t now, uint32_t maxDepth)
+{
+	nbErrors = 0;
+	failedOnMissingInclude = false;
+
+	// Perform some init for below
+	sym_Init(now);
+	for (size_t i = 0; i < nbDefines; i++)
+		sym_AddString(defines[i].name, defines[i].value);
+
+	if (verbose)
+		printf("Assembling %s\n", mainFileName);
+
+	if (dependfile) {
+		if (!targetFileName)
+			errx(1, "Dependency files can only be created if a target file is specified with either -o, -MQ or -MT\n");
+
+		fstk_AddDep(mainFileName);
+	}
+
+	charmap_New("main", NULL);
+
+	bool includePrelude = usePchName && !pch_Apply();
+
+	if (emitPchName)
+		pch_StartEmit();
+
+	// Init file stack, prodiving file info
+	fstk_Init(mainFileName, maxDepth);
+	if (includePrelude)
+		fstk_RunInclude(pch_GetPreludeName());
+
+	// Perform parse (yyparse is auto-generated from `parser.y`)
+	if (yyparse() != 0 && nbErrors == 0)
+		nbErrors = 1;
+
+	writeDependFile();
+
+	sect_CheckUnionClosed();
+
+	if (nbErrors != 0)
+		return false;
+
+	// If parse aborted due to missing an include, and `-MG` was given, exit normally
+	if (failedOnMissingInclude)
+		return true;
+
+	/* The prelude is only assembled for its symbols, so it needs no object file */
+	if (emitPchName)
+		return pch_Write(emitPchName);
+
+	/* If no path specified, don't write file */
+	if (objectName != NULL)
+		out_WriteObject();
+	return true;
+}
+
+/*
+ * Forget everything about the file just assembled, keeping the command-line settings
+ */
+static void resetAssembler(void)
+{
+	fstk_Reset();
+	out_Reset();
+	sect_Reset();
+	sym_Reset();
+	charmap_Reset();
+	opt_Reset();
+}
+
+struct BatchEntry {
+	char const *mainFileName;
+	char *outName;
+	char const *depName; /* NULL if no dependency file is to be written */
+};
+
+/*
+ * Read the manifest, each of whose lines is `<file> <out_file> [<depend_file>]`
+ * Blank lines and lines starting with `#` are ignored
+ * The manifest is kept in memory, since the entries point into it
+ */
+static struct BatchEntry *readManifest(char const *name, uint32_t *nbEntries)
+{
+	FILE *file = strcmp(name, "-") ? fopen(name, "rb") : stdin;
+	size_t size = 0, capacity = 4096;
+	char *contents = malloc(capacity);
+	size_t nbRead;
+
+	if (!file)
+		err(1, "Failed to open manifest \"%s\"", name);
+	if (!contents)
+		err(1, "Failed to allocate manifest");
+	while ((nbRead = fread(&contents[size], 1, capacity - size - 1, file)) != 0) {
+		size += nbRead;
+		if (size == capacity - 1) {
+			capacity *= 2;
+			contents = realloc(contents, capacity);
+			if (!contents)
+				err(1, "Failed to allocate manifest");
+		}
+	}
+	if (ferror(file))
+		err(1, "Failed to read manifest \"%s\"", name);
+	if (file != stdin)
+		fclose(file);
+	contents[size] = '\0';
+
+	struct BatchEntry *entries = NULL;
+	uint32_t nbAlloced = 0;
+	unsigned int lineNo = 0;
+	char *line = contents;
+
+	*nbEntries = 0;
+	while (*line) {
+		char *end = strchr(line, '\n');
+
+		if (end)
+			*end++ = '\0';
+		else
+			end = &line[strlen(line)];
+		lineNo++;
+
+		char *words[4];
+		unsigned int nbWords = 0;
+
+		for (char *word = strtok(line, " \t\r"); word; word = strtok(NULL, " \t\r")) {
+			if (nbWords == 0 && word[0] == '#')
+				break;
+			if (nbWords == sizeof(words) / sizeof(*words))
+				break;
+			words[nbWords++] = word;
+		}
+
+		if (nbWords == 1 || nbWords > 3) {
+			errx(1, "%s(%u): Batch entry must be of the form <file> <out_file> [<depend_file>]",
+			     name, lineNo);
+		} else if (nbWords != 0) {
+			if (*nbEntries == nbAlloced) {
+				nbAlloced = nbAlloced ? nbAlloced * 2 : 64;
+				entries = realloc(entries, sizeof(*entries) * nbAlloced);
+				if (!entries)
+					err(1, "Failed to allocate batch entries");
+			}
+
+			struct BatchEntry *entry = &entries[(*nbEntries)++];
+
+			entry->mainFileName = words[0];
+			entry->outName = words[1];
+			entry->depName = nbWords == 3 ? words[2] : NULL;
+		}
+		line = end;
+	}
+	if (*nbEntries == 0)
+		errx(1, "Manifest \"%s\" lists no files to assemble", name);
+	return entries;
+}
+
+/*
+ * Assemble a batch entry, after forgetting about the previous one if any
+ */
+static bool assembleEntry(struct BatchEntry *entry, time_t now, uint32_t maxDepth)
+{
+	static bool firstEntry = true;
+
+	if (entry->depName) {
+		dependfile = fopen(entry->depName, "w");
+		if (dependfile == NULL)
+			err(1, "Could not open dependfile %s", entry->depName);
+	}
+
+	if (!firstEntry)
+		resetAssembler();
+	firstEntry = false;
+	out_SetFileName(entry->outName);
+	targetFileName = entry->outName;
+
+	if (!assembleFile(entry->mainFileName, now, maxDepth)) {
+		fprintf(stderr, "error: %s: Assembly aborted (%u error%s)!\n", entry->mainFileName,
+			nbErrors, nbErrors == 1 ? "" : "s");
+		return false;
+	}
+	return true;
+}
+
+/* What each batch entry needs to be assembled, for `jobs_Run` */
+struct BatchContext {
+	struct BatchEntry *entries;
+	time_t now;
+	uint32_t maxDepth;
+};
+
+/*
+ * Assemble an entry of the batch; the lexer and parser keep their state in globals,
+ * so with several jobs each worker gets its own process
+ */
+static bool assembleBatchEntry(uint32_t entryID, void *arg)
+{
+	struct BatchContext const *context = arg;
+
+	return assembleEntry(&context->entries[entryID], context->now, context->maxDepth);
+}
+
+/*
+ * Assemble each file listed in the manifest
+ * Errors in one file do not prevent assembling the next ones
+ */
+static int assembleBatch(char const *manifestName, unsigned int nbJobs, time_t now,
+			 uint32_t maxDepth)
+{
+	uint32_t nbEntries;
+	struct BatchEntry *entries = readManifest(manifestName, &nbEntries);
+	struct BatchContext context = { .entries = entries, .now = now, .maxDepth = maxDepth };
+
+	opt_SaveDefaults();
+#if !HAVE_FORK
+	if (nbJobs > 1)
+		warnx("-j is not supported on this platform, assembling one file at a time");
+#endif
+	uint32_t nbFailed = jobs_Run(nbEntries, nbJobs, assembleBatchEntry, &context);
+
+	if (nbFailed != 0)
+		errx(1, "%" PRIu32 " of %" PRIu32 " files failed to assemble", nbFailed, nbEntries);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	int ch;
@@ -160,17 +426,16 @@ int main(int argc, char *argv[])
 		now = (time_t)strtoul(sourceDateEpoch, NULL, 0);
 
 	dependfile = NULL;
+	atexit(writeDependFile);
 
 #if defined(YYDEBUG) && YYDEBUG
 	yydebug = 1;
 #endif
 
-	// Perform some init for below
-	sym_Init(now);
-
 	// Set defaults
 
 	generatePhonyDeps = false;
+	dependFormat = DEPFORMAT_MAKE;
 	generatedMissingIncludes = false;
 	failedOnMissingInclude = false;
 	targetFileName = NULL;
@@ -185,9 +450,15 @@ int main(int argc, char *argv[])
 	sym_SetExportAll(false);
 	uint32_t maxDepth = 64;
 	size_t targetFileNameLen = 0;
+	char const *manifestName = NULL;
+	unsigned long nbJobs = 0; /* 0 if -j was not given */
 
 	while ((ch = musl_getopt_long_only(argc, argv, optstring, longopts, NULL)) != -1) {
 		switch (ch) {
+		case 'B':
+			manifestName = musl_optarg;
+			break;
+
 		case 'b':
 			if (strlen(musl_optarg) == 2)
 				opt_B(&musl_optarg[1]);
@@ -197,13 +468,17 @@ int main(int argc, char *argv[])
 
 			char *equals;
 		case 'D':
+			defines = realloc(defines, sizeof(*defines) * (nbDefines + 1));
+			if (!defines)
+				err(1, "Failed to allocate memory for -D");
 			equals = strchr(musl_optarg, '=');
 			if (equals) {
 				*equals = '\0';
-				sym_AddString(musl_optarg, equals + 1);
+				defines[nbDefines].value = equals + 1;
 			} else {
-				sym_AddString(musl_optarg, "1");
+				defines[nbDefines].value = "1";
 			}
+			defines[nbDefines++].name = musl_optarg;
 			break;
 
 		case 'E':
@@ -225,6 +500,16 @@ int main(int argc, char *argv[])
 			fstk_AddIncludePath(musl_optarg);
 			break;
 
+		case 'j':
+			nbJobs = strtoul(musl_optarg, &ep, 0);
+
+			if (musl_optarg[0] == '\0' || *ep != '\0')
+				errx(1, "Invalid argument for option 'j'");
+
+			if (nbJobs == 0 || nbJobs > JOBS_MAX)
+				errx(1, "Argument for option 'j' must be between 1 and %d", JOBS_MAX);
+			break;
+
 		case 'L':
 			optimizeLoads = false;
 			break;
@@ -280,6 +565,23 @@ int main(int argc, char *argv[])
 		/* Long-only options */
 		case 0:
 			switch (depType) {
+			case 'e':
+				emitPchName = musl_optarg;
+				break;
+
+			case 'u':
+				usePchName = musl_optarg;
+				break;
+
+			case 'F':
+				if (!strcmp(musl_optarg, "make"))
+					dependFormat = DEPFORMAT_MAKE;
+				else if (!strcmp(musl_optarg, "ninja"))
+					dependFormat = DEPFORMAT_NINJA;
+				else
+					errx(1, "Dependency file format must be \"make\" or \"ninja\"");
+				break;
+
 			case 'G':
 				generatedMissingIncludes = true;
 				break;
@@ -326,54 +628,47 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (targetFileName == NULL)
-		targetFileName = objectName;
+	// Init lexer keyword tables, which are shared by all files
+	lexer_Init();
 
-	if (argc == musl_optind) {
-		fputs("FATAL: No input files\n", stderr);
+	if (manifestName && argc != musl_optind) {
+		fputs("FATAL: Input files cannot be given with -B, list them in the manifest\n",
+		      stderr);
 		print_usage();
-	} else if (argc != musl_optind + 1) {
-		fputs("FATAL: More than one input file given\n", stderr);
+	}
+	if (!manifestName && argc == musl_optind) {
+		fputs("FATAL: No input files\n", stderr);
 		print_usage();
 	}
 
-	char const *mainFileName = argv[musl_optind];
-
-	if (verbose)
-		printf("Assembling %s\n", mainFileName);
-
-	if (dependfile) {
-		if (!targetFileName)
-			errx(1, "Dependency files can only be created if a target file is specified with either -o, -MQ or -MT\n");
-
-		fprintf(dependfile, "%s: %s\n", targetFileName, mainFileName);
+	if (emitPchName && usePchName)
+		errx(1, "--emit-pch and --use-pch cannot be used together");
+	// The precompiled header is only read once, even when assembling several files
+	if (usePchName)
+		pch_Load(usePchName);
+
+	if (manifestName) {
+		if (emitPchName)
+			errx(1, "--emit-pch cannot be used with -B");
+		if (dependfile || targetFileName)
+			errx(1, "-M, -MT and -MQ cannot be used with -B; give a dependency file per entry instead");
+		if (objectName)
+			errx(1, "-o cannot be used with -B; give an output file per entry instead");
+		return assembleBatch(manifestName, nbJobs ? nbJobs : 1, now, maxDepth);
 	}
+	if (nbJobs)
+		errx(1, "-j can only be used with -B");
 
-	charmap_New("main", NULL);
-
-	// Init lexer and file stack, prodiving file info
-	lexer_Init();
-	fstk_Init(mainFileName, maxDepth);
-
-	// Perform parse (yyparse is auto-generated from `parser.y`)
-	if (yyparse() != 0 && nbErrors == 0)
-		nbErrors = 1;
-
-	if (dependfile)
-		fclose(dependfile);
+	if (targetFileName == NULL)
+		targetFileName = objectName;
 
-	sect_CheckUnionClosed();
+	if (argc != musl_optind + 1) {
+		fputs("FATAL: More than one input file given\n", stderr);
+		print_usage();
+	}
 
-	if (nbErrors != 0)
+	if (!assembleFile(argv[musl_optind], now, maxDepth))
 		errx(1, "Assembly aborted (%u error%s)!", nbErrors,
 			nbErrors == 1 ? "" : "s");
-
-	// If parse aborted due to missing an include, and `-MG` was given, exit normally
-	if (failedOnMissingInclude)
-		return 0;
-
-	/* If no path specified, don't write file */
-	if (objectName != NULL)
-		out_WriteObject();
 	return 0;
 }
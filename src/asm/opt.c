@@ -22,6 +22,7 @@ struct OptStackEntry {
 };
 
 static struct OptStackEntry *stack = NULL;
+static struct OptStackEntry defaults;
 
 void opt_B(char chars[2])
 {
@@ -134,13 +135,8 @@ void opt_Parse(char *s)
 	}
 }
 
-void opt_Push(void)
+static void saveOptions(struct OptStackEntry *entry)
 {
-	struct OptStackEntry *entry = malloc(sizeof(*entry));
-
-	if (entry == NULL)
-		fatalerror("Failed to alloc option stack entry: %s\n", strerror(errno));
-
 	// Both of these pulled from lexer.h
 	entry->binary[0] = binDigits[0];
 	entry->binary[1] = binDigits[1];
@@ -159,6 +155,29 @@ void opt_Push(void)
 	// Both of these pulled from warning.h
 	entry->warningsAreErrors = warningsAreErrors;
 	memcpy(entry->warningStates, warningStates, sizeof(warningStates));
+}
+
+static void restoreOptions(struct OptStackEntry *entry)
+{
+	opt_B(entry->binary);
+	opt_G(entry->gbgfx);
+	opt_P(entry->fillByte);
+	opt_h(entry->haltnop);
+	opt_L(entry->optimizeLoads);
+
+	// opt_W does not apply a whole warning state; it processes one flag string
+	warningsAreErrors = entry->warningsAreErrors;
+	memcpy(warningStates, entry->warningStates, sizeof(warningStates));
+}
+
+void opt_Push(void)
+{
+	struct OptStackEntry *entry = malloc(sizeof(*entry));
+
+	if (entry == NULL)
+		fatalerror("Failed to alloc option stack entry: %s\n", strerror(errno));
+
+	saveOptions(entry);
 
 	entry->next = stack;
 	stack = entry;
@@ -173,16 +192,30 @@ void opt_Pop(void)
 
 	struct OptStackEntry *entry = stack;
 
-	opt_B(entry->binary);
-	opt_G(entry->gbgfx);
-	opt_P(entry->fillByte);
-	opt_h(entry->haltnop);
-	opt_L(entry->optimizeLoads);
-
-	// opt_W does not apply a whole warning state; it processes one flag string
-	warningsAreErrors = entry->warningsAreErrors;
-	memcpy(warningStates, entry->warningStates, sizeof(warningStates));
+	restoreOptions(entry);
 
 	stack = entry->next;
 	free(entry);
 }
+
+/*
+ * Remember the options set on the command line, which `opt_Reset` goes back to
+ */
+void opt_SaveDefaults(void)
+{
+	saveOptions(&defaults);
+}
+
+/*
+ * Undo the effects of `OPT` and drop the option stack, for the next file in batch mode
+ */
+void opt_Reset(void)
+{
+	while (stack) {
+		struct OptStackEntry *next = stack->next;
+
+		free(stack);
+		stack = next;
+	}
+	restoreOptions(&defaults);
+}
@@ -241,19 +241,18 @@ static void writesection(struct Section const *sect, FILE *f)
 	}
 }
 
-static void freesection(struct Section const *sect)
+static void freesection(struct Section *sect)
 {
-	if (sect_HasData(sect->type)) {
-		struct Patch *patch = sect->patches;
+	struct Patch *patch = sect->patches;
 
-		while (patch != NULL) {
-			struct Patch *next = patch->next;
+	while (patch != NULL) {
+		struct Patch *next = patch->next;
 
-			free(patch->rpn);
-			free(patch);
-			patch = next;
-		}
+		free(patch->rpn);
+		free(patch);
+		patch = next;
 	}
+	sect->patches = NULL;
 }
 
 /*
@@ -297,7 +296,7 @@ static uint32_t getSymbolID(struct Symbol *sym)
 	return sym->ID;
 }
 
-static void writerpn(uint8_t *rpnexpr, uint32_t *rpnptr, uint8_t *rpn,
+static void writerpn(uint8_t *rpnexpr, uint32_t *rpnptr, uint8_t const *rpn,
 		     uint32_t rpnlen)
 {
 	char symName[512];
@@ -429,7 +428,7 @@ static struct Patch *allocpatch(uint32_t type, struct Expression const *expr, ui
 		patch->rpn[4] = (uint32_t)(expr->val) >> 24;
 	} else {
 		patch->rpnSize = 0;
-		writerpn(patch->rpn, &patch->rpnSize, expr->rpn, expr->rpnLength);
+		writerpn(patch->rpn, &patch->rpnSize, rpn_GetBytes(expr), expr->rpnLength);
 	}
 	assert(patch->rpnSize == rpnSize);
 
@@ -486,6 +485,7 @@ static void freeassert(struct Assertion *assert)
 {
 	free(assert->patch->rpn);
 	free(assert->patch);
+	free(assert->message);
 	free(assert);
 }
 
@@ -551,23 +551,37 @@ void out_WriteObject(void)
 	for (struct Symbol const *sym = objectSymbols; sym; sym = sym->next)
 		writesymbol(sym, f);
 
-	for (struct Section *sect = sectionList; sect; sect = sect->next) {
+	for (struct Section *sect = sectionList; sect; sect = sect->next)
 		writesection(sect, f);
-		freesection(sect);
-	}
 
 	putlong(countAsserts(), f);
-	struct Assertion *assert = assertions;
+	for (struct Assertion *assert = assertions; assert; assert = assert->next)
+		writeassert(assert, f);
+
+	fclose(f);
+}
+
+/*
+ * Free the patches and assertions of the file just assembled, and forget its
+ * symbols and file stack nodes, so the next file in batch mode starts afresh
+ * The symbols and nodes themselves are owned by their respective modules
+ */
+void out_Reset(void)
+{
+	for (struct Section *sect = sectionList; sect; sect = sect->next)
+		freesection(sect);
 
-	while (assert != NULL) {
-		struct Assertion *next = assert->next;
+	while (assertions) {
+		struct Assertion *next = assertions->next;
 
-		writeassert(assert, f);
-		freeassert(assert);
-		assert = next;
+		freeassert(assertions);
+		assertions = next;
 	}
 
-	fclose(f);
+	objectSymbols = NULL;
+	objectSymbolsTail = &objectSymbols;
+	nbSymbols = 0;
+	fileStackNodes = NULL;
 }
 
 /*
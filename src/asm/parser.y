@@ -686,6 +686,7 @@ line		: plain_directive endofline
 		| line_directive /* Directives that manage newlines themselves */
 		/* Continue parsing the next line on a syntax error */
 		| error {
+			sect_EndDataList(); // Values before the error were valid
 			lexer_SetMode(LEXER_NORMAL);
 			lexer_ToggleStringExpansion(true);
 		} endofline {
@@ -694,6 +695,7 @@ line		: plain_directive endofline
 		}
 		/* Hint about unindented macros parsed as labels */
 		| T_LABEL error {
+			sect_EndDataList();
 			lexer_SetMode(LEXER_NORMAL);
 			lexer_ToggleStringExpansion(true);
 		} endofline {
@@ -1121,15 +1123,15 @@ ds_args		: reloc_8bit {
 ;
 
 db		: T_POP_DB { sect_Skip(1, false); }
-		| T_POP_DB constlist_8bit trailing_comma
+		| T_POP_DB constlist_8bit trailing_comma { sect_EndDataList(); }
 ;
 
 dw		: T_POP_DW { sect_Skip(2, false); }
-		| T_POP_DW constlist_16bit trailing_comma
+		| T_POP_DW constlist_16bit trailing_comma { sect_EndDataList(); }
 ;
 
 dl		: T_POP_DL { sect_Skip(4, false); }
-		| T_POP_DL constlist_32bit trailing_comma
+		| T_POP_DL constlist_32bit trailing_comma { sect_EndDataList(); }
 ;
 
 def_equ		: def_id T_POP_EQU const {
@@ -1306,13 +1308,13 @@ constlist_8bit	: constlist_8bit_entry
 ;
 
 constlist_8bit_entry : reloc_8bit_no_str {
-			sect_RelByte(&$1, 0);
+			sect_DataValue(&$1, 1);
 		}
 		| string {
 			uint8_t *output = malloc(strlen($1)); /* Cannot be larger than that */
 			int32_t length = charmap_Convert($1, output);
 
-			sect_AbsByteGroup(output, length);
+			sect_DataString(output, length, 1);
 			free(output);
 		}
 ;
@@ -1322,13 +1324,13 @@ constlist_16bit : constlist_16bit_entry
 ;
 
 constlist_16bit_entry : reloc_16bit_no_str {
-			sect_RelWord(&$1, 0);
+			sect_DataValue(&$1, 2);
 		}
 		| string {
 			uint8_t *output = malloc(strlen($1)); /* Cannot be larger than that */
 			int32_t length = charmap_Convert($1, output);
 
-			sect_AbsWordGroup(output, length);
+			sect_DataString(output, length, 2);
 			free(output);
 		}
 ;
@@ -1338,14 +1340,14 @@ constlist_32bit : constlist_32bit_entry
 ;
 
 constlist_32bit_entry : relocexpr_no_str {
-			sect_RelLong(&$1, 0);
+			sect_DataValue(&$1, 4);
 		}
 		| string {
 			// Charmaps cannot increase the length of a string
 			uint8_t *output = malloc(strlen($1));
 			int32_t length = charmap_Convert($1, output);
 
-			sect_AbsLongGroup(output, length);
+			sect_DataString(output, length, 4);
 			free(output);
 		}
 ;
@@ -0,0 +1,735 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Precompiled headers save the symbols, charmaps and options defined by a prelude file,
+ * so that files which all start by including it need not assemble it again
+ */
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "asm/charmap.h"
+#include "asm/fstack.h"
+#include "asm/lexer.h"
+#include "asm/macro.h"
+#include "asm/main.h"
+#include "asm/output.h"
+#include "asm/pch.h"
+#include "asm/section.h"
+#include "asm/symbol.h"
+#include "asm/warning.h"
+
+#include "extern/err.h"
+
+#include "hashmap.h"
+#include "platform.h" // strdup
+#include "version.h"
+
+#define PCH_MAGIC "RGBPCH"
+#define PCH_VERSION 1
+
+struct OptionState {
+	char binDigits[2];
+	char gfxDigits[4];
+	uint8_t fillByte;
+	bool haltnop;
+	bool optimizeLoads;
+	bool warningsAreErrors;
+	enum WarningState warningStates[NB_WARNINGS];
+};
+
+/* Only the options changed by the prelude are saved, so the others can differ between runs */
+enum ChangedOption {
+	CHANGED_BIN_DIGITS = 1 << 0,
+	CHANGED_GFX_DIGITS = 1 << 1,
+	CHANGED_FILL_BYTE  = 1 << 2,
+	CHANGED_HALTNOP    = 1 << 3,
+	CHANGED_OPT_LOADS  = 1 << 4,
+	CHANGED_WERROR     = 1 << 5,
+};
+#define WARNING_UNCHANGED 0xFF
+
+struct Define {
+	char *name;
+	char *value;
+};
+
+/* State remembered while assembling the prelude */
+static bool emitting;
+static struct OptionState startOptions;
+static struct Define *startDefines;
+static uint32_t nbStartDefines;
+static HashMap dependencies; /* Only used to list each file once */
+static char **depPaths;
+static uint32_t nbDeps;
+
+/* The loaded precompiled header, which lives as long as the program */
+static char const *pchFileName;
+static uint8_t *pchData;
+static uint8_t *pchEnd;
+static uint8_t *readPtr;
+static char const *preludeName;
+static bool isUpToDate;
+static uint8_t *pchDeps;
+static uint32_t nbPchDeps;
+static uint8_t *pchState; /* Where the state to restore begins */
+
+static void saveOptionState(struct OptionState *state)
+{
+	memcpy(state->binDigits, binDigits, sizeof(state->binDigits));
+	memcpy(state->gfxDigits, gfxDigits, sizeof(state->gfxDigits));
+	state->fillByte = fillByte;
+	state->haltnop = haltnop;
+	state->optimizeLoads = optimizeLoads;
+	state->warningsAreErrors = warningsAreErrors;
+	memcpy(state->warningStates, warningStates, sizeof(state->warningStates));
+}
+
+static void saveDefine(struct Symbol *sym, void *arg)
+{
+	(void)arg;
+	/* Before the prelude is assembled, only the symbols defined with `-D` aren't built-in */
+	if (sym->isBuiltin)
+		return;
+
+	startDefines = realloc(startDefines, sizeof(*startDefines) * (nbStartDefines + 1));
+	if (!startDefines)
+		fatalerror("Failed to save definition of '%s': %s\n", sym->name, strerror(errno));
+
+	struct Define *define = &startDefines[nbStartDefines++];
+
+	define->name = strdup(sym->name);
+	define->value = strdup(sym_GetStringValue(sym));
+	if (!define->name || !define->value)
+		fatalerror("Failed to save definition of '%s': %s\n", sym->name, strerror(errno));
+}
+
+void pch_StartEmit(void)
+{
+	emitting = true;
+	saveOptionState(&startOptions);
+	sym_ForEach(saveDefine, NULL);
+}
+
+void pch_AddDependency(char const *path)
+{
+	if (!emitting || hash_GetElement(dependencies, path))
+		return;
+
+	char *copy = strdup(path);
+
+	depPaths = realloc(depPaths, sizeof(*depPaths) * (nbDeps + 1));
+	if (!copy || !depPaths)
+		fatalerror("Failed to remember dependency \"%s\": %s\n", path, strerror(errno));
+	depPaths[nbDeps++] = copy;
+	hash_AddElement(dependencies, copy, copy);
+}
+
+/*
+ * Hash a file's contents with FNV-1a, which is enough to tell if they changed
+ */
+static bool hashFile(char const *path, uint64_t *hash)
+{
+	FILE *file = fopen(path, "rb");
+
+	if (!file)
+		return false;
+
+	uint8_t buf[4096];
+	size_t len;
+
+	*hash = 0xCBF29CE484222325;
+	while ((len = fread(buf, 1, sizeof(buf), file)) != 0) {
+		for (size_t i = 0; i < len; i++)
+			*hash = (*hash ^ buf[i]) * 0x100000001B3;
+	}
+
+	bool ok = !ferror(file);
+
+	fclose(file);
+	return ok;
+}
+
+static void putlong(uint32_t i, FILE *f)
+{
+	putc(i, f);
+	putc(i >> 8, f);
+	putc(i >> 16, f);
+	putc(i >> 24, f);
+}
+
+static void putquad(uint64_t i, FILE *f)
+{
+	putlong(i, f);
+	putlong(i >> 32, f);
+}
+
+static void putstring(char const *s, FILE *f)
+{
+	while (*s)
+		putc(*s++, f);
+	putc(0, f);
+}
+
+struct SymbolList {
+	struct Symbol **syms;
+	uint32_t nbSyms;
+	struct FileStackNode **nodes;
+	uint32_t nbNodes;
+};
+
+/*
+ * Give a node and its parents IDs within the precompiled header
+ * No object file is written when emitting one, so the IDs meant for it can be used
+ */
+static void registerNode(struct SymbolList *list, struct FileStackNode *node)
+{
+	if (node->ID != (uint32_t)-1)
+		return;
+	if (node->parent)
+		registerNode(list, node->parent);
+
+	list->nodes = realloc(list->nodes, sizeof(*list->nodes) * (list->nbNodes + 1));
+	if (!list->nodes)
+		fatalerror("Failed to collect file stack nodes: %s\n", strerror(errno));
+	node->ID = list->nbNodes;
+	list->nodes[list->nbNodes++] = node;
+}
+
+static void collectSymbol(struct Symbol *sym, void *_list)
+{
+	struct SymbolList *list = _list;
+
+	/* Built-ins are defined anew, and `-D` definitions are checked against instead */
+	if (sym->isBuiltin || !sym->src)
+		return;
+
+	list->syms = realloc(list->syms, sizeof(*list->syms) * (list->nbSyms + 1));
+	if (!list->syms)
+		fatalerror("Failed to collect symbols: %s\n", strerror(errno));
+	list->syms[list->nbSyms++] = sym;
+	registerNode(list, sym->src);
+}
+
+static void writeNode(struct FileStackNode const *node, FILE *f)
+{
+	putc(node->type, f);
+	putlong(node->parent ? node->parent->ID : (uint32_t)-1, f);
+	putlong(node->lineNo, f);
+	if (node->type == NODE_REPT) {
+		struct FileStackReptNode const *reptNode = (struct FileStackReptNode const *)node;
+
+		putlong(reptNode->reptDepth, f);
+		for (uint32_t i = 0; i < reptNode->reptDepth; i++)
+			putlong(reptNode->iters[i], f);
+	} else {
+		putstring(((struct FileStackNamedNode const *)node)->name, f);
+	}
+}
+
+static void writeSymbol(struct Symbol const *sym, FILE *f)
+{
+	putstring(sym->name, f);
+	putc(sym->type, f);
+	putc(sym->isExported, f);
+	putlong(sym->src->ID, f);
+	putlong(sym->fileLine, f);
+
+	switch (sym->type) {
+	case SYM_EQU:
+	case SYM_SET:
+		putlong(sym->value, f);
+		break;
+	case SYM_EQUS:
+		putstring(sym->macro, f);
+		break;
+	case SYM_MACRO:
+		putlong(sym->macroSize, f);
+		fwrite(sym->macro, 1, sym->macroSize, f);
+		break;
+	case SYM_REF:
+		break;
+	case SYM_LABEL: /* Labels cannot exist without sections */
+		unreachable_();
+	}
+}
+
+struct CharmapWriter {
+	FILE *file;
+	bool started;
+};
+
+static void writeCharmapName(char const *name, void *_writer)
+{
+	struct CharmapWriter *writer = _writer;
+
+	/* Terminate the previous charmap's mappings */
+	if (writer->started)
+		putc(0, writer->file);
+	writer->started = true;
+	putstring(name, writer->file);
+}
+
+static void writeMapping(char const *mapping, uint8_t value, void *_writer)
+{
+	struct CharmapWriter *writer = _writer;
+
+	putstring(mapping, writer->file);
+	putc(value, writer->file);
+}
+
+static void writeOptions(FILE *f)
+{
+	struct OptionState endOptions;
+	uint8_t changed = 0;
+
+	saveOptionState(&endOptions);
+	if (memcmp(endOptions.binDigits, startOptions.binDigits, sizeof(endOptions.binDigits)))
+		changed |= CHANGED_BIN_DIGITS;
+	if (memcmp(endOptions.gfxDigits, startOptions.gfxDigits, sizeof(endOptions.gfxDigits)))
+		changed |= CHANGED_GFX_DIGITS;
+	if (endOptions.fillByte != startOptions.fillByte)
+		changed |= CHANGED_FILL_BYTE;
+	if (endOptions.haltnop != startOptions.haltnop)
+		changed |= CHANGED_HALTNOP;
+	if (endOptions.optimizeLoads != startOptions.optimizeLoads)
+		changed |= CHANGED_OPT_LOADS;
+	if (endOptions.warningsAreErrors != startOptions.warningsAreErrors)
+		changed |= CHANGED_WERROR;
+
+	putc(changed, f);
+	if (changed & CHANGED_BIN_DIGITS)
+		fwrite(endOptions.binDigits, 1, sizeof(endOptions.binDigits), f);
+	if (changed & CHANGED_GFX_DIGITS)
+		fwrite(endOptions.gfxDigits, 1, sizeof(endOptions.gfxDigits), f);
+	if (changed & CHANGED_FILL_BYTE)
+		putc(endOptions.fillByte, f);
+	if (changed & CHANGED_HALTNOP)
+		putc(endOptions.haltnop, f);
+	if (changed & CHANGED_OPT_LOADS)
+		putc(endOptions.optimizeLoads, f);
+	if (changed & CHANGED_WERROR)
+		putc(endOptions.warningsAreErrors, f);
+
+	for (enum WarningID id = 0; id < NB_WARNINGS; id++)
+		putc(endOptions.warningStates[id] == startOptions.warningStates[id]
+			? WARNING_UNCHANGED : endOptions.warningStates[id], f);
+}
+
+/*
+ * Write the state left by the prelude just assembled
+ * Returns false if it cannot be precompiled
+ */
+bool pch_Write(char const *pchName)
+{
+	if (sectionList) {
+		error("Precompiled headers cannot contain sections\n");
+		return false;
+	}
+	for (uint32_t i = 0; i < nbDeps; i++) {
+		if (!strcmp(depPaths[i], "-")) {
+			error("Standard input cannot be precompiled\n");
+			return false;
+		}
+	}
+
+	FILE *f = fopen(pchName, "wb");
+
+	if (!f)
+		err(1, "Couldn't write file '%s'", pchName);
+
+	fputs(PCH_MAGIC, f);
+	putc(PCH_VERSION, f);
+	putstring(depPaths[0], f); /* The prelude is the first file opened */
+	putstring(get_package_version_string(), f);
+	putlong(NB_WARNINGS, f);
+
+	putlong(nbDeps, f);
+	for (uint32_t i = 0; i < nbDeps; i++) {
+		struct stat statBuf;
+		uint64_t hash;
+
+		if (stat(depPaths[i], &statBuf) != 0 || !hashFile(depPaths[i], &hash))
+			err(1, "Failed to read dependency \"%s\"", depPaths[i]);
+		putstring(depPaths[i], f);
+		putquad(statBuf.st_size, f);
+		putquad(statBuf.st_mtime, f);
+		putquad(hash, f);
+	}
+
+	putlong(nbStartDefines, f);
+	for (uint32_t i = 0; i < nbStartDefines; i++) {
+		struct Symbol const *sym = sym_FindExactSymbol(startDefines[i].name);
+
+		putstring(startDefines[i].name, f);
+		putstring(startDefines[i].value, f);
+		/* Whether the prelude purged (and maybe redefined) it */
+		putc(!sym || sym->src, f);
+	}
+
+	writeOptions(f);
+	putlong(macro_GetMaxUniqueID(), f);
+	putlong(sym_FindExactSymbol("_RS")->value, f);
+
+	struct SymbolList list = { 0 };
+
+	sym_ForEach(collectSymbol, &list);
+	putlong(list.nbNodes, f);
+	for (uint32_t i = 0; i < list.nbNodes; i++)
+		writeNode(list.nodes[i], f);
+	/* Symbols are added back in reverse, which recreates the symbol table's order */
+	putlong(list.nbSyms, f);
+	for (uint32_t i = list.nbSyms; i--; )
+		writeSymbol(list.syms[i], f);
+	free(list.syms);
+	free(list.nodes);
+
+	struct CharmapWriter writer = { .file = f, .started = false };
+
+	charmap_ForEach(writeCharmapName, writeMapping, &writer);
+	if (writer.started)
+		putc(0, f);
+	putc(0, f);
+	putstring(charmap_GetCurrentName(), f);
+
+	if (ferror(f) || fclose(f) != 0)
+		err(1, "Couldn't write file '%s'", pchName);
+	return true;
+}
+
+static _Noreturn void corrupted(void)
+{
+	errx(1, "%s: Precompiled header is corrupted", pchFileName);
+}
+
+static uint8_t *readBytes(size_t len)
+{
+	uint8_t *ptr = readPtr;
+
+	if ((size_t)(pchEnd - readPtr) < len)
+		corrupted();
+	readPtr += len;
+	return ptr;
+}
+
+static uint8_t readByte(void)
+{
+	return *readBytes(1);
+}
+
+static uint32_t readLong(void)
+{
+	uint8_t const *bytes = readBytes(4);
+
+	return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static uint64_t readQuad(void)
+{
+	uint64_t low = readLong();
+
+	return low | (uint64_t)readLong() << 32;
+}
+
+static char *readString(void)
+{
+	uint8_t *end = memchr(readPtr, '\0', pchEnd - readPtr);
+
+	if (!end)
+		corrupted();
+	return (char *)readBytes(end - readPtr + 1);
+}
+
+static bool isDependencyUpToDate(char const *path, uint64_t size, int64_t mtime,
+				 uint64_t hash)
+{
+	struct stat statBuf;
+
+	if (stat(path, &statBuf) != 0 || (uint64_t)statBuf.st_size != size)
+		return false;
+	if (statBuf.st_mtime == mtime)
+		return true;
+
+	/* A file may have been touched without being changed */
+	uint64_t newHash;
+
+	return hashFile(path, &newHash) && newHash == hash;
+}
+
+void pch_Load(char const *pchName)
+{
+	FILE *f = fopen(pchName, "rb");
+	long size;
+
+	if (!f)
+		err(1, "Failed to open precompiled header '%s'", pchName);
+	if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) == -1 || fseek(f, 0, SEEK_SET) != 0)
+		err(1, "Failed to read precompiled header '%s'", pchName);
+
+	/* The whole file is kept around, so that macros can point into it */
+	pchData = malloc(size ? size : 1);
+	if (!pchData)
+		err(1, "Failed to allocate precompiled header '%s'", pchName);
+	if (fread(pchData, 1, size, f) != (size_t)size)
+		err(1, "Failed to read precompiled header '%s'", pchName);
+	fclose(f);
+
+	pchFileName = pchName;
+	pchEnd = pchData + size;
+	readPtr = pchData;
+	if ((size_t)size < strlen(PCH_MAGIC) + 1
+	 || memcmp(pchData, PCH_MAGIC, strlen(PCH_MAGIC)) != 0)
+		errx(1, "%s: Not a precompiled header", pchName);
+	readBytes(strlen(PCH_MAGIC));
+
+	uint8_t version = readByte();
+
+	preludeName = readString();
+	if (version != PCH_VERSION || strcmp(readString(), get_package_version_string()) != 0
+	 || readLong() != NB_WARNINGS) {
+		warnx("%s: Precompiled header was made by another version, including \"%s\" instead",
+		      pchName, preludeName);
+		return;
+	}
+
+	nbPchDeps = readLong();
+	pchDeps = readPtr;
+	for (uint32_t i = 0; i < nbPchDeps; i++) {
+		char const *path = readString();
+		uint64_t depSize = readQuad();
+		int64_t mtime = readQuad();
+		uint64_t hash = readQuad();
+
+		if (!isDependencyUpToDate(path, depSize, mtime, hash)) {
+			warnx("%s: \"%s\" changed since the precompiled header was made, including \"%s\" instead",
+			      pchName, path, preludeName);
+			return;
+		}
+	}
+
+	pchState = readPtr;
+	isUpToDate = true;
+}
+
+char const *pch_GetPreludeName(void)
+{
+	return preludeName;
+}
+
+static void countDefine(struct Symbol *sym, void *_count)
+{
+	uint32_t *count = _count;
+
+	if (!sym->isBuiltin)
+		(*count)++;
+}
+
+/*
+ * Check that the symbols defined with `-D` are the same as when the prelude was assembled
+ */
+static bool checkDefines(uint32_t nbDefines)
+{
+	uint32_t nbCurDefines = 0;
+	bool matches = true;
+
+	sym_ForEach(countDefine, &nbCurDefines);
+	for (uint32_t i = 0; i < nbDefines; i++) {
+		char const *name = readString();
+		char const *value = readString();
+		struct Symbol const *sym = sym_FindExactSymbol(name);
+
+		readByte();
+
+		if (!sym || sym->isBuiltin || sym->type != SYM_EQUS
+		 || strcmp(sym_GetStringValue(sym), value) != 0)
+			matches = false;
+	}
+	return matches && nbCurDefines == nbDefines;
+}
+
+static void restoreOptions(void)
+{
+	uint8_t changed = readByte();
+
+	if (changed & CHANGED_BIN_DIGITS)
+		lexer_SetBinDigits((char const *)readBytes(2));
+	if (changed & CHANGED_GFX_DIGITS)
+		lexer_SetGfxDigits((char const *)readBytes(4));
+	if (changed & CHANGED_FILL_BYTE)
+		fillByte = readByte();
+	if (changed & CHANGED_HALTNOP)
+		haltnop = readByte();
+	if (changed & CHANGED_OPT_LOADS)
+		optimizeLoads = readByte();
+	if (changed & CHANGED_WERROR)
+		warningsAreErrors = readByte();
+
+	for (enum WarningID id = 0; id < NB_WARNINGS; id++) {
+		uint8_t state = readByte();
+
+		if (state != WARNING_UNCHANGED)
+			warningStates[id] = state;
+	}
+}
+
+static struct FileStackNode *readNode(struct FileStackNode **nodes, uint32_t nodeID)
+{
+	uint8_t type = readByte();
+	uint32_t parentID = readLong();
+	uint32_t lineNo = readLong();
+	struct FileStackNode *node;
+
+	if (parentID != (uint32_t)-1 && parentID >= nodeID)
+		corrupted();
+
+	if (type == NODE_REPT) {
+		uint32_t reptDepth = readLong();
+
+		if (reptDepth > (size_t)(pchEnd - readPtr) / sizeof(uint32_t))
+			corrupted();
+
+		struct FileStackReptNode *reptNode = malloc(sizeof(*reptNode)
+						       + sizeof(reptNode->iters[0]) * reptDepth);
+
+		if (!reptNode)
+			fatalerror("Failed to allocate file stack node: %s\n", strerror(errno));
+		reptNode->reptDepth = reptDepth;
+		for (uint32_t i = 0; i < reptDepth; i++)
+			reptNode->iters[i] = readLong();
+		node = (struct FileStackNode *)reptNode;
+	} else if (type == NODE_FILE || type == NODE_MACRO) {
+		char const *name = readString();
+		size_t len = strlen(name);
+		struct FileStackNamedNode *namedNode = malloc(sizeof(*namedNode) + len + 1);
+
+		if (!namedNode)
+			fatalerror("Failed to allocate file stack node: %s\n", strerror(errno));
+		memcpy(namedNode->name, name, len + 1);
+		node = (struct FileStackNode *)namedNode;
+	} else {
+		corrupted();
+	}
+
+	node->type = type;
+	node->parent = parentID == (uint32_t)-1 ? NULL : nodes[parentID];
+	node->lineNo = lineNo;
+	node->next = NULL;
+	/* Symbols point to the node, so it may never be freed */
+	node->referenced = true;
+	node->ID = -1;
+	return node;
+}
+
+static void readSymbol(struct FileStackNode **nodes, uint32_t nbNodes)
+{
+	char const *name = readString();
+	uint8_t type = readByte();
+	bool isExported = readByte();
+	uint32_t srcID = readLong();
+	uint32_t fileLine = readLong();
+
+	if (srcID >= nbNodes || sym_FindExactSymbol(name))
+		corrupted();
+
+	struct Symbol *sym;
+
+	switch (type) {
+	case SYM_EQU:
+	case SYM_SET:
+		sym = sym_AddPrecompiled(name, type, nodes[srcID], fileLine);
+		sym->value = readLong();
+		break;
+	case SYM_EQUS:
+		sym = sym_AddPrecompiled(name, type, nodes[srcID], fileLine);
+		sym->macro = strdup(readString());
+		if (!sym->macro)
+			fatalerror("No memory for string equate: %s\n", strerror(errno));
+		sym->macroSize = strlen(sym->macro);
+		break;
+	case SYM_MACRO:
+		sym = sym_AddPrecompiled(name, type, nodes[srcID], fileLine);
+		sym->macroSize = readLong();
+		sym->macro = (char *)readBytes(sym->macroSize);
+		break;
+	case SYM_REF:
+		sym = sym_AddPrecompiled(name, type, nodes[srcID], fileLine);
+		break;
+	default:
+		corrupted();
+	}
+	sym->isExported = isExported;
+}
+
+bool pch_Apply(void)
+{
+	if (!isUpToDate)
+		return false;
+
+	readPtr = pchState;
+
+	uint32_t nbDefines = readLong();
+	uint8_t *defines = readPtr;
+
+	if (!checkDefines(nbDefines)) {
+		warnx("%s: Precompiled header was made with other -D definitions, including \"%s\" instead",
+		      pchFileName, preludeName);
+		return false;
+	}
+	readPtr = defines;
+	for (uint32_t i = 0; i < nbDefines; i++) {
+		char const *name = readString();
+
+		readString();
+		if (readByte())
+			sym_Purge(name);
+	}
+
+	restoreOptions();
+	macro_SetUniqueID(readLong());
+	sym_AddSet("_RS", readLong());
+
+	uint32_t nbNodes = readLong();
+	struct FileStackNode **nodes = malloc(sizeof(*nodes) * (nbNodes ? nbNodes : 1));
+
+	if (!nodes)
+		fatalerror("Failed to allocate file stack nodes: %s\n", strerror(errno));
+	for (uint32_t i = 0; i < nbNodes; i++)
+		nodes[i] = readNode(nodes, i);
+
+	uint32_t nbSymbols = readLong();
+
+	for (uint32_t i = 0; i < nbSymbols; i++)
+		readSymbol(nodes, nbNodes);
+	free(nodes);
+
+	for (char const *name; *(name = readString()); ) {
+		/* The main charmap is created before this is called */
+		if (!strcmp(name, "main"))
+			charmap_Set(name);
+		else
+			charmap_New(name, NULL);
+		for (char *mapping; *(mapping = readString()); )
+			charmap_Add(mapping, readByte());
+	}
+	charmap_Set(readString());
+
+	/* Whatever depends on the prelude also depends on what it included */
+	readPtr = pchDeps;
+	for (uint32_t i = 0; i < nbPchDeps; i++) {
+		fstk_AddDep(readString());
+		readBytes(8 * 3);
+	}
+	return true;
+}
@@ -28,27 +28,25 @@
 
 #include "opmath.h"
 
-/* Makes an expression "not known", also setting its error message */
-#define makeUnknown(expr_, ...) do { \
-	struct Expression *_expr = expr_; \
-	_expr->isKnown = false; \
-	/* If we had `asprintf` this would be great, but alas. */ \
-	_expr->reason = malloc(128); /* Use an initial reasonable size */ \
-	if (!_expr->reason) \
-		fatalerror("Can't allocate err string: %s\n", strerror(errno)); \
-	int size = snprintf(_expr->reason, 128, __VA_ARGS__); \
-	if (size >= 128) { /* If this wasn't enough, try again */ \
-		_expr->reason = realloc(_expr->reason, size + 1); \
-		sprintf(_expr->reason, __VA_ARGS__); \
-	} \
-} while (0)
+/*
+ * Makes an expression "not known", also setting its error message.
+ * The message is only formatted if it ends up being reported, since most aren't.
+ */
+static void makeUnknown(struct Expression *expr, char const *reason, uint32_t reasonArg)
+{
+	expr->isKnown = false;
+	expr->reason = reason;
+	expr->reasonArg = reasonArg;
+}
 
 static uint8_t *reserveSpace(struct Expression *expr, uint32_t size)
 {
 	/* This assumes the RPN length is always less than the capacity */
 	if (expr->rpnCapacity - expr->rpnLength < size) {
-		/* If there isn't enough room to reserve the space, realloc */
-		if (!expr->rpn)
+		/* If there isn't enough room to reserve the space, move to the heap */
+		uint8_t *inlineBuf = expr->rpn ? NULL : expr->rpnBuf;
+
+		if (inlineBuf)
 			expr->rpnCapacity = 256; /* Initial size */
 		while (expr->rpnCapacity - expr->rpnLength < size) {
 			if (expr->rpnCapacity >= MAXRPNLEN)
@@ -67,9 +65,11 @@ static uint8_t *reserveSpace(struct Expression *expr, uint32_t size)
 
 		if (!expr->rpn)
 			fatalerror("Failed to grow RPN expression: %s\n", strerror(errno));
+		if (inlineBuf)
+			memcpy(expr->rpn, inlineBuf, expr->rpnLength);
 	}
 
-	uint8_t *ptr = expr->rpn + expr->rpnLength;
+	uint8_t *ptr = (expr->rpn ? expr->rpn : expr->rpnBuf) + expr->rpnLength;
 
 	expr->rpnLength += size;
 	return ptr;
@@ -84,7 +84,7 @@ static void rpn_Init(struct Expression *expr)
 	expr->isKnown = true;
 	expr->isSymbol = false;
 	expr->rpn = NULL;
-	expr->rpnCapacity = 0;
+	expr->rpnCapacity = sizeof(expr->rpnBuf);
 	expr->rpnLength = 0;
 	expr->rpnPatchSize = 0;
 }
@@ -95,10 +95,25 @@ static void rpn_Init(struct Expression *expr)
 void rpn_Free(struct Expression *expr)
 {
 	free(expr->rpn);
-	free(expr->reason);
 	rpn_Init(expr);
 }
 
+/*
+ * Append a name to the RPN buffer, returning the offset of its part named in the source
+ * (which is a suffix of the name stored, in case it was a local label's short form)
+ */
+static uint32_t appendName(struct Expression *expr, char const *name, char const *srcName)
+{
+	size_t nameLen = strlen(name) + 1; /* Don't forget NUL! */
+	size_t srcNameLen = strlen(srcName) + 1;
+	uint32_t ofs = expr->rpnLength;
+
+	memcpy(reserveSpace(expr, nameLen), name, nameLen);
+	if (srcNameLen <= nameLen && !strcmp(&name[nameLen - srcNameLen], srcName))
+		ofs += nameLen - srcNameLen;
+	return ofs;
+}
+
 /*
  * Add symbols, constants and operators to expression
  */
@@ -119,15 +134,14 @@ void rpn_Symbol(struct Expression *expr, char const *symName)
 		rpn_Init(expr);
 		expr->isSymbol = true;
 
-		makeUnknown(expr, sym_IsPC(sym) ? "PC is not constant at assembly time"
-						: "'%s' is not constant at assembly time", symName);
+		char const *reason = sym_IsPC(sym) ? "PC is not constant at assembly time"
+						   : "'%s' is not constant at assembly time";
+
 		sym = sym_Ref(symName);
 		expr->rpnPatchSize += 5; /* 1-byte opcode + 4-byte symbol ID */
 
-		size_t nameLen = strlen(sym->name) + 1; /* Don't forget NUL! */
-		uint8_t *ptr = reserveSpace(expr, nameLen + 1);
-		*ptr++ = RPN_SYM;
-		memcpy(ptr, sym->name, nameLen);
+		*reserveSpace(expr, 1) = RPN_SYM;
+		makeUnknown(expr, reason, appendName(expr, sym->name, symName));
 	} else {
 		rpn_Number(expr, sym_GetConstantValue(symName));
 	}
@@ -141,7 +155,7 @@ void rpn_BankSelf(struct Expression *expr)
 		error("PC has no bank outside a section\n");
 		expr->val = 1;
 	} else if (currentSection->bank == (uint32_t)-1) {
-		makeUnknown(expr, "Current section's bank is not known");
+		makeUnknown(expr, "Current section's bank is not known", 0);
 		expr->rpnPatchSize++;
 		*reserveSpace(expr, 1) = RPN_BANK_SELF;
 	} else {
@@ -170,13 +184,11 @@ void rpn_BankSymbol(struct Expression *expr, char const *symName)
 			/* Symbol's section is known and bank is fixed */
 			expr->val = sym_GetSection(sym)->bank;
 		} else {
-			makeUnknown(expr, "\"%s\"'s bank is not known", symName);
 			expr->rpnPatchSize += 5; /* opcode + 4-byte sect ID */
 
-			size_t nameLen = strlen(sym->name) + 1; /* Room for NUL! */
-			uint8_t *ptr = reserveSpace(expr, nameLen + 1);
-			*ptr++ = RPN_BANK_SYM;
-			memcpy(ptr, sym->name, nameLen);
+			*reserveSpace(expr, 1) = RPN_BANK_SYM;
+			makeUnknown(expr, "\"%s\"'s bank is not known",
+				    appendName(expr, sym->name, symName));
 		}
 	}
 }
@@ -190,14 +202,10 @@ void rpn_BankSection(struct Expression *expr, char const *sectionName)
 	if (section && section->bank != (uint32_t)-1) {
 		expr->val = section->bank;
 	} else {
-		makeUnknown(expr, "Section \"%s\"'s bank is not known", sectionName);
-
-		size_t nameLen = strlen(sectionName) + 1; /* Room for NUL! */
-		uint8_t *ptr = reserveSpace(expr, nameLen + 1);
-
-		expr->rpnPatchSize += nameLen + 1;
-		*ptr++ = RPN_BANK_SECT;
-		memcpy(ptr, sectionName, nameLen);
+		*reserveSpace(expr, 1) = RPN_BANK_SECT;
+		makeUnknown(expr, "Section \"%s\"'s bank is not known",
+			    appendName(expr, sectionName, sectionName));
+		expr->rpnPatchSize += expr->rpnLength;
 	}
 }
 
@@ -210,14 +218,10 @@ void rpn_SizeOfSection(struct Expression *expr, char const *sectionName)
 	if (section && sect_IsSizeKnown(section)) {
 		expr->val = section->size;
 	} else {
-		makeUnknown(expr, "Section \"%s\"'s size is not known", sectionName);
-
-		size_t nameLen = strlen(sectionName) + 1; /* Room for NUL! */
-		uint8_t *ptr = reserveSpace(expr, nameLen + 1);
-
-		expr->rpnPatchSize += nameLen + 1;
-		*ptr++ = RPN_SIZEOF_SECT;
-		memcpy(ptr, sectionName, nameLen);
+		*reserveSpace(expr, 1) = RPN_SIZEOF_SECT;
+		makeUnknown(expr, "Section \"%s\"'s size is not known",
+			    appendName(expr, sectionName, sectionName));
+		expr->rpnPatchSize += expr->rpnLength;
 	}
 }
 
@@ -230,14 +234,10 @@ void rpn_StartOfSection(struct Expression *expr, char const *sectionName)
 	if (section && section->org != (uint32_t)-1) {
 		expr->val = section->org;
 	} else {
-		makeUnknown(expr, "Section \"%s\"'s start is not known", sectionName);
-
-		size_t nameLen = strlen(sectionName) + 1; /* Room for NUL! */
-		uint8_t *ptr = reserveSpace(expr, nameLen + 1);
-
-		expr->rpnPatchSize += nameLen + 1;
-		*ptr++ = RPN_STARTOF_SECT;
-		memcpy(ptr, sectionName, nameLen);
+		*reserveSpace(expr, 1) = RPN_STARTOF_SECT;
+		makeUnknown(expr, "Section \"%s\"'s start is not known",
+			    appendName(expr, sectionName, sectionName));
+		expr->rpnPatchSize += expr->rpnLength;
 	}
 }
 
@@ -292,7 +292,12 @@ void rpn_CheckNBit(struct Expression const *expr, uint8_t n)
 int32_t rpn_GetConstVal(struct Expression const *expr)
 {
 	if (!rpn_isKnown(expr)) {
-		error("Expected constant expression: %s\n", expr->reason);
+		/* The reason's argument is a symbol or section name, which are capped in length */
+		char reason[MAXSYMLEN + 64];
+
+		snprintf(reason, sizeof(reason), expr->reason,
+			 (char const *)&rpn_GetBytes(expr)[expr->reasonArg]);
+		error("Expected constant expression: %s\n", reason);
 		return 0;
 	}
 	return expr->val;
@@ -315,7 +320,7 @@ struct Symbol const *rpn_SymbolOf(struct Expression const *expr)
 {
 	if (!rpn_isSymbol(expr))
 		return NULL;
-	return sym_FindScopedSymbol((char *)expr->rpn + 1);
+	return sym_FindScopedSymbol((char const *)rpn_GetBytes(expr) + 1);
 }
 
 bool rpn_IsDiffConstant(struct Expression const *src, struct Symbol const *sym)
@@ -485,26 +490,28 @@ void rpn_BinaryOp(enum RPNCommand op, struct Expression *expr,
 					   lval >> 16, lval >> 24};
 			expr->rpnPatchSize = sizeof(bytes);
 			expr->rpn = NULL;
-			expr->rpnCapacity = 0;
+			expr->rpnCapacity = sizeof(expr->rpnBuf);
 			expr->rpnLength = 0;
 			memcpy(reserveSpace(expr, sizeof(bytes)), bytes,
 			       sizeof(bytes));
 
-			/* Use the other expression's un-const reason */
+			/* Use the other expression's un-const reason, which will follow */
 			expr->reason = src2->reason;
-			free(src1->reason);
+			expr->reasonArg = src2->reasonArg + sizeof(bytes);
 		} else {
 			/* Otherwise just reuse its RPN buffer */
 			expr->rpnPatchSize = src1->rpnPatchSize;
 			expr->rpn = src1->rpn;
 			expr->rpnCapacity = src1->rpnCapacity;
 			expr->rpnLength = src1->rpnLength;
+			if (!src1->rpn)
+				memmove(expr->rpnBuf, src1->rpnBuf, src1->rpnLength);
 			expr->reason = src1->reason;
-			free(src2->reason);
+			expr->reasonArg = src1->reasonArg;
 		}
 
 		/* Now, merge the right expression into the left one */
-		uint8_t *ptr = src2->rpn; /* Pointer to the right RPN */
+		uint8_t const *ptr = rpn_GetBytes(src2); /* Pointer to the right RPN */
 		uint32_t len = src2->rpnLength; /* Size of the right RPN */
 		uint32_t patchSize = src2->rpnPatchSize;
 
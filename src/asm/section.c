@@ -42,6 +42,15 @@ struct Section *currentSection = NULL;
 static struct Section *currentLoadSection = NULL;
 int32_t loadOffset; /* Offset into the LOAD section's parent (see sect_GetOutputOffset) */
 
+/*
+ * Constant data from the `db`, `dw` or `dl` being assembled, not yet written to the section
+ * It is written all at once by `sect_EndDataList`, or before the next non-constant value;
+ * until then, it counts towards the current offset.
+ */
+static uint8_t *pendingData;
+static uint32_t pendingSize;
+static uint32_t pendingCapacity;
+
 /*
  * A quick check to see if we have an initialized section
  */
@@ -483,12 +492,12 @@ struct Section *sect_GetSymbolSection(void)
  */
 uint32_t sect_GetSymbolOffset(void)
 {
-	return curOffset;
+	return curOffset + pendingSize;
 }
 
 uint32_t sect_GetOutputOffset(void)
 {
-	return curOffset + loadOffset;
+	return curOffset + loadOffset + pendingSize;
 }
 
 void sect_AlignPC(uint8_t alignment, uint16_t offset)
@@ -616,49 +625,58 @@ void sect_CheckUnionClosed(void)
 }
 
 /*
- * Output an absolute byte
+ * Free all sections and section stacks, so the next file in batch mode starts afresh
+ * The sections' patches must have been freed by `out_Reset` beforehand
  */
-void sect_AbsByte(uint8_t b)
+void sect_Reset(void)
 {
-	if (!checkcodesection())
-		return;
-	if (!reserveSpace(1))
-		return;
+	while (sectionList) {
+		struct Section *next = sectionList->next;
 
-	writebyte(b);
-}
+		free(sectionList->name);
+		free(sectionList->data);
+		free(sectionList);
+		sectionList = next;
+	}
 
-void sect_AbsByteGroup(uint8_t const *s, int32_t length)
-{
-	if (!checkcodesection())
-		return;
-	if (!reserveSpace(length))
-		return;
+	while (sectionStack) {
+		struct SectionStackEntry *next = sectionStack->next;
 
-	while (length--)
-		writebyte(*s++);
-}
+		while (sectionStack->unionStack) {
+			struct UnionStackEntry *nextUnion = sectionStack->unionStack->next;
 
-void sect_AbsWordGroup(uint8_t const *s, int32_t length)
-{
-	if (!checkcodesection())
-		return;
-	if (!reserveSpace(length * 2))
-		return;
+			free(sectionStack->unionStack);
+			sectionStack->unionStack = nextUnion;
+		}
+		free(sectionStack);
+		sectionStack = next;
+	}
 
-	while (length--)
-		writeword(*s++);
+	while (unionStack) {
+		struct UnionStackEntry *next = unionStack->next;
+
+		free(unionStack);
+		unionStack = next;
+	}
+
+	currentSection = NULL;
+	currentLoadSection = NULL;
+	curOffset = 0;
+	loadOffset = 0;
+	pendingSize = 0;
 }
 
-void sect_AbsLongGroup(uint8_t const *s, int32_t length)
+/*
+ * Output an absolute byte
+ */
+void sect_AbsByte(uint8_t b)
 {
 	if (!checkcodesection())
 		return;
-	if (!reserveSpace(length * 4))
+	if (!reserveSpace(1))
 		return;
 
-	while (length--)
-		writelong(*s++);
+	writebyte(b);
 }
 
 /*
@@ -783,6 +801,71 @@ void sect_RelLong(struct Expression *expr, uint32_t pcShift)
 	rpn_Free(expr);
 }
 
+/*
+ * Queue a constant value of a data list, in little-endian order
+ */
+static void queueData(uint32_t value, uint8_t size)
+{
+	if (pendingSize + size > pendingCapacity) {
+		pendingCapacity = pendingCapacity ? pendingCapacity * 2 : 256;
+		pendingData = realloc(pendingData, pendingCapacity);
+		if (!pendingData)
+			fatalerror("Failed to allocate data list: %s\n", strerror(errno));
+	}
+	for (uint8_t i = 0; i < size; i++)
+		pendingData[pendingSize++] = value >> (i * 8);
+}
+
+/*
+ * Output a value of a `db` (size 1), `dw` (size 2) or `dl` (size 4) list
+ * Runs of constant values are only checked and written once the run ends
+ */
+void sect_DataValue(struct Expression *expr, uint8_t size)
+{
+	if (rpn_isKnown(expr)) {
+		queueData(expr->val, size);
+		rpn_Free(expr);
+		return;
+	}
+
+	sect_EndDataList();
+	if (size == 1)
+		sect_RelByte(expr, 0);
+	else if (size == 2)
+		sect_RelWord(expr, 0);
+	else
+		sect_RelLong(expr, 0);
+}
+
+/*
+ * Output a string of a data list, once converted by the charmap; each unit becomes one value
+ */
+void sect_DataString(uint8_t const *s, int32_t length, uint8_t size)
+{
+	while (length--)
+		queueData(*s++, size);
+}
+
+/*
+ * Write the constant values of the data list queued so far
+ */
+void sect_EndDataList(void)
+{
+	uint32_t size = pendingSize;
+
+	if (!size)
+		return;
+	pendingSize = 0; // So that offsets are the section's own again
+
+	if (!checkcodesection())
+		return;
+	if (!reserveSpace(size))
+		return;
+
+	memcpy(&currentSection->data[sect_GetOutputOffset()], pendingData, size);
+	growSection(size);
+}
+
 /*
  * Output a PC-relative relocatable byte. Checking will be done to see if it
  * is an absolute value in disguise.
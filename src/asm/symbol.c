@@ -177,6 +177,16 @@ static void updateSymbolFilename(struct Symbol *sym)
 	/* TODO: unref the old node, and use `out_ReplaceNode` instead of deleting it */
 }
 
+/*
+ * Give a symbol a generation that no symbol has had before, signaling that its value changed
+ */
+static void newGeneration(struct Symbol *sym)
+{
+	static uint32_t nextGeneration = 0;
+
+	sym->generation = nextGeneration++;
+}
+
 /*
  * Create a new symbol by name
  */
@@ -197,6 +207,9 @@ static struct Symbol *createsymbol(char const *symName)
 	setSymbolFilename(sym);
 	sym->ID = -1;
 	sym->next = NULL;
+	sym->nbExpansions = 0;
+	sym->isPurged = false;
+	newGeneration(sym);
 
 	hash_AddElement(symbols, sym->name, sym);
 	return sym;
@@ -227,6 +240,7 @@ static void assignStringSymbol(struct Symbol *sym, char const *value)
 	sym->type = SYM_EQUS;
 	sym->macro = string;
 	sym->macroSize = strlen(string);
+	newGeneration(sym);
 }
 
 struct Symbol *sym_FindExactSymbol(char const *symName)
@@ -267,6 +281,17 @@ struct Symbol const *sym_GetPC(void)
 	return PCSymbol;
 }
 
+static void freeSymbol(void *_sym, void *arg)
+{
+	struct Symbol *sym = _sym;
+
+	(void)arg;
+	/* Macro bodies may point into mapped files, so only string equates are owned */
+	if (sym->type == SYM_EQUS && !sym->hasCallback)
+		free(sym->macro);
+	free(sym);
+}
+
 static bool isReferenced(struct Symbol const *sym)
 {
 	return sym->ID != (uint32_t)-1;
@@ -291,15 +316,31 @@ void sym_Purge(char const *symName)
 			sym_SetCurrentSymbolScope(NULL);
 
 		/*
-		 * FIXME: this leaks sym->macro for SYM_EQUS and SYM_MACRO, but this can't
-		 * free(sym->macro) because the expansion may be purging itself.
+		 * FIXME: this leaks sym->macro for SYM_MACRO, but this can't free(sym->macro)
+		 * because the macro may be purging itself.
 		 */
 		hash_RemoveElement(symbols, sym->name);
 		/* TODO: ideally, also unref the file stack nodes */
-		free(sym);
+		if (sym->nbExpansions != 0)
+			sym->isPurged = true; /* Freed by the last expansion, see `sym_EndExpansion` */
+		else
+			freeSymbol(sym, NULL);
 	}
 }
 
+void sym_BeginExpansion(struct Symbol *sym)
+{
+	sym->nbExpansions++;
+}
+
+void sym_EndExpansion(struct Symbol *sym)
+{
+	assert(sym->nbExpansions != 0);
+	sym->nbExpansions--;
+	if (sym->isPurged && sym->nbExpansions == 0)
+		freeSymbol(sym, NULL);
+}
+
 uint32_t sym_GetPCValue(void)
 {
 	struct Section const *sect = sect_GetSymbolSection();
@@ -394,6 +435,7 @@ struct Symbol *sym_AddEqu(char const *symName, int32_t value)
 
 	sym->type = SYM_EQU;
 	sym->value = value;
+	newGeneration(sym);
 
 	return sym;
 }
@@ -418,6 +460,7 @@ struct Symbol *sym_RedefEqu(char const *symName, int32_t value)
 	updateSymbolFilename(sym);
 	sym->type = SYM_EQU;
 	sym->value = value;
+	newGeneration(sym);
 
 	return sym;
 }
@@ -496,6 +539,7 @@ struct Symbol *sym_AddSet(char const *symName, int32_t value)
 
 	sym->type = SYM_SET;
 	sym->value = value;
+	newGeneration(sym);
 
 	return sym;
 }
@@ -523,6 +567,7 @@ static struct Symbol *addLabel(char const *symName)
 	/* If the symbol already exists as a ref, just "take over" it */
 	sym->type = SYM_LABEL;
 	sym->value = sect_GetSymbolOffset();
+	newGeneration(sym);
 	if (exportall)
 		sym->isExported = true;
 	sym->section = sect_GetSymbolSection();
@@ -672,6 +717,21 @@ struct Symbol *sym_AddMacro(char const *symName, int32_t defLineNo, char *body,
 	return sym;
 }
 
+/*
+ * Add a symbol read from a precompiled header, keeping where it was originally defined
+ * The caller must then set its value
+ */
+struct Symbol *sym_AddPrecompiled(char const *symName, enum SymbolType type,
+				  struct FileStackNode *src, uint32_t fileLine)
+{
+	struct Symbol *sym = createsymbol(symName);
+
+	sym->type = type;
+	sym->src = src;
+	sym->fileLine = fileLine;
+	return sym;
+}
+
 /*
  * Flag that a symbol is referenced in an RPN expression
  * and create it if it doesn't exist yet
@@ -716,6 +776,18 @@ static struct Symbol *createBuiltinSymbol(char const *symName)
 	return sym;
 }
 
+/*
+ * Free the symbol table, so that `sym_Init` can be called for the next file in batch mode
+ * No lexer state may be expanding a symbol anymore when this is called
+ */
+void sym_Reset(void)
+{
+	hash_ForEach(symbols, freeSymbol, NULL);
+	hash_EmptyMap(symbols);
+	PCSymbol = NULL;
+	labelScope = NULL;
+}
+
 /*
  * Initialize the symboltable
  */
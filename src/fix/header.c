@@ -0,0 +1,1258 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2020, Eldred habert and RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fix/header.h"
+
+#include "extern/getopt.h"
+
+#include "helpers.h"
+#include "platform.h"
+
+#define UNSPECIFIED 0x200 // Should not be in byte range
+
+#define BANK_SIZE FIX_BANK_SIZE
+
+// Same as rgbfix's, minus the options that don't affect the ROM
+static const char *optstring = "Ccf:i:jk:l:m:n:Op:r:st:v";
+
+static struct option const longopts[] = {
+	{ "color-only",       no_argument,       NULL, 'C' },
+	{ "color-compatible", no_argument,       NULL, 'c' },
+	{ "fix-spec",         required_argument, NULL, 'f' },
+	{ "game-id",          required_argument, NULL, 'i' },
+	{ "non-japanese",     no_argument,       NULL, 'j' },
+	{ "new-licensee",     required_argument, NULL, 'k' },
+	{ "old-licensee",     required_argument, NULL, 'l' },
+	{ "mbc-type",         required_argument, NULL, 'm' },
+	{ "rom-version",      required_argument, NULL, 'n' },
+	{ "overwrite",        no_argument,       NULL, 'O' },
+	{ "pad-value",        required_argument, NULL, 'p' },
+	{ "ram-size",         required_argument, NULL, 'r' },
+	{ "sgb-compatible",   no_argument,       NULL, 's' },
+	{ "title",            required_argument, NULL, 't' },
+	{ "validate",         no_argument,       NULL, 'v' },
+	{ NULL,               no_argument,       NULL, 0   }
+};
+
+static uint8_t nbErrors;
+
+static void countError(void)
+{
+	if (nbErrors != UINT8_MAX)
+		nbErrors++;
+}
+
+static format_(printf, 1, 2) void report(char const *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+
+	countError();
+}
+
+enum MbcType {
+	ROM  = 0x00,
+	ROM_RAM = 0x08,
+	ROM_RAM_BATTERY = 0x09,
+
+	MBC1 = 0x01,
+	MBC1_RAM = 0x02,
+	MBC1_RAM_BATTERY = 0x03,
+
+	MBC2 = 0x05,
+	MBC2_BATTERY = 0x06,
+
+	MMM01 = 0x0B,
+	MMM01_RAM = 0x0C,
+	MMM01_RAM_BATTERY = 0x0D,
+
+	MBC3 = 0x11,
+	MBC3_TIMER_BATTERY = 0x0F,
+	MBC3_TIMER_RAM_BATTERY = 0x10,
+	MBC3_RAM = 0x12,
+	MBC3_RAM_BATTERY = 0x13,
+
+	MBC5 = 0x19,
+	MBC5_RAM = 0x1A,
+	MBC5_RAM_BATTERY = 0x1B,
+	MBC5_RUMBLE = 0x1C,
+	MBC5_RUMBLE_RAM = 0x1D,
+	MBC5_RUMBLE_RAM_BATTERY = 0x1E,
+
+	MBC6 = 0x20,
+
+	MBC7_SENSOR_RUMBLE_RAM_BATTERY = 0x22,
+
+	POCKET_CAMERA = 0xFC,
+
+	BANDAI_TAMA5 = 0xFD,
+
+	HUC3 = 0xFE,
+
+	HUC1_RAM_BATTERY = 0xFF,
+
+	// "Extended" values (still valid, but not directly actionable)
+
+	// A high byte of 0x01 means TPP1, the low byte is the requested features
+	// This does not include SRAM, which is instead implied by a non-zero SRAM size
+	// Note: Multiple rumble speeds imply rumble
+	TPP1 = 0x100,
+	TPP1_RUMBLE = 0x101,
+	TPP1_MULTIRUMBLE = 0x102, // Should not be possible
+	TPP1_MULTIRUMBLE_RUMBLE = 0x103,
+	TPP1_TIMER = 0x104,
+	TPP1_TIMER_RUMBLE = 0x105,
+	TPP1_TIMER_MULTIRUMBLE = 0x106, // Should not be possible
+	TPP1_TIMER_MULTIRUMBLE_RUMBLE = 0x107,
+	TPP1_BATTERY = 0x108,
+	TPP1_BATTERY_RUMBLE = 0x109,
+	TPP1_BATTERY_MULTIRUMBLE = 0x10A, // Should not be possible
+	TPP1_BATTERY_MULTIRUMBLE_RUMBLE = 0x10B,
+	TPP1_BATTERY_TIMER = 0x10C,
+	TPP1_BATTERY_TIMER_RUMBLE = 0x10D,
+	TPP1_BATTERY_TIMER_MULTIRUMBLE = 0x10E, // Should not be possible
+	TPP1_BATTERY_TIMER_MULTIRUMBLE_RUMBLE = 0x10F,
+
+	// Error values
+	MBC_NONE = UNSPECIFIED, // No MBC specified, do not act on it
+	MBC_BAD, // Specified MBC does not exist / syntax error
+	MBC_WRONG_FEATURES, // MBC incompatible with specified features
+	MBC_BAD_RANGE, // MBC number out of range
+};
+
+static void printAcceptedMBCNames(void)
+{
+	fputs("\tROM ($00) [aka ROM_ONLY]\n", stderr);
+	fputs("\tMBC1 ($01), MBC1+RAM ($02), MBC1+RAM+BATTERY ($03)\n", stderr);
+	fputs("\tMBC2 ($05), MBC2+BATTERY ($06)\n", stderr);
+	fputs("\tROM+RAM ($08) [deprecated], ROM+RAM+BATTERY ($09) [deprecated]\n", stderr);
+	fputs("\tMMM01 ($0B), MMM01+RAM ($0C), MMM01+RAM+BATTERY ($0D)\n", stderr);
+	fputs("\tMBC3+TIMER+BATTERY ($0F), MBC3+TIMER+RAM+BATTERY ($10)\n", stderr);
+	fputs("\tMBC3 ($11), MBC3+RAM ($12), MBC3+RAM+BATTERY ($13)\n", stderr);
+	fputs("\tMBC5 ($19), MBC5+RAM ($1A), MBC5+RAM+BATTERY ($1B)\n", stderr);
+	fputs("\tMBC5+RUMBLE ($1C), MBC5+RUMBLE+RAM ($1D), MBC5+RUMBLE+RAM+BATTERY ($1E)\n", stderr);
+	fputs("\tMBC6 ($20)\n", stderr);
+	fputs("\tMBC7+SENSOR+RUMBLE+RAM+BATTERY ($22)\n", stderr);
+	fputs("\tPOCKET_CAMERA ($FC)\n", stderr);
+	fputs("\tBANDAI_TAMA5 ($FD)\n", stderr);
+	fputs("\tHUC3 ($FE)\n", stderr);
+	fputs("\tHUC1+RAM+BATTERY ($FF)\n", stderr);
+
+	fputs("\n\tTPP1_1.0, TPP1_1.0+RUMBLE, TPP1_1.0+MULTIRUMBLE, TPP1_1.0+TIMER,\n", stderr);
+	fputs("\tTPP1_1.0+TIMER+RUMBLE, TPP1_1.0+TIMER+MULTIRUMBLE, TPP1_1.0+BATTERY,\n", stderr);
+	fputs("\tTPP1_1.0+BATTERY+RUMBLE, TPP1_1.0+BATTERY+MULTIRUMBLE,\n", stderr);
+	fputs("\tTPP1_1.0+BATTERY+TIMER, TPP1_1.0+BATTERY+TIMER+RUMBLE,\n", stderr);
+	fputs("\tTPP1_1.0+BATTERY+TIMER+MULTIRUMBLE\n", stderr);
+}
+
+static uint8_t tpp1Rev[2];
+
+/**
+ * @return False on failure
+ */
+static bool readMBCSlice(char const **name, char const *expected)
+{
+	while (*expected) {
+		char c = *(*name)++;
+
+		if (c == '\0') // Name too short
+			return false;
+
+		if (c >= 'a' && c <= 'z') // Perform the comparison case-insensitive
+			c = c - 'a' + 'A';
+		else if (c == '_') // Treat underscores as spaces
+			c = ' ';
+
+		if (c != *expected++)
+			return false;
+	}
+	return true;
+}
+
+static enum MbcType parseMBC(char const *name)
+{
+	if (!strcasecmp(name, "help")) {
+		fputs("Accepted MBC names:\n", stderr);
+		printAcceptedMBCNames();
+		exit(0);
+	}
+
+	if ((name[0] >= '0' && name[0] <= '9') || name[0] == '$') {
+		int base = 0;
+
+		if (name[0] == '$') {
+			name++;
+			base = 16;
+		}
+		// Parse number, and return it as-is (unless it's too large)
+		char *endptr;
+		unsigned long mbc = strtoul(name, &endptr, base);
+
+		if (*endptr)
+			return MBC_BAD;
+		if (mbc > 0xFF)
+			return MBC_BAD_RANGE;
+		return mbc;
+
+	} else {
+		// Begin by reading the MBC type:
+		uint16_t mbc;
+		char const *ptr = name;
+
+		// Trim off leading whitespace
+		while (*ptr == ' ' || *ptr == '\t')
+			ptr++;
+
+#define tryReadSlice(expected) \
+do { \
+	if (!readMBCSlice(&ptr, expected)) \
+		return MBC_BAD; \
+} while (0)
+
+		switch (*ptr++) {
+		case 'R': // ROM / ROM_ONLY
+		case 'r':
+			tryReadSlice("OM");
+			// Handle optional " ONLY"
+			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
+				ptr++;
+			if (*ptr == 'O' || *ptr == 'o') {
+				ptr++;
+				tryReadSlice("NLY");
+			}
+			mbc = ROM;
+			break;
+
+		case 'M': // MBC{1, 2, 3, 5, 6, 7} / MMM01
+		case 'm':
+			switch (*ptr++) {
+			case 'B':
+			case 'b':
+				switch (*ptr++) {
+				case 'C':
+				case 'c':
+					break;
+				default:
+					return MBC_BAD;
+				}
+				switch (*ptr++) {
+				case '1':
+					mbc = MBC1;
+					break;
+				case '2':
+					mbc = MBC2;
+					break;
+				case '3':
+					mbc = MBC3;
+					break;
+				case '5':
+					mbc = MBC5;
+					break;
+				case '6':
+					mbc = MBC6;
+					break;
+				case '7':
+					mbc = MBC7_SENSOR_RUMBLE_RAM_BATTERY;
+					break;
+				default:
+					return MBC_BAD;
+				}
+				break;
+			case 'M':
+			case 'm':
+				tryReadSlice("M01");
+				mbc = MMM01;
+				break;
+			default:
+				return MBC_BAD;
+			}
+			break;
+
+		case 'P': // POCKET_CAMERA
+		case 'p':
+			tryReadSlice("OCKET CAMERA");
+			mbc = POCKET_CAMERA;
+			break;
+
+		case 'B': // BANDAI_TAMA5
+		case 'b':
+			tryReadSlice("ANDAI TAMA5");
+			mbc = BANDAI_TAMA5;
+			break;
+
+		case 'T': // TAMA5 / TPP1
+		case 't':
+			switch (*ptr++) {
+			case 'A':
+				tryReadSlice("MA5");
+				mbc = BANDAI_TAMA5;
+				break;
+			case 'P':
+				tryReadSlice("P1");
+				// Parse version
+				while (*ptr == ' ' || *ptr == '_')
+					ptr++;
+				// Major
+				char *endptr;
+				unsigned long val = strtoul(ptr, &endptr, 10);
+
+				if (endptr == ptr) {
+					report("error: Failed to parse TPP1 major revision number\n");
+					return MBC_BAD;
+				}
+				ptr = endptr;
+				if (val != 1) {
+					report("error: RGBFIX only supports TPP1 versions 1.0\n");
+					return MBC_BAD;
+				}
+				tpp1Rev[0] = val;
+				tryReadSlice(".");
+				// Minor
+				val = strtoul(ptr, &endptr, 10);
+				if (endptr == ptr) {
+					report("error: Failed to parse TPP1 minor revision number\n");
+					return MBC_BAD;
+				}
+				ptr = endptr;
+				if (val > 0xFF) {
+					report("error: TPP1 minor revision number must be 8-bit\n");
+					return MBC_BAD;
+				}
+				tpp1Rev[1] = val;
+				mbc = TPP1;
+				break;
+			default:
+				return MBC_BAD;
+			}
+			break;
+
+		case 'H': // HuC{1, 3}
+		case 'h':
+			tryReadSlice("UC");
+			switch (*ptr++) {
+			case '1':
+				mbc = HUC1_RAM_BATTERY;
+				break;
+			case '3':
+				mbc = HUC3;
+				break;
+			default:
+				return MBC_BAD;
+			}
+			break;
+
+		default:
+			return MBC_BAD;
+		}
+
+		// Read "additional features"
+		uint8_t features = 0;
+#define RAM 0x80
+#define BATTERY 0x40
+#define TIMER 0x20
+#define RUMBLE 0x10
+#define SENSOR 0x08
+#define MULTIRUMBLE 0x04
+
+		for (;;) {
+			// Trim off trailing whitespace
+			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
+				ptr++;
+
+			// If done, start processing "features"
+			if (!*ptr)
+				break;
+			// We expect a '+' at this point
+			if (*ptr++ != '+')
+				return MBC_BAD;
+			// Trim off leading whitespace
+			while (*ptr == ' ' || *ptr == '\t' || *ptr == '_')
+				ptr++;
+
+			switch (*ptr++) {
+			case 'B': // BATTERY
+			case 'b':
+				tryReadSlice("ATTERY");
+				features |= BATTERY;
+				break;
+
+			case 'M':
+			case 'm':
+				tryReadSlice("ULTIRUMBLE");
+				features |= MULTIRUMBLE;
+				break;
+
+			case 'R': // RAM or RUMBLE
+			case 'r':
+				switch (*ptr++) {
+				case 'U':
+				case 'u':
+					tryReadSlice("MBLE");
+					features |= RUMBLE;
+					break;
+				case 'A':
+				case 'a':
+					if (*ptr != 'M' && *ptr != 'm')
+						return MBC_BAD;
+					ptr++;
+					features |= RAM;
+					break;
+				default:
+					return MBC_BAD;
+				}
+				break;
+
+			case 'S': // SENSOR
+			case 's':
+				tryReadSlice("ENSOR");
+				features |= SENSOR;
+				break;
+
+			case 'T': // TIMER
+			case 't':
+				tryReadSlice("IMER");
+				features |= TIMER;
+				break;
+
+			default:
+				return MBC_BAD;
+			}
+		}
+#undef tryReadSlice
+
+		switch (mbc) {
+		case ROM:
+			if (!features)
+				break;
+			mbc = ROM_RAM - 1;
+			static_assert(ROM_RAM + 1 == ROM_RAM_BATTERY, "Enum sanity check failed!");
+			static_assert(MBC1 + 1 == MBC1_RAM, "Enum sanity check failed!");
+			static_assert(MBC1 + 2 == MBC1_RAM_BATTERY, "Enum sanity check failed!");
+			static_assert(MMM01 + 1 == MMM01_RAM, "Enum sanity check failed!");
+			static_assert(MMM01 + 2 == MMM01_RAM_BATTERY, "Enum sanity check failed!");
+			// fallthrough
+		case MBC1:
+		case MMM01:
+			if (features == RAM)
+				mbc++;
+			else if (features == (RAM | BATTERY))
+				mbc += 2;
+			else if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC2:
+			if (features == BATTERY)
+				mbc = MBC2_BATTERY;
+			else if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC3:
+			// Handle timer, which also requires battery
+			if (features & (TIMER & BATTERY)) {
+				features &= ~(TIMER | BATTERY); // Reset those bits
+				mbc = MBC3_TIMER_BATTERY;
+				// RAM is handled below
+			}
+			static_assert(MBC3 + 1 == MBC3_RAM, "Enum sanity check failed!");
+			static_assert(MBC3 + 2 == MBC3_RAM_BATTERY, "Enum sanity check failed!");
+			static_assert(MBC3_TIMER_BATTERY + 1 == MBC3_TIMER_RAM_BATTERY,
+				      "Enum sanity check failed!");
+			if (features == RAM)
+				mbc++;
+			else if (features == (RAM | BATTERY))
+				mbc += 2;
+			else if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC5:
+			if (features & RUMBLE) {
+				features &= ~RUMBLE;
+				mbc = MBC5_RUMBLE;
+			}
+			static_assert(MBC5 + 1 == MBC5_RAM, "Enum sanity check failed!");
+			static_assert(MBC5 + 2 == MBC5_RAM_BATTERY, "Enum sanity check failed!");
+			static_assert(MBC5_RUMBLE + 1 == MBC5_RUMBLE_RAM, "Enum sanity check failed!");
+			static_assert(MBC5_RUMBLE + 2 == MBC5_RUMBLE_RAM_BATTERY,
+				      "Enum sanity check failed!");
+			if (features == RAM)
+				mbc++;
+			else if (features == (RAM | BATTERY))
+				mbc += 2;
+			else if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC6:
+		case POCKET_CAMERA:
+		case BANDAI_TAMA5:
+		case HUC3:
+			// No extra features accepted
+			if (features)
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
+			if (features != (SENSOR | RUMBLE | RAM | BATTERY))
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case HUC1_RAM_BATTERY:
+			if (features != (RAM | BATTERY)) // HuC1 expects RAM+BATTERY
+				return MBC_WRONG_FEATURES;
+			break;
+
+		case TPP1:
+			if (features & RAM)
+				fprintf(stderr,
+					"warning: TPP1 requests RAM implicitly if given a non-zero RAM size");
+			if (features & BATTERY)
+				mbc |= 0x08;
+			if (features & TIMER)
+				mbc |= 0x04;
+			if (features & MULTIRUMBLE)
+				mbc |= 0x03; // Also set the rumble flag
+			if (features & RUMBLE)
+				mbc |= 0x01;
+			if (features & SENSOR)
+				return MBC_WRONG_FEATURES;
+			break;
+		}
+
+		// Trim off trailing whitespace
+		while (*ptr == ' ' || *ptr == '\t')
+			ptr++;
+
+		// If there is still something past the whitespace, error out
+		if (*ptr)
+			return MBC_BAD;
+
+		return mbc;
+	}
+}
+
+static char const *mbcName(enum MbcType type)
+{
+	switch (type) {
+	case ROM:
+		return "ROM";
+	case ROM_RAM:
+		return "ROM+RAM";
+	case ROM_RAM_BATTERY:
+		return "ROM+RAM+BATTERY";
+	case MBC1:
+		return "MBC1";
+	case MBC1_RAM:
+		return "MBC1+RAM";
+	case MBC1_RAM_BATTERY:
+		return "MBC1+RAM+BATTERY";
+	case MBC2:
+		return "MBC2";
+	case MBC2_BATTERY:
+		return "MBC2+BATTERY";
+	case MMM01:
+		return "MMM01";
+	case MMM01_RAM:
+		return "MMM01+RAM";
+	case MMM01_RAM_BATTERY:
+		return "MMM01+RAM+BATTERY";
+	case MBC3:
+		return "MBC3";
+	case MBC3_TIMER_BATTERY:
+		return "MBC3+TIMER+BATTERY";
+	case MBC3_TIMER_RAM_BATTERY:
+		return "MBC3+TIMER+RAM+BATTERY";
+	case MBC3_RAM:
+		return "MBC3+RAM";
+	case MBC3_RAM_BATTERY:
+		return "MBC3+RAM+BATTERY";
+	case MBC5:
+		return "MBC5";
+	case MBC5_RAM:
+		return "MBC5+RAM";
+	case MBC5_RAM_BATTERY:
+		return "MBC5+RAM+BATTERY";
+	case MBC5_RUMBLE:
+		return "MBC5+RUMBLE";
+	case MBC5_RUMBLE_RAM:
+		return "MBC5+RUMBLE+RAM";
+	case MBC5_RUMBLE_RAM_BATTERY:
+		return "MBC5+RUMBLE+RAM+BATTERY";
+	case MBC6:
+		return "MBC6";
+	case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
+		return "MBC7+SENSOR+RUMBLE+RAM+BATTERY";
+	case POCKET_CAMERA:
+		return "POCKET CAMERA";
+	case BANDAI_TAMA5:
+		return "BANDAI TAMA5";
+	case HUC3:
+		return "HUC3";
+	case HUC1_RAM_BATTERY:
+		return "HUC1+RAM+BATTERY";
+	case TPP1:
+		return "TPP1";
+	case TPP1_RUMBLE:
+		return "TPP1+RUMBLE";
+	case TPP1_MULTIRUMBLE:
+	case TPP1_MULTIRUMBLE_RUMBLE:
+		return "TPP1+MULTIRUMBLE";
+	case TPP1_TIMER:
+		return "TPP1+TIMER";
+	case TPP1_TIMER_RUMBLE:
+		return "TPP1+TIMER+RUMBLE";
+	case TPP1_TIMER_MULTIRUMBLE:
+	case TPP1_TIMER_MULTIRUMBLE_RUMBLE:
+		return "TPP1+TIMER+MULTIRUMBLE";
+	case TPP1_BATTERY:
+		return "TPP1+BATTERY";
+	case TPP1_BATTERY_RUMBLE:
+		return "TPP1+BATTERY+RUMBLE";
+	case TPP1_BATTERY_MULTIRUMBLE:
+	case TPP1_BATTERY_MULTIRUMBLE_RUMBLE:
+		return "TPP1+BATTERY+MULTIRUMBLE";
+	case TPP1_BATTERY_TIMER:
+		return "TPP1+BATTERY+TIMER";
+	case TPP1_BATTERY_TIMER_RUMBLE:
+		return "TPP1+BATTERY+TIMER+RUMBLE";
+	case TPP1_BATTERY_TIMER_MULTIRUMBLE:
+	case TPP1_BATTERY_TIMER_MULTIRUMBLE_RUMBLE:
+		return "TPP1+BATTERY+TIMER+MULTIRUMBLE";
+
+	// Error values
+	case MBC_NONE:
+	case MBC_BAD:
+	case MBC_WRONG_FEATURES:
+	case MBC_BAD_RANGE:
+		unreachable_();
+	}
+
+	unreachable_();
+}
+
+static bool hasRAM(enum MbcType type)
+{
+	switch (type) {
+	case ROM:
+	case MBC1:
+	case MBC2: // Technically has RAM, but not marked as such
+	case MBC2_BATTERY:
+	case MMM01:
+	case MBC3:
+	case MBC3_TIMER_BATTERY:
+	case MBC5:
+	case MBC5_RUMBLE:
+	case MBC6: // TODO: not sure
+	case BANDAI_TAMA5: // TODO: not sure
+	case MBC_NONE:
+	case MBC_BAD:
+	case MBC_WRONG_FEATURES:
+	case MBC_BAD_RANGE:
+		return false;
+
+	case ROM_RAM:
+	case ROM_RAM_BATTERY:
+	case MBC1_RAM:
+	case MBC1_RAM_BATTERY:
+	case MMM01_RAM:
+	case MMM01_RAM_BATTERY:
+	case MBC3_TIMER_RAM_BATTERY:
+	case MBC3_RAM:
+	case MBC3_RAM_BATTERY:
+	case MBC5_RAM:
+	case MBC5_RAM_BATTERY:
+	case MBC5_RUMBLE_RAM:
+	case MBC5_RUMBLE_RAM_BATTERY:
+	case MBC7_SENSOR_RUMBLE_RAM_BATTERY:
+	case POCKET_CAMERA:
+	case HUC3:
+	case HUC1_RAM_BATTERY:
+		return true;
+
+	// TPP1 may or may not have RAM, don't call this function for it
+	case TPP1:
+	case TPP1_RUMBLE:
+	case TPP1_MULTIRUMBLE:
+	case TPP1_MULTIRUMBLE_RUMBLE:
+	case TPP1_TIMER:
+	case TPP1_TIMER_RUMBLE:
+	case TPP1_TIMER_MULTIRUMBLE:
+	case TPP1_TIMER_MULTIRUMBLE_RUMBLE:
+	case TPP1_BATTERY:
+	case TPP1_BATTERY_RUMBLE:
+	case TPP1_BATTERY_MULTIRUMBLE:
+	case TPP1_BATTERY_MULTIRUMBLE_RUMBLE:
+	case TPP1_BATTERY_TIMER:
+	case TPP1_BATTERY_TIMER_RUMBLE:
+	case TPP1_BATTERY_TIMER_MULTIRUMBLE:
+	case TPP1_BATTERY_TIMER_MULTIRUMBLE_RUMBLE:
+		break;
+	}
+
+	unreachable_();
+}
+
+static const uint8_t ninLogo[] = {
+	0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B,
+	0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
+	0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E,
+	0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
+	0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC,
+	0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E
+};
+
+static const uint8_t trashLogo[] = {
+	0xFF^0xCE, 0xFF^0xED, 0xFF^0x66, 0xFF^0x66, 0xFF^0xCC, 0xFF^0x0D, 0xFF^0x00, 0xFF^0x0B,
+	0xFF^0x03, 0xFF^0x73, 0xFF^0x00, 0xFF^0x83, 0xFF^0x00, 0xFF^0x0C, 0xFF^0x00, 0xFF^0x0D,
+	0xFF^0x00, 0xFF^0x08, 0xFF^0x11, 0xFF^0x1F, 0xFF^0x88, 0xFF^0x89, 0xFF^0x00, 0xFF^0x0E,
+	0xFF^0xDC, 0xFF^0xCC, 0xFF^0x6E, 0xFF^0xE6, 0xFF^0xDD, 0xFF^0xDD, 0xFF^0xD9, 0xFF^0x99,
+	0xFF^0xBB, 0xFF^0xBB, 0xFF^0x67, 0xFF^0x63, 0xFF^0x6E, 0xFF^0x0E, 0xFF^0xEC, 0xFF^0xCC,
+	0xFF^0xDD, 0xFF^0xDC, 0xFF^0x99, 0xFF^0x9F, 0xFF^0xBB, 0xFF^0xB9, 0xFF^0x33, 0xFF^0x3E
+};
+
+static enum { DMG, BOTH, CGB } model = DMG; // If DMG, byte is left alone
+#define   FIX_LOGO        0x80
+#define TRASH_LOGO        0x40
+#define   FIX_HEADER_SUM  0x20
+#define TRASH_HEADER_SUM  0x10
+#define   FIX_GLOBAL_SUM  0x08
+#define TRASH_GLOBAL_SUM  0x04
+static uint8_t fixSpec = 0;
+static const char *gameID = NULL;
+static uint8_t gameIDLen;
+static bool japanese = true;
+static const char *newLicensee = NULL;
+static uint8_t newLicenseeLen;
+static uint16_t oldLicensee = UNSPECIFIED;
+static enum MbcType cartridgeType = MBC_NONE;
+static uint16_t romVersion = UNSPECIFIED;
+static bool overwriteRom = false; // If false, warn when overwriting non-zero non-identical bytes
+static uint16_t padValue = UNSPECIFIED;
+static uint16_t ramSize = UNSPECIFIED;
+static bool sgb = false; // If false, SGB flags are left alone
+static const char *title = NULL;
+static uint8_t titleLen;
+
+static uint8_t maxTitleLen(void)
+{
+	return gameID ? 11 : model != DMG ? 15 : 16;
+}
+
+/**
+ * @param rom0 A pointer to rom0
+ * @param addr What address to check
+ * @param fixedByte The fixed byte at the address
+ * @param areaName Name to be displayed in the warning message
+ */
+static void overwriteByte(uint8_t *rom0, uint16_t addr, uint8_t fixedByte, char const *areaName)
+{
+	uint8_t origByte = rom0[addr];
+
+	if (!overwriteRom && origByte != 0 && origByte != fixedByte)
+		fprintf(stderr, "warning: Overwrote a non-zero byte in the %s\n", areaName);
+
+	rom0[addr] = fixedByte;
+}
+
+/**
+ * @param rom0 A pointer to rom0
+ * @param startAddr What address to begin checking from
+ * @param fixed The fixed bytes at the address
+ * @param size How many bytes to check
+ * @param areaName Name to be displayed in the warning message
+ */
+static void overwriteBytes(uint8_t *rom0, uint16_t startAddr, uint8_t const *fixed, uint8_t size,
+			   char const *areaName)
+{
+	if (!overwriteRom) {
+		for (uint8_t i = 0; i < size; i++) {
+			uint8_t origByte = rom0[i + startAddr];
+
+			if (origByte != 0 && origByte != fixed[i]) {
+				fprintf(stderr, "warning: Overwrote a non-zero byte in the %s\n",
+					areaName);
+				break;
+			}
+		}
+	}
+
+	memcpy(&rom0[startAddr], fixed, size);
+}
+
+/**
+ * Sums bytes modulo 65536, as the global checksum does.
+ * Bytes are processed 8 at a time: each byte pair of a word is added into one of four
+ * 16-bit lanes, which are only added together every 128 words, before they can overflow.
+ * @param data The bytes to sum
+ * @param len How many bytes to sum
+ * @return The sum, truncated to 16 bits
+ */
+uint16_t fix_SumBytes(uint8_t const *data, size_t len)
+{
+	uint16_t sum = 0;
+
+	while (len >= 8) {
+		size_t nbWords = len / 8 < 128 ? len / 8 : 128;
+		uint64_t lanes = 0;
+
+		for (size_t i = 0; i < nbWords; i++) {
+			uint64_t word;
+
+			memcpy(&word, &data[i * 8], sizeof(word));
+			lanes += (word & 0x00FF00FF00FF00FF) + (word >> 8 & 0x00FF00FF00FF00FF);
+		}
+		data += nbWords * 8;
+		len -= nbWords * 8;
+
+		lanes = (lanes & 0x0000FFFF0000FFFF) + (lanes >> 16 & 0x0000FFFF0000FFFF);
+		sum += lanes + (lanes >> 32);
+	}
+	while (len--)
+		sum += *data++;
+
+	return sum;
+}
+
+
+bool fix_ParseOption(int ch, char const *arg)
+{
+	switch (ch) {
+		size_t len;
+#define parseByte(output, name) \
+do { \
+	char *endptr; \
+	unsigned long tmp; \
+	\
+	if (arg[0] == 0) { \
+		report("error: Argument to option '" name "' may not be empty\n"); \
+	} else { \
+		if (arg[0] == '$') { \
+			tmp = strtoul(&arg[1], &endptr, 16); \
+		} else { \
+			tmp = strtoul(arg, &endptr, 0); \
+		} \
+		if (*endptr) \
+			report("error: Expected number as argument to option '" name "', got %s\n", \
+			       arg); \
+		else if (tmp > 0xFF) \
+			report("error: Argument to option '" name "' is larger than 255: %lu\n", tmp); \
+		else \
+			output = tmp; \
+	} \
+} while (0)
+
+	case 'C':
+	case 'c':
+		model = ch == 'c' ? BOTH : CGB;
+		if (titleLen > 15) {
+			titleLen = 15;
+			fprintf(stderr, "warning: Truncating title \"%s\" to 15 chars\n",
+				title);
+		}
+		break;
+
+	case 'f':
+		fixSpec = 0;
+		while (*arg) {
+			switch (*arg) {
+#define SPEC_l FIX_LOGO
+#define SPEC_L TRASH_LOGO
+#define SPEC_h FIX_HEADER_SUM
+#define SPEC_H TRASH_HEADER_SUM
+#define SPEC_g FIX_GLOBAL_SUM
+#define SPEC_G TRASH_GLOBAL_SUM
+#define overrideSpec(new, bad) \
+do { \
+	if (fixSpec & SPEC_##bad) \
+		fprintf(stderr, \
+			"warning: '" #new "' overriding '" #bad "' in fix spec\n"); \
+	fixSpec = (fixSpec & ~SPEC_##bad) | SPEC_##new; \
+} while (0)
+			case 'l':
+				overrideSpec(l, L);
+				break;
+			case 'L':
+				overrideSpec(L, l);
+				break;
+
+			case 'h':
+				overrideSpec(h, H);
+				break;
+			case 'H':
+				overrideSpec(H, h);
+				break;
+
+			case 'g':
+				overrideSpec(g, G);
+				break;
+			case 'G':
+				overrideSpec(G, g);
+				break;
+
+			default:
+				fprintf(stderr, "warning: Ignoring '%c' in fix spec\n",
+					*arg);
+#undef overrideSpec
+			}
+			arg++;
+		}
+		break;
+
+	case 'i':
+		gameID = arg;
+		len = strlen(gameID);
+		if (len > 4) {
+			len = 4;
+			fprintf(stderr, "warning: Truncating game ID \"%s\" to 4 chars\n",
+				gameID);
+		}
+		gameIDLen = len;
+		if (titleLen > 11) {
+			titleLen = 11;
+			fprintf(stderr, "warning: Truncating title \"%s\" to 11 chars\n",
+				title);
+		}
+		break;
+
+	case 'j':
+		japanese = false;
+		break;
+
+	case 'k':
+		newLicensee = arg;
+		len = strlen(newLicensee);
+		if (len > 2) {
+			len = 2;
+			fprintf(stderr,
+				"warning: Truncating new licensee \"%s\" to 2 chars\n",
+				newLicensee);
+		}
+		newLicenseeLen = len;
+		break;
+
+	case 'l':
+		parseByte(oldLicensee, "l");
+		break;
+
+	case 'm':
+		cartridgeType = parseMBC(arg);
+		if (cartridgeType == MBC_BAD) {
+			report("error: Unknown MBC \"%s\"\nAccepted MBC names:\n",
+			       arg);
+			printAcceptedMBCNames();
+		} else if (cartridgeType == MBC_WRONG_FEATURES) {
+			report("error: Features incompatible with MBC (\"%s\")\nAccepted combinations:\n",
+			       arg);
+			printAcceptedMBCNames();
+		} else if (cartridgeType == MBC_BAD_RANGE) {
+			report("error: Specified MBC ID out of range 0-255: %s\n",
+			       arg);
+		} else if (cartridgeType == ROM_RAM || cartridgeType == ROM_RAM_BATTERY) {
+			fprintf(stderr, "warning: ROM+RAM / ROM+RAM+BATTERY are under-specified and poorly supported\n");
+		}
+		break;
+
+	case 'n':
+		parseByte(romVersion, "n");
+		break;
+
+	case 'O':
+		overwriteRom = true;
+		break;
+
+	case 'p':
+		parseByte(padValue, "p");
+		break;
+
+	case 'r':
+		parseByte(ramSize, "r");
+		break;
+
+	case 's':
+		sgb = true;
+		break;
+
+	case 't':
+		title = arg;
+		len = strlen(title);
+		uint8_t maxLen = maxTitleLen();
+
+		if (len > maxLen) {
+			len = maxLen;
+			fprintf(stderr, "warning: Truncating title \"%s\" to %u chars\n",
+				title, maxLen);
+		}
+		titleLen = len;
+		break;
+
+	case 'v':
+		fixSpec = FIX_LOGO | FIX_HEADER_SUM | FIX_GLOBAL_SUM;
+		break;
+
+	default:
+		return false;
+	}
+#undef parseByte
+
+	return true;
+}
+
+bool fix_ParseArgs(char const *args)
+{
+	// Each argument takes at least one char, plus a separator
+	size_t maxArgs = strlen(args) / 2 + 2;
+	char **argv = malloc(sizeof(*argv) * (maxArgs + 1));
+	char *buf = malloc(strlen(args) + 1);
+	int argc = 0;
+
+	if (!argv || !buf) {
+		report("FATAL: Failed to allocate fix options: %s\n", strerror(errno));
+		goto cleanup;
+	}
+	// getopt prefixes its messages with this; parsing starts at index 1
+	argv[argc++] = "error: Fix options";
+
+	// Split the arguments at whitespace, honoring quotes
+	char *ptr = buf;
+
+	for (;;) {
+		while (isspace((unsigned char)*args))
+			args++;
+		if (!*args)
+			break;
+
+		char quote = 0;
+
+		argv[argc++] = ptr;
+		for (; *args && (quote || !isspace((unsigned char)*args)); args++) {
+			if (*args == quote)
+				quote = 0;
+			else if (!quote && (*args == '"' || *args == '\''))
+				quote = *args;
+			else
+				*ptr++ = *args;
+		}
+		*ptr++ = '\0';
+		if (quote) {
+			report("error: Unterminated %c quote in fix options\n", quote);
+			goto cleanup;
+		}
+	}
+	argv[argc] = NULL;
+
+	int ch;
+
+	musl_optreset = 1;
+	while ((ch = musl_getopt_long_only(argc, argv, optstring, longopts, NULL)) != -1) {
+		// Only fails on getopt's '?', which it has already reported
+		if (!fix_ParseOption(ch, musl_optarg))
+			countError();
+	}
+	if (musl_optind < argc)
+		report("error: Unexpected argument \"%s\" in fix options\n", argv[musl_optind]);
+
+cleanup:
+	// Options that take strings point into the buffer, so it has to be kept around
+	free(argv);
+	return !nbErrors;
+}
+
+bool fix_CheckOptions(void)
+{
+	if ((cartridgeType & 0xFF00) == TPP1 && !japanese)
+		fprintf(stderr, "warning: TPP1 overwrites region flag for its identification code, ignoring `-j`\n");
+
+	// Check that RAM size is correct for "standard" mappers
+	if (ramSize != UNSPECIFIED && (cartridgeType & 0xFF00) == 0) {
+		if (cartridgeType == ROM_RAM || cartridgeType == ROM_RAM_BATTERY) {
+			if (ramSize != 1)
+				fprintf(stderr, "warning: MBC \"%s\" should have 2kiB of RAM (-r 1)\n",
+					mbcName(cartridgeType));
+		} else if (hasRAM(cartridgeType)) {
+			if (!ramSize) {
+				fprintf(stderr,
+					"warning: MBC \"%s\" has RAM, but RAM size was set to 0\n",
+					mbcName(cartridgeType));
+			} else if (ramSize == 1) {
+				fprintf(stderr,
+					"warning: RAM size 1 (2 kiB) was specified for MBC \"%s\"\n",
+					mbcName(cartridgeType));
+			} // TODO: check possible values?
+		} else if (ramSize) {
+			fprintf(stderr,
+				"warning: MBC \"%s\" has no RAM, but RAM size was set to %u\n",
+				mbcName(cartridgeType), ramSize);
+		}
+	}
+
+	if (sgb && oldLicensee != UNSPECIFIED && oldLicensee != 0x33)
+		fprintf(stderr,
+			"warning: SGB compatibility enabled, but old licensee is %#x, not 0x33\n",
+			oldLicensee);
+
+	return !nbErrors;
+}
+
+uint16_t fix_HeaderSize(void)
+{
+	return (cartridgeType & 0xFF00) == TPP1 ? 0x154 : 0x150;
+}
+
+void fix_Header(uint8_t *rom0)
+{
+	if (fixSpec & (FIX_LOGO | TRASH_LOGO)) {
+		if (fixSpec & FIX_LOGO)
+			overwriteBytes(rom0, 0x0104, ninLogo, sizeof(ninLogo), "Nintendo logo");
+		else
+			overwriteBytes(rom0, 0x0104, trashLogo, sizeof(trashLogo), "Nintendo logo");
+	}
+
+	if (title)
+		overwriteBytes(rom0, 0x134, (const uint8_t *)title, titleLen, "title");
+
+	if (gameID)
+		overwriteBytes(rom0, 0x13F, (const uint8_t *)gameID, gameIDLen, "manufacturer code");
+
+	if (model != DMG)
+		overwriteByte(rom0, 0x143, model == BOTH ? 0x80 : 0xC0, "CGB flag");
+
+	if (newLicensee)
+		overwriteBytes(rom0, 0x144, (const uint8_t *)newLicensee, newLicenseeLen,
+			       "new licensee code");
+
+	if (sgb)
+		overwriteByte(rom0, 0x146, 0x03, "SGB flag");
+
+	// If a valid MBC was specified...
+	if (cartridgeType < MBC_NONE) {
+		uint8_t byte = cartridgeType;
+
+		if ((cartridgeType & 0xFF00) == TPP1) {
+			// Cartridge type isn't directly actionable, translate it
+			byte = 0xBC;
+			// The other TPP1 identification bytes will be written below
+		}
+		overwriteByte(rom0, 0x147, byte, "cartridge type");
+	}
+
+	// ROM size will be written last, after evaluating the file's size
+
+	if ((cartridgeType & 0xFF00) == TPP1) {
+		uint8_t const tpp1Code[2] = {0xC1, 0x65};
+
+		overwriteBytes(rom0, 0x149, tpp1Code, sizeof(tpp1Code), "TPP1 identification code");
+
+		overwriteBytes(rom0, 0x150, tpp1Rev, sizeof(tpp1Rev), "TPP1 revision number");
+
+		if (ramSize != UNSPECIFIED)
+			overwriteByte(rom0, 0x152, ramSize, "RAM size");
+
+		overwriteByte(rom0, 0x153, cartridgeType & 0xFF, "TPP1 feature flags");
+	} else {
+		// Regular mappers
+
+		if (ramSize != UNSPECIFIED)
+			overwriteByte(rom0, 0x149, ramSize, "RAM size");
+
+		if (!japanese)
+			overwriteByte(rom0, 0x14A, 0x01, "destination code");
+	}
+
+	if (oldLicensee != UNSPECIFIED)
+		overwriteByte(rom0, 0x14B, oldLicensee, "old licensee code");
+
+	if (romVersion != UNSPECIFIED)
+		overwriteByte(rom0, 0x14C, romVersion, "mask ROM version number");
+}
+
+bool fix_Pad(uint8_t *rom0, size_t *rom0Len, size_t romxLen, uint8_t *padByte, size_t *padLen)
+{
+	// Pad to the next valid power of 2. This is because padding is required by flashers, which
+	// flash to ROM chips, whose size is always a power of 2... so there'd be no point in
+	// padding to something else.
+	// Additionally, a ROM must be at least 32k, so we guarantee a whole amount of banks...
+	if (padValue == UNSPECIFIED)
+		return false;
+
+	uint32_t nbBanks = 1 + (romxLen + (BANK_SIZE - 1)) / BANK_SIZE; // Including ROM0
+
+	// We want at least 2 banks
+	if (nbBanks == 1) {
+		if (*rom0Len != BANK_SIZE) {
+			memset(&rom0[*rom0Len], padValue, BANK_SIZE - *rom0Len);
+			// ROM0 was padded, so treat it as entirely written: update its size
+			*rom0Len = BANK_SIZE;
+		}
+		nbBanks = 2;
+	} else {
+		assert(*rom0Len == BANK_SIZE);
+	}
+	// Alter number of banks to reflect required value
+	// x&(x-1) is zero iff x is a power of 2, or 0; we know for sure it's non-zero,
+	// so this is true (non-zero) when we don't have a power of 2
+	if (nbBanks & (nbBanks - 1))
+		nbBanks = 1 << (CHAR_BIT * sizeof(nbBanks) - clz(nbBanks));
+	// Write final ROM size
+	rom0[0x148] = ctz(nbBanks / 2);
+
+	*padByte = padValue;
+	*padLen = (size_t)(nbBanks - 1) * BANK_SIZE - romxLen; // Don't count ROM0!
+	return true;
+}
+
+void fix_HeaderSum(uint8_t *rom0)
+{
+	if (fixSpec & (FIX_HEADER_SUM | TRASH_HEADER_SUM)) {
+		uint8_t sum = 0;
+
+		for (uint16_t i = 0x134; i < 0x14D; i++)
+			sum -= rom0[i] + 1;
+
+		overwriteByte(rom0, 0x14D, fixSpec & TRASH_HEADER_SUM ? ~sum : sum,
+			      "header checksum");
+	}
+}
+
+bool fix_WantsGlobalSum(void)
+{
+	return fixSpec & (FIX_GLOBAL_SUM | TRASH_GLOBAL_SUM);
+}
+
+void fix_GlobalSum(uint8_t *rom0, size_t rom0Len, uint16_t romxSum)
+{
+	if (!fix_WantsGlobalSum())
+		return;
+
+	// Computation of the global checksum does not include the checksum bytes
+	assert(rom0Len >= 0x150);
+	uint16_t globalSum = romxSum + fix_SumBytes(rom0, 0x14E)
+			     + fix_SumBytes(&rom0[0x150], rom0Len - 0x150);
+
+	if (fixSpec & TRASH_GLOBAL_SUM)
+		globalSum = ~globalSum;
+
+	uint8_t bytes[2] = {globalSum >> 8, globalSum & 0xFF};
+
+	overwriteBytes(rom0, 0x14E, bytes, sizeof(bytes), "global checksum");
+}
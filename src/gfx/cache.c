@@ -0,0 +1,252 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2013-2018, stag019 and RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gfx/cache.h"
+
+#include "platform.h" /* HAVE_FORK */
+
+#if HAVE_FORK
+# include <unistd.h>
+#endif
+
+/*
+ * Conversion results are stored in the cache directory as `<key>.<ext>`, one
+ * file per output. The key hashes the input file's bytes, which include the
+ * pixels, the palette and any options saved in the PNG, along with every
+ * command-line option that affects the outputs. `<key>.done` is written last,
+ * so that an interrupted store is never mistaken for a complete entry.
+ */
+enum CacheOutput {
+	CACHE_TILES,
+	CACHE_TILEMAP,
+	CACHE_ATTRMAP,
+	CACHE_PALETTE,
+
+	NB_CACHE_OUTPUTS
+};
+
+static char const * const cache_exts[NB_CACHE_OUTPUTS] = {
+	[CACHE_TILES]   = "bin",
+	[CACHE_TILEMAP] = "tilemap",
+	[CACHE_ATTRMAP] = "attrmap",
+	[CACHE_PALETTE] = "pal",
+};
+
+/* Extensions of the outputs that can be named after the input file */
+static char const * const derived_exts[NB_CACHE_OUTPUTS] = {
+	[CACHE_TILES]   = NULL,
+	[CACHE_TILEMAP] = ".tilemap",
+	[CACHE_ATTRMAP] = ".attrmap",
+	[CACHE_PALETTE] = ".pal",
+};
+
+static char *output_name(const struct Options *opts, enum CacheOutput output)
+{
+	switch (output) {
+	case CACHE_TILES:
+		return opts->outfile;
+	case CACHE_TILEMAP:
+		return opts->tilemapfile;
+	case CACHE_ATTRMAP:
+		return opts->attrmapfile;
+	case CACHE_PALETTE:
+		return opts->palfile;
+	case NB_CACHE_OUTPUTS:
+		break;
+	}
+	return NULL;
+}
+
+static char *cache_file_name(const struct Options *opts, char const *key,
+			     char const *ext)
+{
+	size_t len = strlen(opts->cachedir) + 1 + CACHE_KEY_LEN + 1
+		     + strlen(ext) + 1;
+	char *name = malloc(len);
+
+	if (!name)
+		err(1, "%s: Failed to allocate memory for cache file name",
+		    __func__);
+	snprintf(name, len, "%s/%s.%s", opts->cachedir, key, ext);
+	return name;
+}
+
+/* FNV-1a */
+static uint64_t hash_bytes(uint64_t hash, uint8_t const *bytes, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ bytes[i]) * 0x100000001B3;
+	return hash;
+}
+
+void cache_key(const struct Options *opts, char key[CACHE_KEY_LEN + 1])
+{
+	/* Bump the version whenever the outputs for a given input change */
+	uint8_t settings[] = {
+		1, /* Version */
+		depth,
+		opts->unique,
+		opts->mirror,
+		opts->trim & 0xFF,
+		opts->trim >> 8 & 0xFF,
+		opts->trim >> 16 & 0xFF,
+		opts->trim >> 24 & 0xFF,
+		opts->horizontal,
+		opts->colorcurve,
+		*opts->outfile != '\0',
+		*opts->tilemapfile != '\0' || opts->tilemapout,
+		*opts->attrmapfile != '\0' || opts->attrmapout,
+		*opts->palfile != '\0' || opts->palout,
+	};
+	uint64_t hash = hash_bytes(0xCBF29CE484222325, settings,
+				   sizeof(settings));
+	FILE *f = fopen(opts->infile, "rb");
+	uint8_t buf[4096];
+	size_t len;
+
+	if (!f)
+		err(1, "Opening input png file '%s' failed", opts->infile);
+	while ((len = fread(buf, 1, sizeof(buf), f)) != 0)
+		hash = hash_bytes(hash, buf, len);
+	if (ferror(f))
+		err(1, "Reading input png file '%s' failed", opts->infile);
+	fclose(f);
+
+	snprintf(key, CACHE_KEY_LEN + 1, "%016" PRIx64, hash);
+}
+
+/*
+ * Copy a file's contents to another
+ * Returns false on failure, setting `*missing` if the source doesn't exist
+ */
+static bool copy_file(char const *from, char const *to, bool *missing)
+{
+	FILE *in = fopen(from, "rb");
+	FILE *out;
+	uint8_t buf[4096];
+	size_t len;
+	bool ok = true;
+
+	*missing = !in && errno == ENOENT;
+	if (!in)
+		return false;
+	out = fopen(to, "wb");
+	if (!out) {
+		fclose(in);
+		return false;
+	}
+	while ((len = fread(buf, 1, sizeof(buf), in)) != 0) {
+		if (fwrite(buf, 1, len, out) != len) {
+			ok = false;
+			break;
+		}
+	}
+	if (ferror(in))
+		ok = false;
+	fclose(in);
+	if (fclose(out) != 0)
+		ok = false;
+	return ok;
+}
+
+bool cache_fetch(const struct Options *opts, char const *key)
+{
+	char *done_name = cache_file_name(opts, key, "done");
+	FILE *done = fopen(done_name, "rb");
+	bool missing;
+
+	free(done_name);
+	if (!done)
+		return false;
+	fclose(done);
+
+	/*
+	 * The key tells which outputs were requested, but not the names that
+	 * the PNG's own options picked, since the PNG is not read. Those
+	 * outputs are named after the input file, as if by `-T`, `-A` or `-P`.
+	 */
+	for (enum CacheOutput i = 0; i < NB_CACHE_OUTPUTS; i++) {
+		char *cached_name = cache_file_name(opts, key, cache_exts[i]);
+		char *name = output_name(opts, i);
+		char *derived_name = NULL;
+
+		if (!*name && derived_exts[i])
+			name = derived_name = derived_file_name(opts->infile,
+								derived_exts[i]);
+		if (!copy_file(cached_name, name, &missing) && !missing)
+			err(1, "%s: Copying cached file '%s' to '%s' failed",
+			    __func__, cached_name, name);
+		free(cached_name);
+		free(derived_name);
+	}
+	return true;
+}
+
+/*
+ * Store a file in the cache, or an empty one if `from` is NULL
+ * It is written under a temporary name first, since jobs converting
+ * identical images may store the same entry at the same time
+ */
+static bool store_cache_file(const struct Options *opts, char const *key,
+			     char const *ext, char const *from)
+{
+	char tmp_ext[32];
+	char *cached_name = cache_file_name(opts, key, ext);
+	char *tmp_name;
+	bool missing;
+	bool ok;
+
+#if HAVE_FORK
+	snprintf(tmp_ext, sizeof(tmp_ext), "tmp%ld", (long)getpid());
+#else
+	snprintf(tmp_ext, sizeof(tmp_ext), "tmp");
+#endif
+	tmp_name = cache_file_name(opts, key, tmp_ext);
+
+	if (from) {
+		ok = copy_file(from, tmp_name, &missing);
+	} else {
+		FILE *f = fopen(tmp_name, "wb");
+
+		ok = f && fclose(f) == 0;
+	}
+	/* Windows refuses to replace an existing entry, which is just as good */
+	if (ok && rename(tmp_name, cached_name) != 0 && errno != EEXIST)
+		ok = false;
+	remove(tmp_name);
+
+	free(tmp_name);
+	free(cached_name);
+	return ok;
+}
+
+void cache_store(const struct Options *opts, char const *key)
+{
+	bool ok = true;
+
+	for (enum CacheOutput i = 0; ok && i < NB_CACHE_OUTPUTS; i++) {
+		char const *name = output_name(opts, i);
+
+		if (*name)
+			ok = store_cache_file(opts, key, cache_exts[i], name);
+	}
+	if (ok)
+		ok = store_cache_file(opts, key, "done", NULL);
+
+	/* The cache is only an optimization, so failing to fill it is not an error */
+	if (!ok)
+		warn("Failed to store '%s' in cache directory '%s'",
+		     opts->infile, opts->cachedir);
+}
@@ -6,57 +6,93 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <errno.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "gfx/gb.h"
 
-void transpose_tiles(struct GBImage *gb, int width)
+/*
+ * Gathers one bit of each of 8 pixels into a bitplane byte, leftmost pixel
+ * in bit 7. The pixels are loaded as one 64-bit word; isolating the wanted
+ * bit of each byte and multiplying by a "diagonal" constant moves them all
+ * into the top byte at once, without any carries.
+ */
+static uint8_t pixels_to_plane(uint64_t pixels, unsigned int bit)
 {
-	uint8_t *newdata;
-	int i;
-	int newbyte;
-
-	newdata = calloc(gb->size, 1);
-	if (!newdata)
-		err(1, "%s: Failed to allocate memory for new data", __func__);
-
-	for (i = 0; i < gb->size; i++) {
-		newbyte = i / (8 * depth) * width * 8 * depth;
-		newbyte = newbyte % gb->size
-			+ 8 * depth * (newbyte / gb->size)
-			+ i % (8 * depth);
-		newdata[newbyte] = gb->data[i];
-	}
-
-	free(gb->data);
-
-	gb->data = newdata;
+	return ((pixels >> bit) & 0x0101010101010101) * 0x8040201008040201
+		>> 56;
 }
 
-void raw_to_gb(const struct RawIndexedImage *raw_image, struct GBImage *gb)
+/* Converts the image rows `y` to `y + nb_rows - 1`, held in `rows` */
+static void rows_to_gb(const struct RawIndexedImage *raw_image,
+		       uint8_t * const *rows, unsigned int y,
+		       unsigned int nb_rows, struct GBImage *gb)
 {
-	int x, y, byte;
-	uint8_t index;
-
-	for (y = 0; y < raw_image->height; y++) {
-		for (x = 0; x < raw_image->width; x++) {
-			index = raw_image->data[y][x];
-			index &= (1 << depth) - 1;
-
-			byte = y * depth
-				+ x / 8 * raw_image->height / 8 * 8 * depth;
-			gb->data[byte] |= (index & 1) << (7 - x % 8);
-			if (depth == 2) {
-				gb->data[byte + 1] |=
-					(index >> 1) << (7 - x % 8);
-			}
+	unsigned int nb_cols = raw_image->width / 8;
+	unsigned int nb_tile_rows = (raw_image->height + 7) / 8;
+	unsigned int tile_size = 8 * depth;
+
+	/*
+	 * Tiles are written directly in their final order: row-major, or
+	 * column-major with `-h`.
+	 */
+	for (unsigned int end = y + nb_rows; y < end; y++) {
+		uint8_t const *row = *rows++;
+
+		for (unsigned int col = 0; col < nb_cols; col++) {
+			uint8_t const *px = &row[col * 8];
+			unsigned int tile = gb->horizontal
+				? col * nb_tile_rows + y / 8
+				: y / 8 * nb_cols + col;
+			uint8_t *dest = &gb->data[tile * tile_size
+						  + y % 8 * depth];
+			uint64_t pixels = (uint64_t)px[0]
+					| (uint64_t)px[1] << 8
+					| (uint64_t)px[2] << 16
+					| (uint64_t)px[3] << 24
+					| (uint64_t)px[4] << 32
+					| (uint64_t)px[5] << 40
+					| (uint64_t)px[6] << 48
+					| (uint64_t)px[7] << 56;
+
+			dest[0] = pixels_to_plane(pixels, 0);
+			if (depth == 2)
+				dest[1] = pixels_to_plane(pixels, 1);
 		}
 	}
+}
+
+void raw_to_gb(struct RawIndexedImage *raw_image, struct GBImage *gb)
+{
+	uint8_t *strip[8];
+	unsigned int nb_rows;
+
+	if (raw_image->data) {
+		rows_to_gb(raw_image, raw_image->data, 0, raw_image->height,
+			   gb);
+		return;
+	}
+
+	/* Decode the image one strip of tiles at a time */
+	for (int i = 0; i < 8; i++) {
+		strip[i] = malloc(raw_image->width);
+		if (!strip[i])
+			err(1, "%s: Failed to allocate memory for image strip",
+			    __func__);
+	}
+
+	for (unsigned int y = 0; y < raw_image->height; y += nb_rows) {
+		nb_rows = raw_image->height - y < 8 ? raw_image->height - y : 8;
+		read_raw_image_rows(raw_image, strip, nb_rows);
+		rows_to_gb(raw_image, strip, y, nb_rows, gb);
+	}
 
-	if (!gb->horizontal)
-		transpose_tiles(gb, raw_image->width / 8);
+	for (int i = 0; i < 8; i++)
+		free(strip[i]);
 }
 
 void output_file(const struct Options *opts, const struct GBImage *gb)
@@ -73,38 +109,14 @@ void output_file(const struct Options *opts, const struct GBImage *gb)
 	fclose(f);
 }
 
-int get_tile_index(uint8_t *tile, uint8_t **tiles, int num_tiles, int tile_size)
-{
-	int i, j;
-
-	for (i = 0; i < num_tiles; i++) {
-		for (j = 0; j < tile_size; j++) {
-			if (tile[j] != tiles[i][j])
-				break;
-		}
-
-		if (j >= tile_size)
-			return i;
-	}
-	return -1;
-}
-
 uint8_t reverse_bits(uint8_t b)
 {
-	uint8_t rev = 0;
-
-	rev |= (b & 0x80) >> 7;
-	rev |= (b & 0x40) >> 5;
-	rev |= (b & 0x20) >> 3;
-	rev |= (b & 0x10) >> 1;
-	rev |= (b & 0x08) << 1;
-	rev |= (b & 0x04) << 3;
-	rev |= (b & 0x02) << 5;
-	rev |= (b & 0x01) << 7;
-	return rev;
+	b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+	b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+	return (b & 0xAA) >> 1 | (b & 0x55) << 1;
 }
 
-void xflip(uint8_t *tile, uint8_t *tile_xflip, int tile_size)
+void xflip(uint8_t const *tile, uint8_t *tile_xflip, int tile_size)
 {
 	int i;
 
@@ -112,7 +124,7 @@ void xflip(uint8_t *tile, uint8_t *tile_xflip, int tile_size)
 		tile_xflip[i] = reverse_bits(tile[i]);
 }
 
-void yflip(uint8_t *tile, uint8_t *tile_yflip, int tile_size)
+void yflip(uint8_t const *tile, uint8_t *tile_yflip, int tile_size)
 {
 	int i;
 
@@ -121,63 +133,214 @@ void yflip(uint8_t *tile, uint8_t *tile_yflip, int tile_size)
 }
 
 /*
- * get_mirrored_tile_index looks for `tile` in tile array `tiles`, also
- * checking x-, y-, and xy-mirrored versions of `tile`. If one is found,
- * `*flags` is set according to the type of mirroring and the index of the
- * matched tile is returned. If no match is found, -1 is returned.
+ * Unique tiles are looked up by content in an open-addressing hash table.
+ * With mirroring enabled, each kept tile also registers its Y-, X- and
+ * XY-flipped variants, in the order they used to be searched in, so that
+ * a single lookup yields both the matching tile and the flags to apply.
+ * Entries refer to tiles by index, so the tile set can keep growing.
  */
-int get_mirrored_tile_index(uint8_t *tile, uint8_t **tiles, int num_tiles,
-			    int tile_size, int *flags)
-{
+struct TileEntry {
+	bool used;
+	uint32_t hash;
 	int index;
-	uint8_t *tile_xflip;
-	uint8_t *tile_yflip;
+	int flags;
+};
 
-	index = get_tile_index(tile, tiles, num_tiles, tile_size);
-	if (index >= 0) {
-		*flags = 0;
-		return index;
+static uint32_t hash_tile(uint8_t const *tile, int tile_size)
+{
+	/* FNV-1a */
+	uint32_t hash = 0x811C9DC5;
+
+	for (int i = 0; i < tile_size; i++)
+		hash = (hash ^ tile[i]) * 16777619;
+	return hash;
+}
+
+static uint8_t const *entry_tile(struct TileSet const *set,
+				 struct TileEntry const *entry)
+{
+	switch (entry->flags) {
+	case 0:
+		return &set->tiles[entry->index * set->tile_size];
+	case YFLIP:
+		return &set->flips[entry->index * 3 * set->tile_size];
+	case XFLIP:
+		return &set->flips[(entry->index * 3 + 1) * set->tile_size];
+	default:
+		return &set->flips[(entry->index * 3 + 2) * set->tile_size];
 	}
+}
 
-	tile_yflip = malloc(tile_size);
-	if (!tile_yflip)
-		err(1, "%s: Failed to allocate memory for Y flip of tile",
-		    __func__);
-	yflip(tile, tile_yflip, tile_size);
-	index = get_tile_index(tile_yflip, tiles, num_tiles, tile_size);
-	if (index >= 0) {
-		*flags = YFLIP;
-		free(tile_yflip);
-		return index;
+static struct TileEntry *find_tile_slot(struct TileSet const *set,
+					uint8_t const *tile, uint32_t hash)
+{
+	for (uint32_t i = hash & set->mask; ; i = (i + 1) & set->mask) {
+		struct TileEntry *entry = &set->entries[i];
+
+		if (!entry->used || (entry->hash == hash
+		 && !memcmp(entry_tile(set, entry), tile, set->tile_size)))
+			return entry;
 	}
+}
 
-	tile_xflip = malloc(tile_size);
-	if (!tile_xflip)
-		err(1, "%s: Failed to allocate memory for X flip of tile",
+/* Keeps the load factor at or below 1/2 */
+static void grow_tile_table(struct TileSet *set, uint32_t nb_keys)
+{
+	struct TileEntry *old_entries = set->entries;
+	uint32_t old_size = set->entries ? set->mask + 1 : 0;
+	uint32_t size = old_size ? old_size : 16;
+
+	while (size < nb_keys * 2)
+		size *= 2;
+	if (size == old_size)
+		return;
+
+	set->entries = calloc(size, sizeof(*set->entries));
+	if (!set->entries)
+		err(1, "%s: Failed to allocate memory for tile table",
 		    __func__);
-	xflip(tile, tile_xflip, tile_size);
-	index = get_tile_index(tile_xflip, tiles, num_tiles, tile_size);
-	if (index >= 0) {
-		*flags = XFLIP;
-		free(tile_yflip);
-		free(tile_xflip);
-		return index;
+	set->mask = size - 1;
+
+	for (uint32_t i = 0; i < old_size; i++) {
+		struct TileEntry const *old = &old_entries[i];
+		uint32_t j = old->hash & set->mask;
+
+		if (!old->used)
+			continue;
+		while (set->entries[j].used)
+			j = (j + 1) & set->mask;
+		set->entries[j] = *old;
 	}
+	free(old_entries);
+}
 
-	yflip(tile_xflip, tile_yflip, tile_size);
-	index = get_tile_index(tile_yflip, tiles, num_tiles, tile_size);
-	if (index >= 0)
-		*flags = XFLIP | YFLIP;
+/* Registers a kept tile's variant unless an identical tile was registered earlier */
+static void add_tile(struct TileSet *set, int index, int flags)
+{
+	struct TileEntry key = { .used = true, .index = index, .flags = flags };
+	uint8_t const *tile = entry_tile(set, &key);
+	struct TileEntry *entry;
+
+	grow_tile_table(set, set->nb_keys + 1);
+	key.hash = hash_tile(tile, set->tile_size);
+	entry = find_tile_slot(set, tile, key.hash);
+	if (entry->used)
+		return;
+	*entry = key;
+	set->nb_keys++;
+}
 
-	free(tile_yflip);
-	free(tile_xflip);
+/* Appends `tile` to the set, even if it is already in it, and returns its index */
+static int keep_tile(struct TileSet *set, uint8_t const *tile)
+{
+	int tile_size = set->tile_size;
+	int index = set->num_tiles;
+
+	if (set->num_tiles == set->max_tiles) {
+		set->max_tiles = set->max_tiles ? set->max_tiles * 2 : 64;
+		set->tiles = realloc(set->tiles, set->max_tiles * tile_size);
+		if (!set->tiles)
+			err(1, "%s: Failed to allocate memory for tiles",
+			    __func__);
+		if (set->mirror) {
+			set->flips = realloc(set->flips,
+					     set->max_tiles * 3 * tile_size);
+			if (!set->flips)
+				err(1, "%s: Failed to allocate memory for tile flips",
+				    __func__);
+		}
+	}
+	memcpy(&set->tiles[index * tile_size], tile, tile_size);
+	set->num_tiles++;
+
+	add_tile(set, index, 0);
+	if (set->mirror) {
+		uint8_t *tile_yflip = &set->flips[index * 3 * tile_size];
+		uint8_t *tile_xflip = tile_yflip + tile_size;
+		uint8_t *tile_xyflip = tile_xflip + tile_size;
+
+		yflip(tile, tile_yflip, tile_size);
+		xflip(tile, tile_xflip, tile_size);
+		yflip(tile_xflip, tile_xyflip, tile_size);
+		add_tile(set, index, YFLIP);
+		add_tile(set, index, XFLIP);
+		add_tile(set, index, XFLIP | YFLIP);
+	}
 	return index;
 }
 
+void init_tileset(struct TileSet *set, bool mirror, int expected_tiles)
+{
+	memset(set, 0, sizeof(*set));
+	set->tile_size = 8 * depth;
+	set->mirror = mirror;
+
+	/* Allocate room for the expected tiles up front */
+	set->max_tiles = expected_tiles > 0 ? expected_tiles : 1;
+	set->tiles = malloc(set->max_tiles * set->tile_size);
+	if (!set->tiles)
+		err(1, "%s: Failed to allocate memory for tiles", __func__);
+	if (mirror) {
+		set->flips = malloc(set->max_tiles * 3 * set->tile_size);
+		if (!set->flips)
+			err(1, "%s: Failed to allocate memory for tile flips",
+			    __func__);
+	}
+	grow_tile_table(set, mirror ? set->max_tiles * 4 : set->max_tiles);
+}
+
+void load_tileset(struct TileSet *set, char const *filename)
+{
+	FILE *f = fopen(filename, "rb");
+	uint8_t tile[8 * 2];
+
+	/* A tileset that doesn't exist yet starts out empty */
+	if (!f) {
+		if (errno == ENOENT)
+			return;
+		err(1, "%s: Opening tileset file '%s' failed", __func__,
+		    filename);
+	}
+
+	/* Keep the file's tiles as they are, so their indices don't change */
+	size_t len;
+
+	while ((len = fread(tile, 1, set->tile_size, f)) == (size_t)set->tile_size)
+		keep_tile(set, tile);
+	if (ferror(f))
+		err(1, "%s: Reading tileset file '%s' failed", __func__,
+		    filename);
+	if (len != 0)
+		errx(1, "Tileset file '%s' is not a whole number of %d-byte tiles",
+		     filename, set->tile_size);
+	fclose(f);
+}
+
+void output_tileset_file(const struct TileSet *set, char const *filename)
+{
+	FILE *f;
+
+	f = fopen(filename, "wb");
+	if (!f)
+		err(1, "%s: Opening tileset file '%s' failed", __func__,
+		    filename);
+
+	fwrite(set->tiles, 1, set->num_tiles * set->tile_size, f);
+	fclose(f);
+}
+
+void free_tileset(struct TileSet *set)
+{
+	free(set->tiles);
+	free(set->flips);
+	free(set->entries);
+}
+
 void create_mapfiles(const struct Options *opts, struct GBImage *gb,
-		     struct Mapfile *tilemap, struct Mapfile *attrmap)
+		     struct Mapfile *tilemap, struct Mapfile *attrmap,
+		     struct TileSet *tileset)
 {
-	int i, j;
+	int i;
 	int gb_i;
 	int tile_size;
 	int max_tiles;
@@ -185,8 +348,8 @@ void create_mapfiles(const struct Options *opts, struct GBImage *gb,
 	int index;
 	int flags;
 	int gb_size;
-	uint8_t *tile;
-	uint8_t **tiles;
+	uint8_t tile[8 * 2];
+	struct TileSet image_tileset;
 
 	tile_size = sizeof(*tile) * depth * 8;
 	gb_size = gb->size - (gb->trim * tile_size);
@@ -196,9 +359,11 @@ void create_mapfiles(const struct Options *opts, struct GBImage *gb,
 	if (gb_size > max_tiles * tile_size)
 		max_tiles++;
 
-	tiles = calloc(max_tiles, sizeof(*tiles));
-	if (!tiles)
-		err(1, "%s: Failed to allocate memory for tiles", __func__);
+	/* Without a shared tileset, the image's unique tiles get their own */
+	if (opts->unique && !tileset) {
+		init_tileset(&image_tileset, opts->mirror, max_tiles);
+		tileset = &image_tileset;
+	}
 	num_tiles = 0;
 
 	if (*opts->tilemapfile) {
@@ -220,42 +385,36 @@ void create_mapfiles(const struct Options *opts, struct GBImage *gb,
 	gb_i = 0;
 	while (gb_i < gb_size) {
 		flags = 0;
-		tile = malloc(tile_size);
-		if (!tile)
-			err(1, "%s: Failed to allocate memory for tile",
-			    __func__);
-		/*
-		 * If the input image doesn't fill the last tile,
-		 * `gb_i` will reach `gb_size`.
-		 */
-		for (i = 0; i < tile_size && gb_i < gb_size; i++) {
-			tile[i] = gb->data[gb_i];
-			gb_i++;
-		}
-		if (opts->unique) {
-			if (opts->mirror) {
-				index = get_mirrored_tile_index(tile, tiles,
-								num_tiles,
-								tile_size,
-								&flags);
+		if (tileset) {
+			uint32_t hash;
+			struct TileEntry const *entry;
+
+			/*
+			 * If the input image doesn't fill the last tile,
+			 * `gb_i` will reach `gb_size`; pad it with zeros.
+			 */
+			memset(tile, 0, tile_size);
+			for (i = 0; i < tile_size && gb_i < gb_size; i++)
+				tile[i] = gb->data[gb_i++];
+
+			hash = hash_tile(tile, tile_size);
+			entry = find_tile_slot(tileset, tile, hash);
+			if (entry->used) {
+				index = entry->index;
+				flags = entry->flags;
 			} else {
-				index = get_tile_index(tile, tiles, num_tiles,
-						       tile_size);
-			}
-
-			if (index < 0) {
-				index = num_tiles;
-				tiles[num_tiles] = tile;
-				num_tiles++;
-			} else {
-				free(tile);
+				index = keep_tile(tileset, tile);
 			}
 		} else {
+			gb_i += tile_size;
 			index = num_tiles;
-			tiles[num_tiles] = tile;
 			num_tiles++;
 		}
 		if (*opts->tilemapfile) {
+			/* Indices past 255 would wrap around in the tilemap */
+			if (index > 0xFF && tileset && tileset != &image_tileset)
+				errx(1, "Shared tileset grew past 256 tiles while converting '%s', its tilemap cannot index them",
+				     opts->infile);
 			tilemap->data[tilemap->size] = index;
 			tilemap->size++;
 		}
@@ -265,24 +424,13 @@ void create_mapfiles(const struct Options *opts, struct GBImage *gb,
 		}
 	}
 
-	if (opts->unique) {
+	if (tileset == &image_tileset) {
 		free(gb->data);
-		gb->data = malloc(tile_size * num_tiles);
-		if (!gb->data)
-			err(1, "%s: Failed to allocate memory for tile data",
-			    __func__);
-		for (i = 0; i < num_tiles; i++) {
-			tile = tiles[i];
-			for (j = 0; j < tile_size; j++)
-				gb->data[i * tile_size + j] = tile[j];
-		}
-		gb->size = i * tile_size;
+		gb->data = image_tileset.tiles;
+		gb->size = image_tileset.num_tiles * tile_size;
+		image_tileset.tiles = NULL;
+		free_tileset(&image_tileset);
 	}
-
-	for (i = 0; i < num_tiles; i++)
-		free(tiles[i]);
-
-	free(tiles);
 }
 
 void output_tilemap_file(const struct Options *opts,
@@ -297,9 +445,6 @@ void output_tilemap_file(const struct Options *opts,
 
 	fwrite(tilemap->data, 1, tilemap->size, f);
 	fclose(f);
-
-	if (opts->tilemapout)
-		free(opts->tilemapfile);
 }
 
 void output_attrmap_file(const struct Options *opts,
@@ -314,9 +459,6 @@ void output_attrmap_file(const struct Options *opts,
 
 	fwrite(attrmap->data, 1, attrmap->size, f);
 	fclose(f);
-
-	if (opts->attrmapout)
-		free(opts->attrmapfile);
 }
 
 /*
@@ -380,7 +522,4 @@ void output_palette_file(const struct Options *opts,
 		fwrite(cur_bytes, 2, 1, f);
 	}
 	fclose(f);
-
-	if (opts->palout)
-		free(opts->palfile);
 }
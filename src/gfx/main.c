@@ -7,18 +7,25 @@
  */
 
 #include <png.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "gfx/main.h"
 
 #include "extern/getopt.h"
+#include "jobs.h"
+#include "platform.h" /* HAVE_FORK */
 #include "version.h"
 
+#if HAVE_FORK
+# include <sys/wait.h>
+#endif
+
 int depth, colors;
 
 /* Short options */
-static char const *optstring = "Aa:CDd:Ffhmo:Pp:Tt:uVvx:";
+static char const *optstring = "Aa:B:Cc:Dd:Ffhj:mo:Pp:s:Tt:uVvx:";
 
 /*
  * Equivalent long options
@@ -33,16 +40,20 @@ static char const *optstring = "Aa:CDd:Ffhmo:Pp:Tt:uVvx:";
 static struct option const longopts[] = {
 	{ "output-attr-map", no_argument,       NULL, 'A' },
 	{ "attr-map",        required_argument, NULL, 'a' },
+	{ "batch",           required_argument, NULL, 'B' },
 	{ "color-curve",     no_argument,       NULL, 'C' },
+	{ "cache",           required_argument, NULL, 'c' },
 	{ "debug",           no_argument,       NULL, 'D' },
 	{ "depth",           required_argument, NULL, 'd' },
 	{ "fix",             no_argument,       NULL, 'f' },
 	{ "fix-and-save",    no_argument,       NULL, 'F' },
 	{ "horizontal",      no_argument,       NULL, 'h' },
+	{ "jobs",            required_argument, NULL, 'j' },
 	{ "mirror-tiles",    no_argument,       NULL, 'm' },
 	{ "output",          required_argument, NULL, 'o' },
 	{ "output-palette",  no_argument,       NULL, 'P' },
 	{ "palette",         required_argument, NULL, 'p' },
+	{ "shared-tiles",    required_argument, NULL, 's' },
 	{ "output-tilemap",  no_argument,       NULL, 'T' },
 	{ "tilemap",         required_argument, NULL, 't' },
 	{ "unique-tiles",    no_argument,       NULL, 'u' },
@@ -55,13 +66,19 @@ static struct option const longopts[] = {
 static void print_usage(void)
 {
 	fputs(
-"Usage: rgbgfx [-CDhmuVv] [-f | -F] [-a <attr_map> | -A] [-d <depth>]\n"
-"              [-o <out_file>] [-p <pal_file> | -P] [-t <tile_map> | -T]\n"
+"Usage: rgbgfx [-CDhmuVv] [-f | -F] [-a <attr_map> | -A] [-c <cache_dir>]\n"
+"              [-d <depth>] [-o <out_file>] [-p <pal_file> | -P] [-t <tile_map> | -T]\n"
 "              [-x <tiles>] <file>\n"
+"       rgbgfx -s <tileset> [options] <file> ...\n"
+"       rgbgfx -B <manifest> [-j <jobs>] [options]\n"
 "Useful options:\n"
+"    -B, --batch <manifest>    convert each image listed in the manifest\n"
+"    -c, --cache <dir>         reuse earlier conversions of identical images\n"
 "    -f, --fix                 make the input image an indexed PNG\n"
+"    -j, --jobs <count>        convert this many images at once with -B\n"
 "    -m, --mirror-tiles        optimize out mirrored tiles\n"
 "    -o, --output <path>       set the output binary file\n"
+"    -s, --shared-tiles <path> add the images' tiles to a shared tileset\n"
 "    -t, --tilemap <path>      set the output tilemap file\n"
 "    -u, --unique-tiles        optimize out identical tiles\n"
 "    -V, --version             print RGBGFX version and exit\n"
@@ -71,288 +88,582 @@ static void print_usage(void)
 	exit(1);
 }
 
-int main(int argc, char *argv[])
+/*
+ * Name an output file after the input file, replacing its extension if any
+ */
+char *derived_file_name(char const *infile, char const *ext)
 {
-	int ch, size;
-	struct Options opts = {0};
-	struct ImageOptions png_options = {0};
-	struct RawIndexedImage *raw_image;
-	struct GBImage gb = {0};
-	struct Mapfile tilemap = {0};
-	struct Mapfile attrmap = {0};
-	char *ext;
+	char const *dot = strrchr(infile, '.');
+	size_t len = dot ? (size_t)(dot - infile) : strlen(infile);
+	char *name = malloc(len + strlen(ext) + 1);
+
+	if (!name)
+		err(1, "%s: Failed to allocate memory for file name", __func__);
+	memcpy(name, infile, len);
+	strcpy(&name[len], ext);
+	return name;
+}
 
-	opts.tilemapfile = "";
-	opts.attrmapfile = "";
-	opts.palfile = "";
-	opts.outfile = "";
+/* Set by `-B`, `-j` and `-s`; `nb_jobs` is 0 if `-j` was not given */
+static char const *manifest_name;
+static unsigned long nb_jobs;
+static char const *tileset_name;
 
-	depth = 2;
+/*
+ * Parse options into `opts`, leaving `musl_optind` on the first non-option argument
+ * Returns false if an option is invalid
+ */
+static bool parse_options(int argc, char *argv[], struct Options *opts)
+{
+	int ch;
+	char *ep;
 
 	while ((ch = musl_getopt_long_only(argc, argv, optstring, longopts,
 					   NULL)) != -1) {
 		switch (ch) {
 		case 'A':
-			opts.attrmapout = true;
+			opts->attrmapout = true;
 			break;
 		case 'a':
-			opts.attrmapfile = musl_optarg;
+			opts->attrmapfile = musl_optarg;
+			break;
+		case 'B':
+			manifest_name = musl_optarg;
 			break;
 		case 'C':
-			opts.colorcurve = true;
+			opts->colorcurve = true;
+			break;
+		case 'c':
+			opts->cachedir = musl_optarg;
 			break;
 		case 'D':
-			opts.debug = true;
+			opts->debug = true;
 			break;
 		case 'd':
 			depth = strtoul(musl_optarg, NULL, 0);
 			break;
 		case 'F':
-			opts.hardfix = true;
+			opts->hardfix = true;
 			/* fallthrough */
 		case 'f':
-			opts.fix = true;
+			opts->fix = true;
 			break;
 		case 'h':
-			opts.horizontal = true;
+			opts->horizontal = true;
+			break;
+		case 'j':
+			nb_jobs = strtoul(musl_optarg, &ep, 0);
+			if (musl_optarg[0] == '\0' || *ep != '\0')
+				errx(1, "Invalid argument for option 'j'");
+			if (nb_jobs == 0 || nb_jobs > JOBS_MAX)
+				errx(1, "Argument for option 'j' must be between 1 and %d", JOBS_MAX);
 			break;
 		case 'm':
-			opts.mirror = true;
-			opts.unique = true;
+			opts->mirror = true;
+			opts->unique = true;
 			break;
 		case 'o':
-			opts.outfile = musl_optarg;
+			opts->outfile = musl_optarg;
 			break;
 		case 'P':
-			opts.palout = true;
+			opts->palout = true;
 			break;
 		case 'p':
-			opts.palfile = musl_optarg;
+			opts->palfile = musl_optarg;
+			break;
+		case 's':
+			tileset_name = musl_optarg;
+			opts->unique = true;
 			break;
 		case 'T':
-			opts.tilemapout = true;
+			opts->tilemapout = true;
 			break;
 		case 't':
-			opts.tilemapfile = musl_optarg;
+			opts->tilemapfile = musl_optarg;
 			break;
 		case 'u':
-			opts.unique = true;
+			opts->unique = true;
 			break;
 		case 'V':
 			printf("rgbgfx %s\n", get_package_version_string());
 			exit(0);
 		case 'v':
-			opts.verbose = true;
+			opts->verbose = true;
 			break;
 		case 'x':
-			opts.trim = strtoul(musl_optarg, NULL, 0);
+			opts->trim = strtoul(musl_optarg, NULL, 0);
 			break;
 		default:
-			print_usage();
-			/* NOTREACHED */
+			return false;
 		}
 	}
-	argc -= musl_optind;
-	argv += musl_optind;
+	return true;
+}
 
-	if (argc == 0) {
-		fputs("FATAL: no input files\n", stderr);
-		print_usage();
-	}
+/*
+ * Convert `opts->infile` as requested by `opts`
+ * If `tileset` is not NULL, the image's tiles are looked up and added there
+ * Any error aborts the process
+ */
+static void convert_image(struct Options *opts, struct TileSet *tileset)
+{
+	struct ImageOptions png_options = {0};
+	struct RawIndexedImage *raw_image;
+	struct GBImage gb = {0};
+	struct Mapfile tilemap = {0};
+	struct Mapfile attrmap = {0};
+	bool own_tilemapfile, own_attrmapfile, own_palfile;
+	char key[CACHE_KEY_LEN + 1];
+	/* Writing the PNG back, or sharing tiles, needs it to be read */
+	bool cached = *opts->cachedir && !opts->fix && !opts->debug && !tileset;
 
 #define WARN_MISMATCH(property) \
 	warnx("The PNG's " property \
 	      " setting doesn't match the one defined on the command line")
 
-	opts.infile = argv[argc - 1];
-
 	if (depth != 1 && depth != 2)
 		errx(1, "Depth option must be either 1 or 2.");
 
 	colors = 1 << depth;
 
-	raw_image = input_png_file(&opts, &png_options);
+	if (cached) {
+		cache_key(opts, key);
+		if (cache_fetch(opts, key))
+			return;
+	}
+
+	raw_image = input_png_file(opts, &png_options);
 
 	png_options.tilemapfile = "";
 	png_options.attrmapfile = "";
 	png_options.palfile = "";
 
-	if (png_options.horizontal != opts.horizontal) {
-		if (opts.verbose)
+	if (png_options.horizontal != opts->horizontal) {
+		if (opts->verbose)
 			WARN_MISMATCH("horizontal");
 
-		if (opts.hardfix)
-			png_options.horizontal = opts.horizontal;
+		if (opts->hardfix)
+			png_options.horizontal = opts->horizontal;
 	}
 
 	if (png_options.horizontal)
-		opts.horizontal = png_options.horizontal;
+		opts->horizontal = png_options.horizontal;
 
-	if (png_options.trim != opts.trim) {
-		if (opts.verbose)
+	if (png_options.trim != opts->trim) {
+		if (opts->verbose)
 			WARN_MISMATCH("trim");
 
-		if (opts.hardfix)
-			png_options.trim = opts.trim;
+		if (opts->hardfix)
+			png_options.trim = opts->trim;
 	}
 
 	if (png_options.trim)
-		opts.trim = png_options.trim;
+		opts->trim = png_options.trim;
 
 	if (raw_image->width % 8) {
 		errx(1, "Input PNG file %s not sized correctly. The image's width must be a multiple of 8.",
-		     opts.infile);
+		     opts->infile);
 	}
 	if (raw_image->width / 8 > 1 && raw_image->height % 8) {
 		errx(1, "Input PNG file %s not sized correctly. If the image is more than 1 tile wide, its height must be a multiple of 8.",
-		     opts.infile);
+		     opts->infile);
 	}
 
-	if (opts.trim &&
-	    opts.trim > (raw_image->width / 8) * (raw_image->height / 8) - 1) {
+	if (opts->trim &&
+	    opts->trim > (raw_image->width / 8) * (raw_image->height / 8) - 1) {
 		errx(1, "Trim (%d) for input raw_image file '%s' too large (max: %u)",
-		     opts.trim, opts.infile,
+		     opts->trim, opts->infile,
 		     (raw_image->width / 8) * (raw_image->height / 8) - 1);
 	}
 
-	if (strcmp(png_options.tilemapfile, opts.tilemapfile) != 0) {
-		if (opts.verbose)
+	if (strcmp(png_options.tilemapfile, opts->tilemapfile) != 0) {
+		if (opts->verbose)
 			WARN_MISMATCH("tilemap file");
 
-		if (opts.hardfix)
-			png_options.tilemapfile = opts.tilemapfile;
+		if (opts->hardfix)
+			png_options.tilemapfile = opts->tilemapfile;
 	}
-	if (!*opts.tilemapfile)
-		opts.tilemapfile = png_options.tilemapfile;
+	if (!*opts->tilemapfile)
+		opts->tilemapfile = png_options.tilemapfile;
 
-	if (png_options.tilemapout != opts.tilemapout) {
-		if (opts.verbose)
+	if (png_options.tilemapout != opts->tilemapout) {
+		if (opts->verbose)
 			WARN_MISMATCH("tilemap file");
 
-		if (opts.hardfix)
-			png_options.tilemapout = opts.tilemapout;
+		if (opts->hardfix)
+			png_options.tilemapout = opts->tilemapout;
 	}
 	if (png_options.tilemapout)
-		opts.tilemapout = png_options.tilemapout;
+		opts->tilemapout = png_options.tilemapout;
 
-	if (strcmp(png_options.attrmapfile, opts.attrmapfile) != 0) {
-		if (opts.verbose)
+	if (strcmp(png_options.attrmapfile, opts->attrmapfile) != 0) {
+		if (opts->verbose)
 			WARN_MISMATCH("attrmap file");
 
-		if (opts.hardfix)
-			png_options.attrmapfile = opts.attrmapfile;
+		if (opts->hardfix)
+			png_options.attrmapfile = opts->attrmapfile;
 	}
-	if (!*opts.attrmapfile)
-		opts.attrmapfile = png_options.attrmapfile;
+	if (!*opts->attrmapfile)
+		opts->attrmapfile = png_options.attrmapfile;
 
-	if (png_options.attrmapout != opts.attrmapout) {
-		if (opts.verbose)
+	if (png_options.attrmapout != opts->attrmapout) {
+		if (opts->verbose)
 			WARN_MISMATCH("attrmap file");
 
-		if (opts.hardfix)
-			png_options.attrmapout = opts.attrmapout;
+		if (opts->hardfix)
+			png_options.attrmapout = opts->attrmapout;
 	}
 	if (png_options.attrmapout)
-		opts.attrmapout = png_options.attrmapout;
+		opts->attrmapout = png_options.attrmapout;
 
-	if (strcmp(png_options.palfile, opts.palfile) != 0) {
-		if (opts.verbose)
+	if (strcmp(png_options.palfile, opts->palfile) != 0) {
+		if (opts->verbose)
 			WARN_MISMATCH("palette file");
 
-		if (opts.hardfix)
-			png_options.palfile = opts.palfile;
+		if (opts->hardfix)
+			png_options.palfile = opts->palfile;
 	}
-	if (!*opts.palfile)
-		opts.palfile = png_options.palfile;
+	if (!*opts->palfile)
+		opts->palfile = png_options.palfile;
 
-	if (png_options.palout != opts.palout) {
-		if (opts.verbose)
+	if (png_options.palout != opts->palout) {
+		if (opts->verbose)
 			WARN_MISMATCH("palette file");
 
-		if (opts.hardfix)
-			png_options.palout = opts.palout;
+		if (opts->hardfix)
+			png_options.palout = opts->palout;
 	}
 
 #undef WARN_MISMATCH
 
 	if (png_options.palout)
-		opts.palout = png_options.palout;
+		opts->palout = png_options.palout;
 
-	if (!*opts.tilemapfile && opts.tilemapout) {
-		ext = strrchr(opts.infile, '.');
+	own_tilemapfile = !*opts->tilemapfile && opts->tilemapout;
+	if (own_tilemapfile)
+		opts->tilemapfile = derived_file_name(opts->infile, ".tilemap");
 
-		if (ext != NULL) {
-			size = ext - opts.infile + 9;
-			opts.tilemapfile = malloc(size);
-			strncpy(opts.tilemapfile, opts.infile, size);
-			*strrchr(opts.tilemapfile, '.') = '\0';
-			strcat(opts.tilemapfile, ".tilemap");
-		} else {
-			opts.tilemapfile = malloc(strlen(opts.infile) + 9);
-			strcpy(opts.tilemapfile, opts.infile);
-			strcat(opts.tilemapfile, ".tilemap");
-		}
-	}
+	own_attrmapfile = !*opts->attrmapfile && opts->attrmapout;
+	if (own_attrmapfile)
+		opts->attrmapfile = derived_file_name(opts->infile, ".attrmap");
+
+	own_palfile = !*opts->palfile && opts->palout;
+	if (own_palfile)
+		opts->palfile = derived_file_name(opts->infile, ".pal");
+
+	gb.size = raw_image->width * raw_image->height * depth / 8;
+	gb.data = calloc(gb.size, 1);
+	gb.trim = opts->trim;
+	gb.horizontal = opts->horizontal;
+
+	/* Writing the PNG back requires the whole image, otherwise stream it */
+	if (opts->fix || opts->debug)
+		load_raw_image(raw_image);
+
+	raw_to_gb(raw_image, &gb);
+	if (*opts->outfile || *opts->tilemapfile || *opts->attrmapfile || tileset)
+		create_mapfiles(opts, &gb, &tilemap, &attrmap, tileset);
+
+	if (*opts->outfile)
+		output_file(opts, &gb);
+
+	if (*opts->tilemapfile)
+		output_tilemap_file(opts, &tilemap);
+
+	if (*opts->attrmapfile)
+		output_attrmap_file(opts, &attrmap);
+
+	if (*opts->palfile)
+		output_palette_file(opts, raw_image);
+
+	if (opts->fix || opts->debug)
+		output_png_file(opts, &png_options, raw_image);
 
-	if (!*opts.attrmapfile && opts.attrmapout) {
-		ext = strrchr(opts.infile, '.');
+	if (cached)
+		cache_store(opts, key);
 
-		if (ext != NULL) {
-			size = ext - opts.infile + 9;
-			opts.attrmapfile = malloc(size);
-			strncpy(opts.attrmapfile, opts.infile, size);
-			*strrchr(opts.attrmapfile, '.') = '\0';
-			strcat(opts.attrmapfile, ".attrmap");
+	destroy_raw_image(&raw_image);
+	free(gb.data);
+
+}
+
+struct BatchEntry {
+	char *infile;
+	char *outfile;
+	int argc;
+	char **argv; /* `argv[0]` is a placeholder, as getopt expects */
+	unsigned int line_no;
+};
+
+/*
+ * Read the manifest, each of whose lines is `<file> <out_file> [options]`
+ * Blank lines and lines starting with `#` are ignored
+ * The manifest is kept in memory, since the entries point into it
+ */
+static struct BatchEntry *read_manifest(char const *name, unsigned int *nb_entries)
+{
+	FILE *f = strcmp(name, "-") ? fopen(name, "rb") : stdin;
+	size_t size = 0, capacity = 4096;
+	char *contents = malloc(capacity);
+	size_t nb_read;
+
+	if (!f)
+		err(1, "Failed to open manifest \"%s\"", name);
+	if (!contents)
+		err(1, "Failed to allocate manifest");
+	while ((nb_read = fread(&contents[size], 1, capacity - size - 1, f)) != 0) {
+		size += nb_read;
+		if (size == capacity - 1) {
+			capacity *= 2;
+			contents = realloc(contents, capacity);
+			if (!contents)
+				err(1, "Failed to allocate manifest");
+		}
+	}
+	if (ferror(f))
+		err(1, "Failed to read manifest \"%s\"", name);
+	if (f != stdin)
+		fclose(f);
+	contents[size] = '\0';
+
+	struct BatchEntry *entries = NULL;
+	unsigned int nb_alloced = 0;
+	unsigned int line_no = 0;
+	char *line = contents;
+
+	*nb_entries = 0;
+	while (*line) {
+		char *end = strchr(line, '\n');
+
+		if (end)
+			*end++ = '\0';
+		else
+			end = &line[strlen(line)];
+		line_no++;
+
+		/* Split the line into words; there is at most one per two chars */
+		char **words = malloc(sizeof(*words) * (strlen(line) / 2 + 3));
+		int nb_words = 1;
+
+		if (!words)
+			err(1, "Failed to allocate batch entry");
+		words[0] = "rgbgfx";
+		for (char *word = strtok(line, " \t\r"); word; word = strtok(NULL, " \t\r"))
+			words[nb_words++] = word;
+		words[nb_words] = NULL;
+
+		if (nb_words == 1 || words[1][0] == '#') {
+			free(words);
+		} else if (nb_words < 3) {
+			errx(1, "%s(%u): Batch entry must be of the form <file> <out_file> [options]",
+			     name, line_no);
 		} else {
-			opts.attrmapfile = malloc(strlen(opts.infile) + 9);
-			strcpy(opts.attrmapfile, opts.infile);
-			strcat(opts.attrmapfile, ".attrmap");
+			if (*nb_entries == nb_alloced) {
+				nb_alloced = nb_alloced ? nb_alloced * 2 : 64;
+				entries = realloc(entries, sizeof(*entries) * nb_alloced);
+				if (!entries)
+					err(1, "Failed to allocate batch entries");
+			}
+
+			struct BatchEntry *entry = &entries[(*nb_entries)++];
+
+			entry->infile = words[1];
+			entry->outfile = words[2];
+			/* Options go right after the placeholder */
+			words[2] = words[0];
+			entry->argc = nb_words - 2;
+			entry->argv = &words[2];
+			entry->line_no = line_no;
 		}
+		line = end;
 	}
+	return entries;
+}
 
-	if (!*opts.palfile && opts.palout) {
-		ext = strrchr(opts.infile, '.');
+/*
+ * Convert a batch entry, starting from the command line's options
+ * Like a standalone conversion, any error aborts the process
+ */
+static void convert_entry(struct BatchEntry const *entry, struct Options const *defaults,
+			  int default_depth)
+{
+	struct Options opts = *defaults;
+
+	depth = default_depth;
+	manifest_name = NULL;
+	nb_jobs = 0;
+	tileset_name = NULL;
+	musl_optreset = 1;
+	if (!parse_options(entry->argc, entry->argv, &opts))
+		errx(1, "Invalid option in batch entry for %s", entry->infile);
+	if (manifest_name || nb_jobs || tileset_name)
+		errx(1, "Batch entries cannot use -B, -j or -s");
+	if (*opts.outfile)
+		errx(1, "Batch entries cannot use -o, the output file is the entry's second word");
+	if (musl_optind != entry->argc)
+		errx(1, "Unexpected argument \"%s\" in batch entry for %s",
+		     entry->argv[musl_optind], entry->infile);
+
+	opts.infile = entry->infile;
+	opts.outfile = entry->outfile;
+	convert_image(&opts, NULL);
+}
 
-		if (ext != NULL) {
-			size = ext - opts.infile + 5;
-			opts.palfile = malloc(size);
-			strncpy(opts.palfile, opts.infile, size);
-			*strrchr(opts.palfile, '.') = '\0';
-			strcat(opts.palfile, ".pal");
-		} else {
-			opts.palfile = malloc(strlen(opts.infile) + 5);
-			strcpy(opts.palfile, opts.infile);
-			strcat(opts.palfile, ".pal");
-		}
+/* What each batch entry needs to be converted, for `jobs_Run` */
+struct BatchContext {
+	struct BatchEntry const *entries;
+	struct Options const *defaults;
+	int default_depth;
+};
+
+#if HAVE_FORK
+/* The entry being converted by this process, until it is done */
+static struct BatchEntry const *job_entry;
+
+static void report_job_failure(void)
+{
+	/* Runs before stderr is flushed, so the entry's messages are kept together */
+	if (job_entry)
+		fprintf(stderr, "error: %s: Conversion failed\n", job_entry->infile);
+}
+#endif
+
+/*
+ * Convert an entry of the batch
+ * Conversions report errors by aborting, so each entry is converted in a process
+ * of its own, whose exit only ends that entry; without `fork`, it ends the batch
+ * Returns false if the entry failed to convert
+ */
+static bool convert_batch_entry(uint32_t entry_id, void *arg)
+{
+	struct BatchContext const *context = arg;
+	struct BatchEntry const *entry = &context->entries[entry_id];
+
+#if HAVE_FORK
+	/* Don't let the conversion inherit unflushed output */
+	fflush(stdout);
+	fflush(stderr);
+
+	pid_t pid = fork();
+	int status;
+
+	if (pid == -1)
+		err(1, "Failed to start conversion of %s", entry->infile);
+	if (pid == 0) {
+		/* Buffer diagnostics, so that each entry's are printed in one go */
+		static char err_buf[1 << 12];
+
+		setvbuf(stderr, err_buf, _IOFBF, sizeof(err_buf));
+		job_entry = entry;
+		atexit(report_job_failure);
+		convert_entry(entry, context->defaults, context->default_depth);
+		job_entry = NULL;
+		exit(0);
 	}
+	if (waitpid(pid, &status, 0) == -1)
+		err(1, "Failed to wait for conversion of %s", entry->infile);
+	/* Conversions that exited report their own failure */
+	if (!WIFEXITED(status))
+		fprintf(stderr, "error: %s: Conversion aborted\n", entry->infile);
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#else
+	convert_entry(entry, context->defaults, context->default_depth);
+	return true;
+#endif
+}
 
-	gb.size = raw_image->width * raw_image->height * depth / 8;
-	gb.data = calloc(gb.size, 1);
-	gb.trim = opts.trim;
-	gb.horizontal = opts.horizontal;
+/*
+ * Convert every image listed in the manifest
+ * Errors in one image do not prevent converting the next ones, except on
+ * platforms without `fork`, where the first error ends the batch
+ */
+static int convert_batch(struct Options const *defaults)
+{
+	unsigned int nb_entries;
+	struct BatchEntry *entries = read_manifest(manifest_name, &nb_entries);
+	struct BatchContext context = {
+		.entries = entries, .defaults = defaults, .default_depth = depth
+	};
+	uint32_t nb_failed = jobs_Run(nb_entries, nb_jobs ? nb_jobs : 1, convert_batch_entry,
+				      &context);
+
+	if (nb_failed != 0)
+		errx(1, "%" PRIu32 " of %u images failed to convert", nb_failed, nb_entries);
+	return 0;
+}
+
+/*
+ * Convert each image, deduplicating their tiles against the shared tileset
+ * The tileset file is read first if it exists, and its tiles keep their indices
+ */
+static int convert_shared(struct Options const *defaults, int nb_images, char *images[])
+{
+	struct TileSet tileset;
 
-	if (*opts.outfile || *opts.tilemapfile || *opts.attrmapfile) {
-		raw_to_gb(raw_image, &gb);
-		create_mapfiles(&opts, &gb, &tilemap, &attrmap);
+	if (*defaults->outfile)
+		errx(1, "-o cannot be used with -s, the tileset is the output");
+	if (nb_images > 1 && (*defaults->tilemapfile || *defaults->attrmapfile
+			      || *defaults->palfile))
+		errx(1, "-t, -a and -p cannot be used with -s and several images");
+	if (depth != 1 && depth != 2)
+		errx(1, "Depth option must be either 1 or 2.");
+
+	init_tileset(&tileset, defaults->mirror, 0);
+	load_tileset(&tileset, tileset_name);
+
+	for (int i = 0; i < nb_images; i++) {
+		struct Options opts = *defaults;
+
+		opts.infile = images[i];
+		convert_image(&opts, &tileset);
 	}
 
-	if (*opts.outfile)
-		output_file(&opts, &gb);
+	output_tileset_file(&tileset, tileset_name);
+	free_tileset(&tileset);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct Options opts = {0};
+
+	opts.tilemapfile = "";
+	opts.attrmapfile = "";
+	opts.palfile = "";
+	opts.outfile = "";
+	opts.cachedir = "";
+
+	depth = 2;
 
-	if (*opts.tilemapfile)
-		output_tilemap_file(&opts, &tilemap);
+	if (!parse_options(argc, argv, &opts))
+		print_usage();
+	argc -= musl_optind;
+	argv += musl_optind;
 
-	if (*opts.attrmapfile)
-		output_attrmap_file(&opts, &attrmap);
+	if (manifest_name) {
+		if (argc != 0) {
+			fputs("FATAL: input files cannot be given with -B\n", stderr);
+			print_usage();
+		}
+		if (*opts.outfile || *opts.tilemapfile || *opts.attrmapfile || *opts.palfile)
+			errx(1, "-o, -t, -a and -p cannot be used with -B");
+		if (tileset_name)
+			errx(1, "-s cannot be used with -B");
+		return convert_batch(&opts);
+	}
+	if (nb_jobs)
+		errx(1, "-j can only be used with -B");
 
-	if (*opts.palfile)
-		output_palette_file(&opts, raw_image);
+	if (argc == 0) {
+		fputs("FATAL: no input files\n", stderr);
+		print_usage();
+	}
 
-	if (opts.fix || opts.debug)
-		output_png_file(&opts, &png_options, raw_image);
+	if (tileset_name)
+		return convert_shared(&opts, argc, argv);
 
-	destroy_raw_image(&raw_image);
-	free(gb.data);
+	opts.infile = argv[argc - 1];
+	convert_image(&opts, NULL);
 
 	return 0;
 }
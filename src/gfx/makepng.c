@@ -13,55 +13,57 @@
 
 #include "gfx/makepng.h"
 
-static void initialize_png(struct PNGImage *img, FILE * f);
-static struct RawIndexedImage *indexed_png_to_raw(struct PNGImage *img);
-static struct RawIndexedImage *grayscale_png_to_raw(struct PNGImage *img);
-static struct RawIndexedImage *truecolor_png_to_raw(struct PNGImage *img);
+static void start_png_read(struct PNGImage *img);
+static void indexed_png_palette(struct PNGImage *img,
+				struct RawIndexedImage *raw_image);
+static void rgba_png_palette(struct PNGImage *img,
+			     struct RawIndexedImage *raw_image);
+static struct RawIndexedImage *create_raw_image(int width, int height,
+						int num_colors);
 static void get_text(const struct PNGImage *img,
 		     struct ImageOptions *png_options);
 static void set_text(const struct PNGImage *img,
 		     const struct ImageOptions *png_options);
-static void free_png_data(const struct PNGImage *png);
 
+/*
+ * Only reads the PNG's header and determines its palette; the pixels are
+ * decoded as they are requested through `read_raw_image_rows`, so that the
+ * image never has to be held in memory as a whole.
+ */
 struct RawIndexedImage *input_png_file(const struct Options *opts,
 				       struct ImageOptions *png_options)
 {
-	struct PNGImage img;
+	struct PNGImage *img;
 	struct RawIndexedImage *raw_image;
-	FILE *f;
 
-	f = fopen(opts->infile, "rb");
-	if (!f)
+	img = malloc(sizeof(*img));
+	if (!img)
+		err(1, "%s: Failed to allocate memory for PNG image", __func__);
+	img->file = fopen(opts->infile, "rb");
+	if (!img->file)
 		err(1, "Opening input png file '%s' failed", opts->infile);
+	img->data = NULL;
+	img->row = NULL;
+	img->palette = NULL;
 
-	initialize_png(&img, f);
+	start_png_read(img);
 
-	if (img.depth != depth) {
+	if (img->depth != depth) {
 		if (opts->verbose) {
 			warnx("Image bit depth is not %d (is %d).",
-			      depth, img.depth);
+			      depth, img->depth);
 		}
 	}
 
-	switch (img.type) {
-	case PNG_COLOR_TYPE_PALETTE:
-		raw_image = indexed_png_to_raw(&img); break;
-	case PNG_COLOR_TYPE_GRAY:
-	case PNG_COLOR_TYPE_GRAY_ALPHA:
-		raw_image = grayscale_png_to_raw(&img); break;
-	case PNG_COLOR_TYPE_RGB:
-	case PNG_COLOR_TYPE_RGB_ALPHA:
-		raw_image = truecolor_png_to_raw(&img); break;
-	default:
-		/* Shouldn't happen, but might as well handle just in case. */
-		errx(1, "Input PNG file is of invalid color type.");
-	}
+	raw_image = create_raw_image(img->width, img->height, colors);
+	raw_image->png = img;
 
-	get_text(&img, png_options);
+	if (img->type == PNG_COLOR_TYPE_PALETTE)
+		indexed_png_palette(img, raw_image);
+	else
+		rgba_png_palette(img, raw_image);
 
-	png_destroy_read_struct(&img.png, &img.info, NULL);
-	fclose(f);
-	free_png_data(&img);
+	get_text(img, png_options);
 
 	return raw_image;
 }
@@ -144,17 +146,35 @@ void destroy_raw_image(struct RawIndexedImage **raw_image_ptr_ptr)
 {
 	int y;
 	struct RawIndexedImage *raw_image = *raw_image_ptr_ptr;
+	struct PNGImage *img = raw_image->png;
+
+	if (raw_image->data) {
+		for (y = 0; y < raw_image->height; y++)
+			free(raw_image->data[y]);
+		free(raw_image->data);
+	}
 
-	for (y = 0; y < raw_image->height; y++)
-		free(raw_image->data[y]);
+	png_destroy_read_struct(&img->png, &img->info, NULL);
+	fclose(img->file);
+	if (img->data) {
+		for (y = 0; y < img->height; y++)
+			free(img->data[y]);
+		free(img->data);
+	}
+	free(img->row);
+	free(img->palette);
+	free(img);
 
-	free(raw_image->data);
 	free(raw_image->palette);
 	free(raw_image);
 	*raw_image_ptr_ptr = NULL;
 }
 
-static void initialize_png(struct PNGImage *img, FILE *f)
+/*
+ * Sets up libpng to decode the image from the start of the file, with the
+ * transformations that make every row either palette indices or RGBA.
+ */
+static void start_png_read(struct PNGImage *img)
 {
 	img->png = png_create_read_struct(PNG_LIBPNG_VER_STRING,
 					  NULL, NULL, NULL);
@@ -168,7 +188,7 @@ static void initialize_png(struct PNGImage *img, FILE *f)
 	if (setjmp(png_jmpbuf(img->png)))
 		exit(1);
 
-	png_init_io(img->png, f);
+	png_init_io(img->png, img->file);
 
 	png_read_info(img->png, img->info);
 
@@ -176,33 +196,169 @@ static void initialize_png(struct PNGImage *img, FILE *f)
 	img->height = png_get_image_height(img->png, img->info);
 	img->depth  = png_get_bit_depth(img->png, img->info);
 	img->type   = png_get_color_type(img->png, img->info);
+
+	switch (img->type) {
+	case PNG_COLOR_TYPE_PALETTE:
+		if (img->depth < 8)
+			png_set_packing(img->png);
+		break;
+	case PNG_COLOR_TYPE_GRAY:
+	case PNG_COLOR_TYPE_GRAY_ALPHA:
+		if (img->depth < 8)
+			png_set_expand_gray_1_2_4_to_8(img->png);
+		png_set_gray_to_rgb(img->png);
+		/* fallthrough */
+	case PNG_COLOR_TYPE_RGB:
+	case PNG_COLOR_TYPE_RGB_ALPHA:
+		if (img->depth == 16) {
+#if PNG_LIBPNG_VER >= 10504
+			png_set_scale_16(img->png);
+#else
+			png_set_strip_16(img->png);
+#endif
+		}
+
+		if (!(img->type & PNG_COLOR_MASK_ALPHA)) {
+			if (png_get_valid(img->png, img->info, PNG_INFO_tRNS))
+				png_set_tRNS_to_alpha(img->png);
+			else
+				png_set_add_alpha(img->png, 0xFF,
+						  PNG_FILLER_AFTER);
+		}
+		break;
+	default:
+		/* Shouldn't happen, but might as well handle just in case. */
+		errx(1, "Input PNG file is of invalid color type.");
+	}
+
+	/* Interlaced images can only be decoded as a whole */
+	img->interlaced = png_set_interlace_handling(img->png) > 1;
+	png_read_update_info(img->png, img->info);
+
+	free(img->row);
+	img->row = malloc(png_get_rowbytes(img->png, img->info));
+	if (!img->row)
+		err(1, "%s: Failed to allocate memory for image row",
+		    __func__);
+	img->next_row = 0;
+}
+
+/*
+ * Reads the chunks after the image data, once all rows have been decoded.
+ * Options are read before any row is, so they cannot be honored there.
+ */
+static void end_png_read(struct PNGImage *img)
+{
+	png_info *end_info = png_create_info_struct(img->png);
+	png_text *text;
+	int i, numtxts;
+
+	if (!end_info)
+		errx(1, "Creating png info structure failed");
+	png_read_end(img->png, end_info);
+
+	png_get_text(img->png, end_info, &text, &numtxts);
+	for (i = 0; i < numtxts; i++) {
+		if (text[i].key[0] != '\0' && text[i].key[1] == '\0'
+		 && strchr("hxtTaApP", text[i].key[0]))
+			errx(1, "Option \"%s\" must be embedded before the image data, not after it",
+			     text[i].key);
+	}
+	png_destroy_info_struct(img->png, &end_info);
+}
+
+static png_byte const *next_png_row(struct PNGImage *img)
+{
+	int y;
+
+	if (!img->interlaced) {
+		png_read_row(img->png, img->row, NULL);
+		if (++img->next_row == img->height)
+			end_png_read(img);
+		return img->row;
+	}
+
+	if (!img->data) {
+		img->data = malloc(sizeof(*img->data) * img->height);
+		if (!img->data)
+			err(1, "%s: Failed to allocate memory for image data",
+			    __func__);
+		for (y = 0; y < img->height; y++) {
+			img->data[y] = malloc(png_get_rowbytes(img->png,
+							       img->info));
+			if (!img->data[y])
+				err(1, "%s: Failed to allocate memory for image data",
+				    __func__);
+		}
+		png_read_image(img->png, img->data);
+		end_png_read(img);
+	}
+	return img->data[img->next_row++];
+}
+
+/* Makes the next row read be the first one again */
+static void rewind_png(struct PNGImage *img)
+{
+	if (img->interlaced) {
+		/* The decoded image is kept around, no need to do it again */
+		img->next_row = 0;
+		return;
+	}
+
+	png_destroy_read_struct(&img->png, &img->info, NULL);
+	rewind(img->file);
+	start_png_read(img);
 }
 
-static void read_png(struct PNGImage *img);
-static struct RawIndexedImage *create_raw_image(int width, int height,
-						int num_colors);
 static void set_raw_image_palette(struct RawIndexedImage *raw_image,
 				  const png_color *palette, int num_colors);
 
-static struct RawIndexedImage *indexed_png_to_raw(struct PNGImage *img)
+static uint32_t color_key(png_byte red, png_byte green, png_byte blue)
+{
+	return UINT32_C(1) << 24 | red << 16 | green << 8 | blue;
+}
+
+/* Returns the slot holding `key`, or the free slot where it would go */
+static unsigned int color_map_probe(const struct ColorMap *map, uint32_t key)
+{
+	/* Fibonacci hashing, keeping the top bits */
+	unsigned int i = ((uint32_t)(key * UINT32_C(0x9E3779B1)) >> 24)
+				% COLOR_MAP_SIZE;
+
+	while (map->keys[i] && map->keys[i] != key)
+		i = (i + 1) % COLOR_MAP_SIZE;
+	return i;
+}
+
+static void color_map_add(struct ColorMap *map, const png_color *color,
+			  uint8_t index)
+{
+	uint32_t key = color_key(color->red, color->green, color->blue);
+	unsigned int i = color_map_probe(map, key);
+
+	/* If a color appears twice, the first index wins */
+	if (!map->keys[i]) {
+		map->keys[i] = key;
+		map->indices[i] = index;
+	}
+}
+
+static void indexed_png_palette(struct PNGImage *img,
+				struct RawIndexedImage *raw_image)
 {
-	struct RawIndexedImage *raw_image;
 	png_color *palette;
 	int colors_in_PLTE;
 	int colors_in_new_palette;
 	png_byte *trans_alpha;
 	int num_trans;
 	png_color_16 *trans_color;
-	png_color *original_palette;
-	uint8_t *old_to_new_palette;
-	int i, x, y;
-
-	if (img->depth < 8)
-		png_set_packing(img->png);
+	int i;
 
 	png_get_PLTE(img->png, img->info, &palette, &colors_in_PLTE);
 
-	raw_image = create_raw_image(img->width, img->height, colors);
+	img->rgba = false;
+	for (i = 0; i < 256; i++)
+		img->index_map[i] = i;
 
 	/*
 	 * Transparent palette entries are removed, and the palette is
@@ -212,41 +368,28 @@ static struct RawIndexedImage *indexed_png_to_raw(struct PNGImage *img)
 	 */
 	if (png_get_tRNS(img->png, img->info, &trans_alpha, &num_trans,
 			 &trans_color)) {
-		original_palette = palette;
+		png_color *original_palette = palette;
+
 		palette = malloc(sizeof(*palette) * colors_in_PLTE);
 		if (!palette)
 			err(1, "%s: Failed to allocate memory for palette",
 			    __func__);
 		colors_in_new_palette = 0;
-		old_to_new_palette = malloc(sizeof(*old_to_new_palette)
-					    * colors_in_PLTE);
-		if (!old_to_new_palette)
-			err(1, "%s: Failed to allocate memory for new palette",
-			    __func__);
 
 		for (i = 0; i < num_trans; i++) {
 			if (trans_alpha[i] == 0) {
-				old_to_new_palette[i] = 0;
+				img->index_map[i] = 0;
 			} else {
-				old_to_new_palette[i] = colors_in_new_palette;
+				img->index_map[i] = colors_in_new_palette;
 				palette[colors_in_new_palette++] =
 					original_palette[i];
 			}
 		}
 		for (i = num_trans; i < colors_in_PLTE; i++) {
-			old_to_new_palette[i] = colors_in_new_palette;
+			img->index_map[i] = colors_in_new_palette;
 			palette[colors_in_new_palette++] = original_palette[i];
 		}
 
-		if (colors_in_new_palette != colors_in_PLTE) {
-			palette = realloc(palette,
-					  sizeof(*palette) *
-					  colors_in_new_palette);
-			if (!palette)
-				err(1, "%s: Failed to allocate memory for palette",
-				    __func__);
-		}
-
 		/*
 		 * Setting and validating palette before reading
 		 * allows us to error out *before* doing the data
@@ -254,75 +397,10 @@ static struct RawIndexedImage *indexed_png_to_raw(struct PNGImage *img)
 		 */
 		set_raw_image_palette(raw_image, palette,
 				      colors_in_new_palette);
-		read_png(img);
-
-		for (y = 0; y < img->height; y++) {
-			for (x = 0; x < img->width; x++) {
-				raw_image->data[y][x] =
-					old_to_new_palette[img->data[y][x]];
-			}
-		}
-
 		free(palette);
-		free(old_to_new_palette);
 	} else {
 		set_raw_image_palette(raw_image, palette, colors_in_PLTE);
-		read_png(img);
-
-		for (y = 0; y < img->height; y++) {
-			for (x = 0; x < img->width; x++)
-				raw_image->data[y][x] = img->data[y][x];
-		}
 	}
-
-	return raw_image;
-}
-
-static struct RawIndexedImage *grayscale_png_to_raw(struct PNGImage *img)
-{
-	if (img->depth < 8)
-		png_set_expand_gray_1_2_4_to_8(img->png);
-
-	png_set_gray_to_rgb(img->png);
-	return truecolor_png_to_raw(img);
-}
-
-static void rgba_png_palette(struct PNGImage *img,
-			     png_color **palette_ptr_ptr, int *num_colors);
-static struct RawIndexedImage
-	*processed_rgba_png_to_raw(const struct PNGImage *img,
-				   const png_color *palette,
-				   int colors_in_palette);
-
-static struct RawIndexedImage *truecolor_png_to_raw(struct PNGImage *img)
-{
-	struct RawIndexedImage *raw_image;
-	png_color *palette;
-	int colors_in_palette;
-
-	if (img->depth == 16) {
-#if PNG_LIBPNG_VER >= 10504
-		png_set_scale_16(img->png);
-#else
-		png_set_strip_16(img->png);
-#endif
-	}
-
-	if (!(img->type & PNG_COLOR_MASK_ALPHA)) {
-		if (png_get_valid(img->png, img->info, PNG_INFO_tRNS))
-			png_set_tRNS_to_alpha(img->png);
-		else
-			png_set_add_alpha(img->png, 0xFF, PNG_FILLER_AFTER);
-	}
-
-	read_png(img);
-
-	rgba_png_palette(img, &palette, &colors_in_palette);
-	raw_image = processed_rgba_png_to_raw(img, palette, colors_in_palette);
-
-	free(palette);
-
-	return raw_image;
 }
 
 static void rgba_PLTE_palette(struct PNGImage *img,
@@ -331,14 +409,25 @@ static void rgba_build_palette(struct PNGImage *img,
 			       png_color **palette_ptr_ptr, int *num_colors);
 
 static void rgba_png_palette(struct PNGImage *img,
-			     png_color **palette_ptr_ptr, int *num_colors)
+			     struct RawIndexedImage *raw_image)
 {
-	if (png_get_valid(img->png, img->info, PNG_INFO_PLTE))
-		rgba_PLTE_palette(img, palette_ptr_ptr, num_colors);
-	else
-		rgba_build_palette(img, palette_ptr_ptr, num_colors);
+	if (png_get_valid(img->png, img->info, PNG_INFO_PLTE)) {
+		rgba_PLTE_palette(img, &img->palette, &img->num_colors);
+	} else {
+		/* This needs a first pass over the pixels */
+		rgba_build_palette(img, &img->palette, &img->num_colors);
+		rewind_png(img);
+	}
+
+	img->rgba = true;
+	set_raw_image_palette(raw_image, img->palette, img->num_colors);
+
+	memset(&img->color_map, 0, sizeof(img->color_map));
+	for (int i = 0; i < img->num_colors; i++)
+		color_map_add(&img->color_map, &img->palette[i], i);
 }
 
+
 static void rgba_PLTE_palette(struct PNGImage *img,
 			      png_color **palette_ptr_ptr, int *num_colors)
 {
@@ -351,7 +440,7 @@ static void rgba_PLTE_palette(struct PNGImage *img,
 		       PNG_USER_WILL_FREE_DATA, PNG_FREE_PLTE);
 }
 
-static void update_built_palette(png_color *palette,
+static void update_built_palette(png_color *palette, struct ColorMap *map,
 				 const png_color *pixel_color, png_byte alpha,
 				 int *num_colors, bool *only_grayscale);
 static int fit_grayscale_palette(png_color *palette, int *num_colors);
@@ -361,10 +450,12 @@ static void rgba_build_palette(struct PNGImage *img,
 			       png_color **palette_ptr_ptr, int *num_colors)
 {
 	png_color *palette;
-	int y, value_index;
+	int x, y;
+	png_byte const *row;
 	png_color cur_pixel_color;
 	png_byte cur_alpha;
 	bool only_grayscale = true;
+	struct ColorMap map = {0};
 
 	/*
 	 * By filling the palette up with black by default, if the image
@@ -377,14 +468,14 @@ static void rgba_build_palette(struct PNGImage *img,
 	*num_colors = 0;
 
 	for (y = 0; y < img->height; y++) {
-		value_index = 0;
-		while (value_index < img->width * 4) {
-			cur_pixel_color.red   = img->data[y][value_index++];
-			cur_pixel_color.green = img->data[y][value_index++];
-			cur_pixel_color.blue  = img->data[y][value_index++];
-			cur_alpha = img->data[y][value_index++];
-
-			update_built_palette(palette, &cur_pixel_color,
+		row = next_png_row(img);
+		for (x = 0; x < img->width; x++) {
+			cur_pixel_color.red   = *row++;
+			cur_pixel_color.green = *row++;
+			cur_pixel_color.blue  = *row++;
+			cur_alpha = *row++;
+
+			update_built_palette(palette, &map, &cur_pixel_color,
 					     cur_alpha,
 					     num_colors, &only_grayscale);
 		}
@@ -397,13 +488,12 @@ static void rgba_build_palette(struct PNGImage *img,
 		order_color_palette(palette, *num_colors);
 }
 
-static void update_built_palette(png_color *palette,
+static void update_built_palette(png_color *palette, struct ColorMap *map,
 				 const png_color *pixel_color, png_byte alpha,
 				 int *num_colors, bool *only_grayscale)
 {
-	bool color_exists;
-	png_color cur_palette_color;
-	int i;
+	uint32_t key;
+	unsigned int slot;
 
 	/*
 	 * Transparent pixels don't count toward the palette,
@@ -417,21 +507,15 @@ static void update_built_palette(png_color *palette,
 		*only_grayscale = false;
 	}
 
-	color_exists = false;
-	for (i = 0; i < *num_colors; i++) {
-		cur_palette_color = palette[i];
-		if (pixel_color->red   == cur_palette_color.red   &&
-		    pixel_color->green == cur_palette_color.green &&
-		    pixel_color->blue  == cur_palette_color.blue) {
-			color_exists = true;
-			break;
-		}
-	}
-	if (!color_exists) {
+	key = color_key(pixel_color->red, pixel_color->green,
+			pixel_color->blue);
+	slot = color_map_probe(map, key);
+	if (!map->keys[slot]) {
 		if (*num_colors == colors) {
 			errx(1, "Too many colors in input PNG file to fit into a %d-bit palette (max %d).",
 			     depth, colors);
 		}
+		map->keys[slot] = key;
 		palette[*num_colors] = *pixel_color;
 		(*num_colors)++;
 	}
@@ -528,107 +612,64 @@ static void order_color_palette(png_color *palette, int num_colors)
 	free(palette_with_luminance);
 }
 
-static void put_raw_image_pixel(struct RawIndexedImage *raw_image,
-				const struct PNGImage *img,
-				int *value_index, int x, int y,
-				const png_color *palette,
-				int colors_in_palette);
-
-static struct RawIndexedImage
-	*processed_rgba_png_to_raw(const struct PNGImage *img,
-				   const png_color *palette,
-				   int colors_in_palette)
+/* Decodes the image's next `nb_rows` rows as palette indices into `rows` */
+void read_raw_image_rows(struct RawIndexedImage *raw_image, uint8_t **rows,
+			 int nb_rows)
 {
-	struct RawIndexedImage *raw_image;
-	int x, y, value_index;
+	struct PNGImage *img = raw_image->png;
+	png_byte const *row;
+	unsigned int slot;
+	int x, y;
 
-	raw_image = create_raw_image(img->width, img->height, colors);
-
-	set_raw_image_palette(raw_image, palette, colors_in_palette);
+	for (y = 0; y < nb_rows; y++) {
+		row = next_png_row(img);
 
-	for (y = 0; y < img->height; y++) {
-		x = raw_image->width - 1;
-		value_index = img->width * 4 - 1;
-
-		while (x >= 0) {
-			put_raw_image_pixel(raw_image, img,
-					    &value_index, x, y,
-					    palette, colors_in_palette);
-			x--;
+		if (!img->rgba) {
+			for (x = 0; x < img->width; x++)
+				rows[y][x] = img->index_map[row[x]];
+			continue;
 		}
-	}
-
-	return raw_image;
-}
-
-static uint8_t palette_index_of(const png_color *palette,
-				int num_colors, const png_color *color);
 
-static void put_raw_image_pixel(struct RawIndexedImage *raw_image,
-				const struct PNGImage *img,
-				int *value_index, int x, int y,
-				const png_color *palette,
-				int colors_in_palette)
-{
-	png_color pixel_color;
-	png_byte alpha;
-
-	alpha = img->data[y][*value_index];
-	if (alpha == 0) {
-		raw_image->data[y][x] = 0;
-		*value_index -= 4;
-	} else {
-		(*value_index)--;
-		pixel_color.blue  = img->data[y][(*value_index)--];
-		pixel_color.green = img->data[y][(*value_index)--];
-		pixel_color.red   = img->data[y][(*value_index)--];
-		raw_image->data[y][x] = palette_index_of(palette,
-							 colors_in_palette,
-							 &pixel_color);
-	}
-}
-
-static uint8_t palette_index_of(const png_color *palette,
-				int num_colors, const png_color *color)
-{
-	uint8_t i;
+		for (x = 0; x < img->width; x++, row += 4) {
+			/* Transparent pixels become color #0 */
+			if (row[3] == 0) {
+				rows[y][x] = 0;
+				continue;
+			}
 
-	for (i = 0; i < num_colors; i++) {
-		if (palette[i].red   == color->red   &&
-		    palette[i].green == color->green &&
-		    palette[i].blue  == color->blue) {
-			return i;
+			slot = color_map_probe(&img->color_map,
+					       color_key(row[0], row[1], row[2]));
+			if (!img->color_map.keys[slot])
+				errx(1, "The input PNG file contains colors that don't appear in its embedded palette.");
+			rows[y][x] = img->color_map.indices[slot];
 		}
 	}
-	errx(1, "The input PNG file contains colors that don't appear in its embedded palette.");
 }
 
-static void read_png(struct PNGImage *img)
+/* Decodes the whole image into `raw_image->data`, for when it is needed at once */
+void load_raw_image(struct RawIndexedImage *raw_image)
 {
 	int y;
 
-	png_read_update_info(img->png, img->info);
-
-	img->data = malloc(sizeof(*img->data) * img->height);
-	if (!img->data)
-		err(1, "%s: Failed to allocate memory for image data",
+	raw_image->data = malloc(sizeof(*raw_image->data) * raw_image->height);
+	if (!raw_image->data)
+		err(1, "%s: Failed to allocate memory for raw image data",
 		    __func__);
-	for (y = 0; y < img->height; y++) {
-		img->data[y] = malloc(png_get_rowbytes(img->png, img->info));
-		if (!img->data[y])
-			err(1, "%s: Failed to allocate memory for image data",
+	for (y = 0; y < raw_image->height; y++) {
+		raw_image->data[y] = malloc(sizeof(*raw_image->data[y])
+					    * raw_image->width);
+		if (!raw_image->data[y])
+			err(1, "%s: Failed to allocate memory for raw image data",
 			    __func__);
 	}
 
-	png_read_image(img->png, img->data);
-	png_read_end(img->png, img->info);
+	read_raw_image_rows(raw_image, raw_image->data, raw_image->height);
 }
 
 static struct RawIndexedImage *create_raw_image(int width, int height,
 						int num_colors)
 {
 	struct RawIndexedImage *raw_image;
-	int y;
 
 	raw_image = malloc(sizeof(*raw_image));
 	if (!raw_image)
@@ -638,24 +679,13 @@ static struct RawIndexedImage *create_raw_image(int width, int height,
 	raw_image->width = width;
 	raw_image->height = height;
 	raw_image->num_colors = num_colors;
+	raw_image->data = NULL;
 
 	raw_image->palette = malloc(sizeof(*raw_image->palette) * num_colors);
 	if (!raw_image->palette)
 		err(1, "%s: Failed to allocate memory for raw image palette",
 		    __func__);
 
-	raw_image->data = malloc(sizeof(*raw_image->data) * height);
-	if (!raw_image->data)
-		err(1, "%s: Failed to allocate memory for raw image data",
-		    __func__);
-	for (y = 0; y < height; y++) {
-		raw_image->data[y] = malloc(sizeof(*raw_image->data[y])
-					    * width);
-		if (!raw_image->data[y])
-			err(1, "%s: Failed to allocate memory for raw image data",
-			    __func__);
-	}
-
 	return raw_image;
 }
 
@@ -795,13 +825,3 @@ static void set_text(const struct PNGImage *img,
 
 	free(text);
 }
-
-static void free_png_data(const struct PNGImage *img)
-{
-	int y;
-
-	for (y = 0; y < img->height; y++)
-		free(img->data[y]);
-
-	free(img->data);
-}
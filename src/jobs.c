@@ -0,0 +1,115 @@
+/*
+ * This file is part of RGBDS.
+ *
+ * Copyright (c) 2021, RGBDS contributors.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "jobs.h"
+#include "platform.h" /* HAVE_FORK */
+
+#include "extern/err.h"
+
+#if HAVE_FORK
+# include <signal.h>
+# include <sys/wait.h>
+
+static uint32_t runInWorkers(uint32_t nbItems, unsigned int nbJobs,
+			     bool (*func)(uint32_t, void *), void *arg)
+{
+	int queue[2], results[2];
+	pid_t *jobs = malloc(sizeof(*jobs) * nbJobs);
+
+	if (!jobs)
+		err(1, "Failed to allocate jobs");
+	if (pipe(queue) == -1 || pipe(results) == -1)
+		err(1, "Failed to create job pipes");
+
+	/* Don't let the workers inherit unflushed output */
+	fflush(stdout);
+	fflush(stderr);
+
+	for (unsigned int i = 0; i < nbJobs; i++) {
+		jobs[i] = fork();
+		if (jobs[i] == -1)
+			err(1, "Failed to start job");
+		if (jobs[i] != 0)
+			continue;
+
+		/* Buffer diagnostics, so that each item's are printed in one go */
+		static char errBuf[1 << 16];
+		uint32_t nbFailed = 0;
+		uint32_t itemID;
+
+		setvbuf(stderr, errBuf, _IOFBF, sizeof(errBuf));
+		close(queue[1]);
+		close(results[0]);
+		/* Each ID is written at once, and thus read at once */
+		while (read(queue[0], &itemID, sizeof(itemID)) == sizeof(itemID)) {
+			if (!func(itemID, arg))
+				nbFailed++;
+			fflush(stdout);
+			fflush(stderr);
+		}
+		if (write(results[1], &nbFailed, sizeof(nbFailed)) != sizeof(nbFailed))
+			err(1, "Failed to report job results");
+		exit(0);
+	}
+	close(queue[0]);
+	close(results[1]);
+
+	/* If all jobs aborted, stop queuing instead of being killed */
+	signal(SIGPIPE, SIG_IGN);
+	for (uint32_t i = 0; i < nbItems; i++) {
+		if (write(queue[1], &i, sizeof(i)) != sizeof(i))
+			break;
+	}
+	close(queue[1]);
+
+	unsigned int nbAborted = 0;
+	uint32_t nbFailed = 0;
+	uint32_t jobFailed;
+
+	for (unsigned int i = 0; i < nbJobs; i++) {
+		int status;
+
+		if (waitpid(jobs[i], &status, 0) == -1)
+			err(1, "Failed to wait for job");
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			nbAborted++;
+	}
+	while (read(results[0], &jobFailed, sizeof(jobFailed)) == sizeof(jobFailed))
+		nbFailed += jobFailed;
+	close(results[0]);
+	free(jobs);
+
+	if (nbAborted != 0)
+		warnx("%u job%s aborted", nbAborted, nbAborted == 1 ? "" : "s");
+	return nbFailed + nbAborted;
+}
+#endif
+
+uint32_t jobs_Run(uint32_t nbItems, unsigned int nbJobs, bool (*func)(uint32_t, void *),
+		  void *arg)
+{
+	uint32_t nbFailed = 0;
+
+	if (nbJobs > nbItems)
+		nbJobs = nbItems;
+#if HAVE_FORK
+	if (nbJobs > 1)
+		return runInWorkers(nbItems, nbJobs, func, arg);
+#endif
+
+	for (uint32_t i = 0; i < nbItems; i++) {
+		if (!func(i, arg))
+			nbFailed++;
+	}
+	return nbFailed;
+}
@@ -24,11 +24,14 @@
 #include "link/patch.h"
 #include "link/output.h"
 
+#include "fix/header.h"
+
 #include "extern/err.h"
 #include "extern/getopt.h"
 #include "version.h"
 
 bool isDmgMode;               /* -d */
+char const *fixOptions;       /* -f */
 char       *linkerScriptName; /* -l */
 char const *mapFileName;      /* -m */
 char const *symFileName;      /* -n */
@@ -142,7 +145,7 @@ FILE *openFile(char const *fileName, char const *mode)
 }
 
 /* Short options */
-static char const *optstring = "dl:m:n:O:o:p:s:tVvwx";
+static char const *optstring = "df:l:m:n:O:o:p:s:tVvwx";
 
 /*
  * Equivalent long options
@@ -156,6 +159,7 @@ static char const *optstring = "dl:m:n:O:o:p:s:tVvwx";
  */
 static struct option const longopts[] = {
 	{ "dmg",          no_argument,       NULL, 'd' },
+	{ "fix",          required_argument, NULL, 'f' },
 	{ "linkerscript", required_argument, NULL, 'l' },
 	{ "map",          required_argument, NULL, 'm' },
 	{ "sym",          required_argument, NULL, 'n' },
@@ -177,10 +181,11 @@ static struct option const longopts[] = {
 static void printUsage(void)
 {
 	fputs(
-"Usage: rgblink [-dtVvwx] [-l script] [-m map_file] [-n sym_file]\n"
-"               [-O overlay_file] [-o out_file] [-p pad_value] [-s symbol]\n"
-"               <file> ...\n"
+"Usage: rgblink [-dtVvwx] [-f fix_options] [-l script] [-m map_file]\n"
+"               [-n sym_file] [-O overlay_file] [-o out_file] [-p pad_value]\n"
+"               [-s symbol] <file> ...\n"
 "Useful options:\n"
+"    -f, --fix <options>        fix the ROM's header as rgbfix would\n"
 "    -l, --linkerscript <path>  set the input linker script\n"
 "    -m, --map <path>           set the output map file\n"
 "    -n, --sym <path>           set the output symbol list file\n"
@@ -216,6 +221,9 @@ int main(int argc, char *argv[])
 			isDmgMode = true;
 			isWRA0Mode = true;
 			break;
+		case 'f':
+			fixOptions = musl_optarg;
+			break;
 		case 'l':
 			linkerScriptName = musl_optarg;
 			break;
@@ -273,6 +281,10 @@ int main(int argc, char *argv[])
 
 	int curArgIndex = musl_optind;
 
+	/* The ROM fixing options are parsed with rgbfix's options, so only once ours are done */
+	if (fixOptions && !(fix_ParseArgs(fixOptions) && fix_CheckOptions()))
+		error(NULL, 0, "Invalid ROM fixing options \"%s\"", fixOptions);
+
 	/* If no input files were specified, the user must have screwed up */
 	if (curArgIndex == argc) {
 		fputs("fatal: no input files\n", stderr);
@@ -10,19 +10,22 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "link/output.h"
 #include "link/main.h"
 #include "link/section.h"
 #include "link/symbol.h"
 
+#include "fix/header.h"
+
 #include "extern/err.h"
 
 #include "linkdefs.h"
 
 #include "platform.h" // MIN_NB_ELMS
 
-#define BANK_SIZE 0x4000
+#define BANK_SIZE FIX_BANK_SIZE
 
 FILE *outputFile;
 FILE *overlayFile;
@@ -187,6 +190,91 @@ static void coverOverlayBanks(uint32_t nbOverlayBanks)
 	}
 }
 
+/*
+ * When fixing the ROM, its first bank is held back until its header has been fixed,
+ * which requires knowing the ROM's size beforehand
+ */
+static struct {
+	uint8_t rom0[BANK_SIZE];
+	size_t rom0Len;
+	size_t romxLen; /* How many bytes follow the first bank */
+	uint16_t romxSum;
+	bool padded;
+	uint8_t padByte;
+	size_t padLen;
+} fix;
+
+/**
+ * Fixes the ROM's first bank, and writes it to the output file.
+ */
+static void writeFixedRom0(void)
+{
+	fix_Header(fix.rom0);
+	fix.padded = fix_Pad(fix.rom0, &fix.rom0Len, fix.romxLen, &fix.padByte, &fix.padLen);
+	fix_HeaderSum(fix.rom0);
+	fwrite(fix.rom0, sizeof(*fix.rom0), fix.rom0Len, outputFile);
+}
+
+/**
+ * Write data to the output file, fixing the ROM along the way if requested.
+ * @param data The data to write
+ * @param size How many bytes to write
+ */
+static void writeData(uint8_t const *data, size_t size)
+{
+	if (fixOptions && fix.rom0Len < BANK_SIZE) {
+		size_t len = BANK_SIZE - fix.rom0Len < size ? BANK_SIZE - fix.rom0Len : size;
+
+		memcpy(&fix.rom0[fix.rom0Len], data, len);
+		fix.rom0Len += len;
+		if (fix.rom0Len < BANK_SIZE)
+			return;
+		writeFixedRom0();
+		data += len;
+		size -= len;
+	}
+
+	if (fixOptions)
+		fix.romxSum += fix_SumBytes(data, size);
+	fwrite(data, sizeof(*data), size, outputFile);
+}
+
+/**
+ * Fill part of a bank with whatever lies between sections.
+ * @param data Where to write the filler bytes
+ * @param size How many bytes to write
+ */
+static void fillBank(uint8_t *data, uint16_t size)
+{
+	if (overlayFile) {
+		size_t len = fread(data, sizeof(*data), size, overlayFile);
+
+		/* Past the end of the overlay, `getc` would have returned EOF */
+		memset(&data[len], 0xFF, size - len);
+	} else {
+		memset(data, padValue, size);
+	}
+}
+
+/**
+ * Compute how many bytes `writeBank` outputs for a ROM bank.
+ * @param bankSections The bank's sections, ordered by increasing address
+ * @param baseOffset The address of the bank's first byte in GB address space
+ * @param size The size of the bank
+ */
+static uint16_t bankLength(struct SortedSection const *bankSections, uint16_t baseOffset,
+			   uint16_t size)
+{
+	if (!disablePadding)
+		return size;
+
+	uint16_t len = 0;
+
+	for (; bankSections; bankSections = bankSections->next)
+		len = bankSections->section->org + bankSections->section->size - baseOffset;
+	return len;
+}
+
 /**
  * Write a ROM bank's sections to the output file.
  * @param bankSections The bank's sections, ordered by increasing address
@@ -196,21 +284,19 @@ static void coverOverlayBanks(uint32_t nbOverlayBanks)
 static void writeBank(struct SortedSection *bankSections, uint16_t baseOffset,
 		      uint16_t size)
 {
+	static uint8_t data[2 * BANK_SIZE]; /* Large enough for ROM0 in 32k mode */
 	uint16_t offset = 0;
 
+	assert(size <= sizeof(data));
 	while (bankSections) {
 		struct Section const *section = bankSections->section;
 
 		/* Output padding up to the next SECTION */
-		while (offset + baseOffset < section->org) {
-			putc(overlayFile ? getc(overlayFile) : padValue,
-			     outputFile);
-			offset++;
-		}
+		fillBank(&data[offset], section->org - baseOffset - offset);
+		offset = section->org - baseOffset;
 
 		/* Output the section itself */
-		fwrite(section->data, sizeof(*section->data), section->size,
-		       outputFile);
+		memcpy(&data[offset], section->data, section->size);
 		if (overlayFile) {
 			/* Skip bytes even with pipes */
 			for (uint16_t i = 0; i < section->size; i++)
@@ -222,13 +308,11 @@ static void writeBank(struct SortedSection *bankSections, uint16_t baseOffset,
 	}
 
 	if (!disablePadding) {
-		while (offset < size) {
-			putc(overlayFile ? getc(overlayFile)
-					 : padValue,
-			     outputFile);
-			offset++;
-		}
+		fillBank(&data[offset], size - offset);
+		offset = size;
 	}
+
+	writeData(data, offset);
 }
 
 /**
@@ -244,6 +328,26 @@ static void writeROM(void)
 	if (nbOverlayBanks > 0)
 		coverOverlayBanks(nbOverlayBanks);
 
+	if (outputFile && fixOptions) {
+		/* The ROM size is part of the header, so it must be known before writing it */
+		size_t romLen = 0;
+
+		if (sections[SECTTYPE_ROM0].nbBanks > 0)
+			romLen += bankLength(sections[SECTTYPE_ROM0].banks[0].sections,
+					     startaddr[SECTTYPE_ROM0], maxsize[SECTTYPE_ROM0]);
+		for (uint32_t i = 0 ; i < sections[SECTTYPE_ROMX].nbBanks; i++)
+			romLen += bankLength(sections[SECTTYPE_ROMX].banks[i].sections,
+					     startaddr[SECTTYPE_ROMX], maxsize[SECTTYPE_ROMX]);
+
+		if (romLen < fix_HeaderSize())
+			errx(1, "ROM too short to be fixed, expected at least %u bytes, got only %zu",
+			     fix_HeaderSize(), romLen);
+		/* The global checksum can only be written back once the whole ROM has been */
+		if (fix_WantsGlobalSum() && fseek(outputFile, 0, SEEK_CUR) != 0)
+			errx(1, "Cannot fix the global checksum of a non-seekable output");
+		fix.romxLen = romLen > BANK_SIZE ? romLen - BANK_SIZE : 0;
+	}
+
 	if (outputFile) {
 		if (sections[SECTTYPE_ROM0].nbBanks > 0)
 			writeBank(sections[SECTTYPE_ROM0].banks[0].sections,
@@ -254,6 +358,33 @@ static void writeROM(void)
 				  startaddr[SECTTYPE_ROMX], maxsize[SECTTYPE_ROMX]);
 	}
 
+	if (outputFile && fixOptions) {
+		/* ROMs shorter than a bank have not been written yet */
+		if (fix.rom0Len < BANK_SIZE)
+			writeFixedRom0();
+
+		if (fix.padded) {
+			uint8_t bank[BANK_SIZE];
+			size_t len = fix.padLen;
+
+			memset(bank, fix.padByte, sizeof(bank));
+			fix.romxSum += fix.padByte * fix.padLen;
+			while (len) {
+				size_t thisLen = len > sizeof(bank) ? sizeof(bank) : len;
+
+				fwrite(bank, sizeof(*bank), thisLen, outputFile);
+				len -= thisLen;
+			}
+		}
+
+		if (fix_WantsGlobalSum()) {
+			fix_GlobalSum(fix.rom0, fix.rom0Len, fix.romxSum);
+			if (fseek(outputFile, 0x14E, SEEK_SET) != 0)
+				err(1, "Failed to seek back to the global checksum");
+			fwrite(&fix.rom0[0x14E], sizeof(*fix.rom0), 2, outputFile);
+		}
+	}
+
 	closeFile(outputFile);
 	closeFile(overlayFile);
 }
@@ -0,0 +1,15 @@
+SECTION "test", ROM0
+
+	db "abc"
+	CHARMAP "a", 1
+	db "abc"
+	CHARMAP "ab", 2
+	db "abc"
+
+	NEWCHARMAP derived, main
+	db "abc"
+	CHARMAP "c", 3
+	db "abc"
+
+	SETCHARMAP main
+	db "abc"
@@ -0,0 +1,4 @@
+SECTION "deps", ROM0
+INCLUDE "a.inc"
+INCLUDE "fatal.inc"
+INCLUDE "never.inc"
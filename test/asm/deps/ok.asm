@@ -0,0 +1,3 @@
+SECTION "deps", ROM0
+INCLUDE "a.inc"
+INCLUDE "b.inc"
@@ -0,0 +1,17 @@
+; Test vectors for the fixed-point math functions, whose results must be
+; correctly rounded, and the same on every platform
+
+	println "SIN: ", SIN(0.0), " ", SIN(1.0), " ", SIN(8192.0), " ", SIN(16384.0), " ", SIN(-5461.33333), " ", SIN($8000_0000), " ", SIN(-25536.0), " ", SIN(-1)
+	println "COS: ", COS(0.0), " ", COS(1.0), " ", COS(8192.0), " ", COS(16384.0), " ", COS(10922.66667), " ", COS($8000_0000), " ", COS(-12345.6789)
+	println "TAN: ", TAN(0.0), " ", TAN(8192.0), " ", TAN(-8192.0), " ", TAN(16000.0), " ", TAN(16383.99), " ", TAN(16384.0), " ", TAN(-16384.0)
+	println "ASIN: ", ASIN(0.0), " ", ASIN(0.5), " ", ASIN(-0.5), " ", ASIN(0.99999), " ", ASIN(1.0), " ", ASIN(-1.0), " ", ASIN(1.5)
+	println "ACOS: ", ACOS(0.0), " ", ACOS(0.5), " ", ACOS(-0.5), " ", ACOS(0.99999), " ", ACOS(1.0), " ", ACOS(-1.0), " ", ACOS(-1.5)
+	println "ATAN: ", ATAN(0.0), " ", ATAN(1.0), " ", ATAN(-1.0), " ", ATAN(0.00002), " ", ATAN(1000.0), " ", ATAN($7FFF_FFFF), " ", ATAN($8000_0000)
+	println "ATAN2: ", ATAN2(1.0, 1.0), " ", ATAN2(1.0, -1.0), " ", ATAN2(-1.0, -1.0), " ", ATAN2(0.0, -1.0), " ", ATAN2(0.0, 0.0), " ", ATAN2(-3.0, 4.0), " ", ATAN2(1, $7FFF_FFFF)
+	println "MUL: ", MUL(3.1, 5.2), " ", MUL(-1.5, 1.5), " ", MUL(0.00002, 0.00002), " ", MUL(0.00002, 0.5), " ", MUL(-0.00002, 0.5), " ", MUL(300.0, 300.0), " ", MUL(-300.0, 300.0)
+	println "DIV: ", DIV(1.0, 3.0), " ", DIV(-2.0, 3.0), " ", DIV(1, 2.0), " ", DIV(-1, 2.0), " ", DIV(1.0, 0.0), " ", DIV(0.0, 0.0), " ", DIV(30000.0, 0.5)
+	println "POW: ", POW(2.0, 0.5), " ", POW(-2.0, 3.0), " ", POW(-2.0, 0.5), " ", POW(0.0, 0.0), " ", POW(0.0, -1.0), " ", POW(1.00002, 10000.0), " ", POW(10.0, -4.0), " ", POW(2.0, -17.0), " ", POW(2.0, 15.0)
+	println "LOG: ", LOG(2.0, 10.0), " ", LOG(0.5, 2.0), " ", LOG(32767.0, 1.00002), " ", LOG(1.0, 1.0), " ", LOG(2.0, 1.0), " ", LOG(0.0, 2.0), " ", LOG(-1.0, 2.0)
+	println "ROUND: ", ROUND(0.5), " ", ROUND(-0.5), " ", ROUND(0.49999), " ", ROUND(32767.5), " ", ROUND($8000_0000)
+	println "CEIL: ", CEIL(0.00002), " ", CEIL(-0.99998), " ", CEIL(32767.00002), " ", CEIL($8000_0000)
+	println "FLOOR: ", FLOOR(0.99998), " ", FLOOR(-0.00002), " ", FLOOR(32767.99998), " ", FLOOR(-32767.5)
@@ -0,0 +1,10 @@
+	INCLUDE "include-guard.inc"
+	INCLUDE "include-guard.inc"
+	PURGE GUARD_INC
+	INCLUDE "include-guard.inc"
+
+	INCLUDE "include-guard-else.inc"
+	INCLUDE "include-guard-else.inc"
+
+	INCLUDE "include-guard-after.inc"
+	INCLUDE "include-guard-after.inc"
@@ -0,0 +1,4 @@
+SECTION "main", ROM0
+	db FOO, BAZ, "A", STRLEN("{NAME}")
+	twice 5
+	ds 2
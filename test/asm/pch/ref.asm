@@ -0,0 +1,2 @@
+INCLUDE "prelude.inc"
+INCLUDE "main.asm"
@@ -7,9 +7,10 @@ gb="$(mktemp)"
 input="$(mktemp)"
 output="$(mktemp)"
 errput="$(mktemp)"
+pchdir="$(mktemp -d)"
 rc=0
 
-trap "rm -f '$o' '$gb' '$input' '$output' '$errput'" EXIT
+trap "rm -f '$o' '$gb' '$input' '$output' '$errput'; rm -rf '$pchdir'" EXIT
 
 bold="$(tput bold)"
 resbold="$(tput sgr0)"
@@ -127,4 +128,45 @@ for i in *.asm; do
 	done
 done
 
+# These tests need their own flags
+i="deps.asm"
+variant=
+echo "${bold}${green}${i%.asm}...${rescolors}${resbold}"
+$RGBASM --dep-format ninja -M $output -MT deps.o -o $o -i deps/ deps/ok.asm
+tryDiff deps/ninja.out $output out
+rc=$(($? || $rc))
+# A fatal error must still leave the dependencies found until then
+$RGBASM -M $output -MP -MT deps.o -o $o -i deps/ deps/fatal.asm 2> $errput
+tryDiff deps/fatal.out $output out
+rc=$(($? || $rc))
+tryDiff deps/fatal.err $errput err
+rc=$(($? || $rc))
+
+# A precompiled header must give the same ROM as including its prelude, even when it is stale
+# It is used from a copy, since one of its dependencies gets modified
+i="pch.asm"
+echo "${bold}${green}${i%.asm}...${rescolors}${resbold}"
+cp pch/* $pchdir
+tryPch () {
+	$RGBASM -i $pchdir/ "$@" -o $o $pchdir/ref.asm
+	$RGBLINK -o $input $o
+	$RGBASM -i $pchdir/ "$@" --use-pch $pchdir/prelude.pch -o $o $pchdir/main.asm 2>> $errput
+	$RGBLINK -o $output $o
+	tryCmp $input $output
+}
+$RGBASM -i $pchdir/ --emit-pch $pchdir/prelude.pch $pchdir/prelude.inc
+: > $errput
+tryPch
+rc=$(($? || $rc))
+tryPch -DBAR=1
+rc=$(($? || $rc))
+# Dependencies are only stale if both their modification time and contents changed
+echo "; Changed" >> $pchdir/defs.inc
+touch -t 200001010000 $pchdir/defs.inc
+tryPch
+rc=$(($? || $rc))
+sed "s:$pchdir/::g" $errput > $output
+tryDiff pch/out.err $output err
+rc=$(($? || $rc))
+
 exit $rc
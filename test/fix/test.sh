@@ -98,4 +98,17 @@ rc=$(($rc || $? != 1))
 tryDiff "$src/noexist.err" out.err noexist.err
 rc=$(($rc || $?))
 
+# ...and that with -J, files that fail don't prevent fixing the others, but still make it fail
+cp "$src"/padding.bin jobs-a.gb
+cp "$src"/padding.bin jobs-b.gb
+$RGBFIX -J 2 -p 0xFF jobs-a.gb noexist jobs-b.gb noexist2 2>out.err
+rc=$(($rc || $? != 1))
+# Each file's diagnostics are printed together, but the files may be done in any order
+sort out.err | tryDiff "$src/jobs.err" - jobs.err
+rc=$(($rc || $?))
+for i in jobs-a jobs-b; do
+	tryCmp "$src/padding.gb" $i.gb $i.gb
+	rc=$(($rc || $?))
+done
+
 exit $rc
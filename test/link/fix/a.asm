@@ -0,0 +1,12 @@
+SECTION "entry", ROM0[$100]
+	nop
+	jp $150
+
+SECTION "main", ROM0[$150]
+	ld a, BANK(Data)
+	ld [$2000], a
+	jr @
+
+SECTION "data", ROMX, BANK[2]
+Data:
+	db "Enough to need padding past bank 2"
@@ -19,6 +19,7 @@ rescolors="$(tput op)"
 
 RGBASM=../../rgbasm
 RGBLINK=../../rgblink
+RGBFIX=../../rgbfix
 
 startTest () {
 	echo "$bold$green${i%.asm}...$rescolors$resbold"
@@ -140,6 +141,20 @@ rc=$(($? || $rc))
 tryCmp overlay/out.gb $gbtemp
 rc=$(($? || $rc))
 
+i="fix.asm"
+startTest
+$RGBASM -o $otemp fix/a.asm
+# Fixing while linking must give the same ROM as fixing afterwards
+rgblinkQuiet -f '-v -p 0xFF -m MBC1 -n 1 -t "A B"' -o $gbtemp $otemp
+rgblinkQuiet -o $gbtemp2 $otemp
+$RGBFIX -v -p 0xFF -m MBC1 -n 1 -t "A B" $gbtemp2
+tryCmp $gbtemp $gbtemp2
+rc=$(($? || $rc))
+(rgblinkQuiet -f '-v -t "A B' -o $gbtemp $otemp
+ rgblinkQuiet -f '-Z' -o $gbtemp $otemp) > $outtemp 2>&1
+tryDiff fix/out.err $outtemp
+rc=$(($? || $rc))
+
 i="section-fragment/jr-offset.asm"
 startTest
 $RGBASM -o $otemp section-fragment/jr-offset/a.asm